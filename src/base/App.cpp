@@ -9,6 +9,10 @@
 #include "base/Random.hpp"
 
 #include "RayTracer.hpp"
+#include "RenderPool.hpp"
+#include "TraceEvents.hpp"
+#include "RayDump.hpp"
+#include "Validation.hpp"
 #include "rtlib.hpp"
 
 #include <stdio.h>
@@ -26,11 +30,6 @@ using namespace FW;
 
 //------------------------------------------------------------------------
 
-bool fileExists(std::string fileName)
-{
-	return std::ifstream(fileName).good();
-}
-
 App::App(std::vector<std::string>& cmd_args)
 	: m_commonCtrl(CommonControls::Feature_Default & ~CommonControls::Feature_RepaintOnF5),
 	m_cameraCtrl(&m_commonCtrl, CameraControls::Feature_Default | CameraControls::Feature_StereoControls),
@@ -43,7 +42,10 @@ App::App(std::vector<std::string>& cmd_args)
 	m_numAARays		(1),
 	m_aoRayLength	(1.0f),
 	m_whittedBounces(3),
-	m_toneMap		(false)
+	m_toneMap		(false),
+	m_layoutPending	(false),
+	m_progressive	(false),
+	m_showAOSamples	(false)
 {
 
 	m_commonCtrl.showFPS(true);
@@ -56,12 +58,19 @@ App::App(std::vector<std::string>& cmd_args)
 	m_commonCtrl.addToggle(&m_specularMapped, FW_KEY_NONE, "Enable Specular");
 	m_commonCtrl.addToggle(&m_bilinearFiltering, FW_KEY_NONE, "Enable Bilinear Filtering");
 	m_commonCtrl.addToggle(&m_useSAH, FW_KEY_NONE, "Use SAH");
+	m_commonCtrl.addToggle(&(m_settings.two_level), FW_KEY_NONE, "Use two-level BVH (reload mesh to apply)");
+	m_commonCtrl.addToggle(&(m_settings.optimize_bvh), FW_KEY_NONE, "Optimize BVH with treelet restructuring (reload mesh to apply)");
+	m_commonCtrl.addToggle(&(m_settings.presplit), FW_KEY_NONE, "Pre-split large triangles before BVH build (reload mesh to apply)");
+	m_commonCtrl.addToggle((S32*)&(m_settings.bvh_layout), BvhLayout_DepthFirst, FW_KEY_NONE, "BVH node layout: depth first (reload mesh to apply)");
+	m_commonCtrl.addToggle((S32*)&(m_settings.bvh_layout), BvhLayout_VanEmdeBoas, FW_KEY_NONE, "BVH node layout: van Emde Boas (reload mesh to apply)");
+	m_commonCtrl.addToggle((S32*)&(m_settings.bvh_layout), BvhLayout_HotTreelets, FW_KEY_NONE, "BVH node layout: hot treelets from a sample render (reload mesh to apply)");
 	m_commonCtrl.addSeparator();
 
 	m_commonCtrl.addButton((S32*)&m_action, Action_LoadMesh, FW_KEY_M, "Load mesh or state... (M)");
 	m_commonCtrl.addButton((S32*)&m_action, Action_ReloadMesh, FW_KEY_F5, "Reload mesh (F5)");
 	m_commonCtrl.addButton((S32*)&m_action, Action_SaveMesh, FW_KEY_O, "Save mesh... (O)");
 	m_commonCtrl.addButton((S32*)&m_action, Action_LoadBVH, FW_KEY_NONE, "Load BVH from file...");
+	m_commonCtrl.addButton((S32*)&m_action, Action_ReportBVH, FW_KEY_NONE, "Report BVH quality (slow)");
 	m_commonCtrl.addSeparator();
 
 	m_commonCtrl.addButton((S32*)&m_action, Action_ResetCamera, FW_KEY_NONE, "Reset camera");
@@ -112,10 +121,19 @@ App::App(std::vector<std::string>& cmd_args)
 
 	m_commonCtrl.addButton((S32*)&m_action, Action_TracePrimaryRays,        FW_KEY_ENTER,   "Trace Rays (ENTER)");
 	m_commonCtrl.addToggle(&m_showRTImage,									FW_KEY_SPACE,	"Show Ray Tracer result (SPACE)" );
+	m_commonCtrl.addToggle(&m_progressive,									FW_KEY_NONE,	"Progressive rendering, refines while the view is still");
+	m_commonCtrl.addToggle(&m_settings.adaptive_ao,							FW_KEY_NONE,	"Adaptive AO, fewer rays where the estimate has converged");
+	m_commonCtrl.addToggle(&m_showAOSamples,								FW_KEY_NONE,	"Show AO rays per pixel instead of the image");
 
 	m_commonCtrl.addToggle((S32*)&m_shadingMode, Renderer::ShadingMode_Headlight,			FW_KEY_F1,    "Headlight shading (F1)");
 	m_commonCtrl.addToggle((S32*)&m_shadingMode, Renderer::ShadingMode_AmbientOcclusion, FW_KEY_F2, "Ambient occlusion shading (F2)");
 	m_commonCtrl.addToggle((S32*)&m_shadingMode, Renderer::ShadingMode_Whitted, FW_KEY_F3, "Extra: shading using whitted integrator (F3)");
+	m_commonCtrl.addToggle((S32*)&(m_settings.aa_filter), Renderer::Filter_Box, FW_KEY_NONE, "AA filter: box");
+	m_commonCtrl.addToggle((S32*)&(m_settings.aa_filter), Renderer::Filter_Tent, FW_KEY_NONE, "AA filter: tent");
+	m_commonCtrl.addToggle((S32*)&(m_settings.aa_filter), Renderer::Filter_Gaussian, FW_KEY_NONE, "AA filter: gaussian");
+	m_commonCtrl.addToggle((S32*)&(m_settings.sampler), Sampler_Random, FW_KEY_NONE, "Samples: random");
+	m_commonCtrl.addToggle((S32*)&(m_settings.sampler), Sampler_Sobol, FW_KEY_NONE, "Samples: scrambled Sobol");
+	m_commonCtrl.addToggle((S32*)&(m_settings.sampler), Sampler_Halton, FW_KEY_NONE, "Samples: rotated Halton");
 
 	m_commonCtrl.addSeparator();
 
@@ -123,6 +141,8 @@ App::App(std::vector<std::string>& cmd_args)
 	m_commonCtrl.addSlider(&m_numAARays, 1, 128, true, FW_KEY_NONE, FW_KEY_NONE, "AA rays= %d");
 	m_commonCtrl.addSlider(&m_numAORays, 1, 256, true, FW_KEY_NONE, FW_KEY_NONE, "AO rays= %d");
 	m_commonCtrl.addSlider(&m_aoRayLength, 0.1f, 10.0f, false, FW_KEY_NONE, FW_KEY_NONE, "AO ray length= %.2f");
+	m_commonCtrl.addSlider(&m_settings.aa_filter_radius, 0.5f, 2.0f, false, FW_KEY_NONE, FW_KEY_NONE, "AA filter radius= %.2f");
+	m_commonCtrl.addSlider(&m_settings.adaptive_threshold, 0.001f, 0.1f, true, FW_KEY_NONE, FW_KEY_NONE, "Adaptive AO threshold= %.3f");
 	m_commonCtrl.endSliderStack();
 
 	m_window.addListener(this);
@@ -135,8 +155,11 @@ App::App(std::vector<std::string>& cmd_args)
 	m_rtImage.reset(new Image( m_window.getSize(), ImageFormat::RGBA_Vec4f));
 	m_renderer.reset(new Renderer);
 
-	process_args(cmd_args);
+	m_settings.parse(cmd_args);
 
+	// the worker threads live as long as the app, so every frame and build reuses them
+	RenderPool::get().configure(m_settings.threads, m_settings.pin_threads);
+	std::cout << "Render threads: " << RenderPool::get().getNumThreads() << (m_settings.pin_threads ? ", pinned" : "") << std::endl;
 
 
 	if (!m_settings.batch_render) {
@@ -145,6 +168,14 @@ App::App(std::vector<std::string>& cmd_args)
 	}
 	else {
 
+		// the phases are timed by the framework profiler, printed at the end and added to the results
+		if (m_settings.profile) {
+			profileStart();
+			m_renderer->setPhaseTiming(true);
+		}
+		if (!m_settings.trace_file.empty())
+			TraceEvents::enable();
+
 		m_commonCtrl.loadState(cmd_args[1].c_str());
 
 		std::cout << cmd_args[1].c_str() << std::endl;
@@ -176,141 +207,95 @@ App::App(std::vector<std::string>& cmd_args)
 
 		m_renderer->setSpecularMapping(m_specularMapped);
 		m_renderer->setBilinearFiltering(m_bilinearFiltering);
-
-		timingResult res = m_renderer->rayTracePicture(m_rt.get(), m_rtImage.get(), m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode);
+		m_renderer->setFilter(m_settings.aa_filter, m_settings.aa_filter_radius);
+		m_renderer->setSampler(m_settings.sampler);
+		m_renderer->setAdaptiveAO(m_settings.adaptive_ao, m_settings.adaptive_threshold);
+
+		layoutTracer();
+
+		// a sample of rays against brute force and the reference library, before and apart from the timed render
+		if (m_settings.validate_rays > 0 && !validateTracer())
+			::exit(1);
+
+		if (!m_settings.ray_dump_file.empty())
+			RayDump::enable();
+
+		timingResult res;
+		profilePush("Render");
+		if (m_settings.time_budget > 0.0f) {
+			// equal time: AO keeps adding samples until the budget is used up
+			m_renderer->setProgressiveUnlimited(true);
+			res = m_renderer->renderProgressive(m_rt.get(), m_rtImage.get(), m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode, m_settings.time_budget);
+			std::cout << "Progressive render: " << m_renderer->getProgressiveSamples() << " samples per pixel in " << res.duration << " ms" << std::endl;
+		}
+		else
+			res = m_renderer->rayTracePicture(m_rt.get(), m_rtImage.get(), m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode);
+		profileRenderPhases(*m_renderer);
+		profilePop();
 		m_RTTextureNeedsUpload = true;
 
 		m_results.trace_time = res.duration;
 		m_results.rayCount = res.rayCount;
-		if (m_settings.output_images) {
-			FW::exportImage(std::string("images/"+m_results.state_name + ".png").c_str(), m_rtImage.get());
-		}
-
-		// :: alone refers to the local anonymous namespace (present if no other specified)
-		bool created = !(::fileExists(cmd_args[2]));
-
-		std::ofstream result(cmd_args[2], std::ios_base::out|std::ios_base::app);
-
-		if (created)
-			result << "set_name scene_name state_name build_time(ms) trace_time(ms) ray_count" << std::endl;
-
-		result << cmd_args[3] << " " << m_results.scene_name << " " << m_results.state_name << " " << m_results.build_time << " " << m_results.trace_time << " " << m_results.rayCount << std::endl;
-
-		exit(0);
-	}
-	m_timer.start();
-}
-
-// returns the index of the needle in the haystack or -1 if not found
-int find_argument(std::string needle, std::vector<std::string> haystack) {
-
-	for (unsigned j = 0; j < haystack.size(); ++j)
-		if (!haystack[j].compare(needle))
-			return j;
-	
-	return -1;
-}
-
-void App::process_args(std::vector<std::string>& args) {
-
-	// all of the possible cmd arguments and the corresponding enums (enum value is the index of the string in the vector)
-	const std::vector<std::string> argument_names = { "-builder", "-spp", "-output_images", "-use_textures", "-bat_render", "-aa", "-ao", "-ao_length" };
-	enum argument { arg_not_found = -1, builder = 0, spp = 1, output_images = 2, use_textures = 3, bat_render = 4, AA = 5, AO = 6, AO_length = 7 };
-
-	// similarly a list of the implemented BVH builder types
-	const std::vector<std::string> builder_names = { "none", "sah", "object_median", "spatial_median", "linear" };
-	enum builder_type { builder_not_found = -1, builder_None = 0, builder_SAH = 1, builder_ObjectMedian = 2, builder_SpatialMedian = 3, builder_Linear = 4 };
-
-	m_settings.batch_render = false;
-	m_settings.output_images = false;
-	m_settings.use_textures = true;
-	m_settings.sample_type = AA_sampling;
-	m_settings.ao_length = 1.0f;
-	m_settings.spp = 1;
-	m_settings.splitMode = SplitMode_Sah;
-
-	for (unsigned i = 0; i < args.size(); ++i) {
+		m_results.collectThreads(*m_renderer);
 
-		// try to recognize the argument
-		argument cmd = argument(find_argument(args[i], argument_names));
-
-		switch (cmd) {
-
-		case bat_render:
-			m_settings.batch_render = true;
-			break;
-
-		case output_images:
-			m_settings.output_images = true;
-			break;
-		
-		case use_textures:
-			m_settings.use_textures = true;
-			break;
-		
-		case AO:
-			m_settings.sample_type = AO_sampling;
-			break;
-
-		case AA:
-			m_settings.sample_type = AA_sampling;
-			break;
-
-		case spp:
-			++i;
-			m_settings.spp = std::stoi(args[i]);
-			break;
-
-		case AO_length:
-			++i;
-			m_settings.ao_length = std::stof(args[i]);
-			break;
+		if (!m_settings.ray_dump_file.empty()) {
+			RayDump::disable();
+			if (!RayDump::write(m_settings.ray_dump_file, (S32)m_rtTriangles.size()))
+				std::cout << "Could not write the rays to " << m_settings.ray_dump_file << std::endl;
+		}
 
-		case builder: {
+		if (m_settings.mem_report)
+			printMemoryReport("after render");
+		if (!checkMemoryBudget(m_settings.mem_budget))
+			::exit(1);
 
-			++i;
-			builder_type type = builder_type(find_argument(args[i], builder_names));
+		if (m_settings.output_images) {
+			profilePush(batchPhaseName(BatchPhase_ImageExport));
+			FW::exportImage(std::string("images/"+m_results.state_name + ".png").c_str(), m_rtImage.get());
 
-			if (type==builder_not_found) {
-				type = builder_SAH;
-				std::cout << "BVH builder not recognized, using Surface Area Heuristic" << std::endl;
-				break;
+			// where the AO rays went, white is the full AO ray count
+			if (m_settings.adaptive_ao && m_settings.time_budget <= 0.0f) {
+				Image samples(m_rtImage->getSize(), ImageFormat::RGBA_Vec4f);
+				m_renderer->getAOSamplesImage(&samples);
+				FW::exportImage(std::string("images/" + m_results.state_name + "_spp.png").c_str(), &samples);
 			}
+			profilePop();
+		}
 
-			switch (type) {
-
-			case builder_None:
-				m_settings.splitMode = SplitMode_None;
-				break;
-			
-			case builder_SAH:
-				m_settings.splitMode = SplitMode_Sah;
-				break;
-
-			case builder_ObjectMedian:
-				m_settings.splitMode = SplitMode_ObjectMedian;
-				break;
-
-			case builder_SpatialMedian:
-				m_settings.splitMode = SplitMode_SpatialMedian;
-				break;
-
-			case builder_Linear:
-				m_settings.splitMode = SplitMode_Linear;
-				break;
-			}
+		if (!m_settings.image_diff_folder.empty() &&
+			!diffBatchImage(*m_rtImage, m_settings.image_diff_folder, m_results.state_name, m_settings.min_psnr, m_settings.output_images))
+			::exit(1);
 
-			break;
+		if (m_settings.profile) {
+			m_results.collectPhases();
+			profileEnd();
 		}
+		m_results.append(cmd_args[2], cmd_args[3]);
 
+		if (!m_settings.trace_file.empty()) {
+			TraceEvents::disable();
+			if (!TraceEvents::write(m_settings.trace_file))
+				std::cout << "Could not write the trace to " << m_settings.trace_file << std::endl;
+		}
 
-		default:
-			if (args[i][0] == '-')std::cout << "argument \"" << args[i] << "\" not found!" << std::endl;
-
+		// BVH statistics go to a separate file next to the results, e.g. results_bvh.txt
+		if (m_settings.bvh_report) {
+			BvhReport report = m_rt->analyzeHierarchy(true);
+			report.print();
+
+			std::string reportName = cmd_args[2].substr(0, cmd_args[2].find_last_of(".")) + "_bvh.txt";
+			bool reportCreated = !FW::fileExists(reportName);
+			std::ofstream reportFile(reportName, std::ios_base::out | std::ios_base::app);
+			if (reportCreated)
+				reportFile << "set_name scene_name state_name " << BvhReport::header() << std::endl;
+			reportFile << cmd_args[3] << " " << m_results.scene_name << " " << m_results.state_name << " ";
+			report.writeLine(reportFile);
+			reportFile << std::endl;
 		}
+
+		exit(0);
 	}
-	if (m_settings.batch_render)
-		m_settings.use_textures = false;
+	m_timer.start();
 }
 
 //------------------------------------------------------------------------
@@ -368,6 +353,12 @@ bool App::handleEvent(const Window::Event& ev)
 	case Action_LoadBVH:
 		name = m_window.showFileLoadDialog("Load bvh", "hierarchy:BVH");
 		m_rt->loadHierarchy(name.getPtr(), m_rtTriangles);
+		m_rt->analyzeHierarchy(false).print();
+		break;
+
+	case Action_ReportBVH:
+		if (m_rt)
+			m_rt->analyzeHierarchy(true).print();
 		break;
 
 	case Action_ResetCamera:
@@ -513,8 +504,20 @@ bool App::handleEvent(const Window::Event& ev)
 
 			m_renderer->setSpecularMapping(m_specularMapped);
 			m_renderer->setBilinearFiltering(m_bilinearFiltering);
-			
-			m_renderer->rayTracePicture(m_rt.get(), m_rtImage.get(), m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode);
+			m_renderer->setFilter(m_settings.aa_filter, m_settings.aa_filter_radius);
+			m_renderer->setSampler(m_settings.sampler);
+			m_renderer->setAdaptiveAO(m_settings.adaptive_ao, m_settings.adaptive_threshold);
+
+			layoutTracer();
+
+			// in progressive mode, renderFrame does the work a little at a time
+			if (m_progressive)
+				m_renderer->resetProgressive();
+			else {
+				m_renderer->rayTracePicture(m_rt.get(), m_rtImage.get(), m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode);
+				if (m_showAOSamples)
+					m_renderer->getAOSamplesImage(m_rtImage.get());
+			}
 			m_RTTextureNeedsUpload = true;
 
 			m_showRTImage = true;
@@ -591,6 +594,18 @@ void App::renderFrame(GLContext* gl)
 		m_rtImage.reset(new Image( m_window.getSize(), ImageFormat::RGBA_Vec4f ));
 	}
 
+	// refine the progressive image for a frame's worth of time and come back for more until it is done;
+	// moving the camera restarts it, so the view stays interactive even with many AO rays
+	if ( m_showRTImage && m_progressive && m_rt )
+	{
+		timingResult res = m_renderer->renderProgressive(m_rt.get(), m_rtImage.get(), m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode, 1.0f / 30.0f);
+		if (res.rayCount > 0)
+			m_RTTextureNeedsUpload = true;
+		m_commonCtrl.message(sprintf("%d samples per pixel", m_renderer->getProgressiveSamples()), "progressive");
+		if (!m_renderer->isProgressiveDone((Renderer::ShadingMode)m_shadingMode))
+			m_window.repaint();
+	}
+
 	// if desired, show the ray traced result image
 	if ( m_showRTImage )
 	{
@@ -781,8 +796,14 @@ void App::loadMesh(const String& fileName)
 	std::cout << "Scene name: " << m_results.scene_name << std::endl;
 
 	m_window.showModalMessage(sprintf("Loading mesh from '%s'...", fileName.getPtr()));
+	TraceSpan loadSpan("Mesh load", "load");
+	profilePush(batchPhaseName(BatchPhase_MeshLoad));
+	pushMemOwner("Mesh");
 	String oldError = clearError();
 	std::unique_ptr<MeshBase> mesh((MeshBase*)importMesh(fileName));
+	popMemOwner();
+	profilePop();
+	loadSpan.end();
 
 	String newError = getError();
 
@@ -794,7 +815,9 @@ void App::loadMesh(const String& fileName)
 
 	m_meshFileName = fileName;
 
+	pushMemOwner("Mesh");
 	m_mesh.reset(new Mesh<VertexPNTC>(*mesh));
+	popMemOwner();
 
 	// fix input colors to white so we see something
 	for ( S32 i = 0; i < m_mesh->numVertices(); ++i )
@@ -841,6 +864,9 @@ void App::saveMesh(const String& fileName)
 void App::constructTracer()
 {
 	// fetch vertex and triangle data ----->
+	TraceSpan trianglesSpan("Triangle setup", "load", "triangles", m_mesh->numTriangles());
+	profilePush(batchPhaseName(BatchPhase_Triangles));
+	pushMemOwner("Triangles");
 	m_rtTriangles.clear();
 	m_rtTriangles.reserve(m_mesh->numTriangles());
 
@@ -865,8 +891,14 @@ void App::constructTracer()
 	}
 
 
+	popMemOwner();
+	profilePop();
+	trianglesSpan.end();
+
 	// compute checksum
 
+	TraceSpan md5Span("MD5", "load");
+	profilePush(batchPhaseName(BatchPhase_Md5));
 	m_rtVertexPositions.clear();
 	m_rtVertexPositions.reserve(m_mesh->numVertices());
 	for (int i = 0; i < m_mesh->numVertices(); ++i)
@@ -874,16 +906,40 @@ void App::constructTracer()
 
 	String md5 = RayTracer::computeMD5(m_rtVertexPositions);
 	FW::printf("Mesh MD5: %s\n", md5.getPtr());
+	profilePop();
+	md5Span.end();
 
 	// construct a new ray tracer (deletes the old one if there was one)
 	m_rt.reset(new RayTracer());
+	m_rt->setPresplit(m_settings.presplit ? m_settings.presplit_growth : 0.0f);
+	m_rt->setLayout(m_settings.bvh_layout);
+	m_layoutPending = (m_settings.bvh_layout == BvhLayout_HotTreelets);
 
 	// whether we want to try loading a saved hierarchy from disk
 	bool tryLoadHierarchy = true;
 
-	// always construct when measuring performance
+	// always construct when measuring performance, unless a hierarchy file is given to be evaluated
 	if (m_settings.batch_render)
 		tryLoadHierarchy = false;
+	if (m_settings.batch_render && !m_settings.hierarchy_file.empty())
+	{
+		profilePush(batchPhaseName(BatchPhase_HierarchyFile));
+		m_rt->loadHierarchy(m_settings.hierarchy_file.c_str(), m_rtTriangles);
+		profilePop();
+		BvhReport report = m_rt->analyzeHierarchy(false);
+		if (report.valid())
+		{
+			::printf("Loaded hierarchy from %s\n", m_settings.hierarchy_file.c_str());
+			m_results.build_time = 0;
+			m_renderer->gatherLightTriangles(m_rt.get());
+			return;
+		}
+		::printf("Ignoring hierarchy %s: %s\n", m_settings.hierarchy_file.c_str(), report.errors().c_str());
+	}
+
+	// the hierarchy cache only holds single-level BVHs
+	if (m_settings.two_level)
+		tryLoadHierarchy = false;
 
 	if (m_useSAH) {
 		m_settings.splitMode = SplitMode_Sah;
@@ -901,32 +957,48 @@ void App::constructTracer()
 #ifdef _WIN64
 		hierarchyName += "_x64";
 #endif
+		if (m_settings.presplit)
+			hierarchyName += "_presplit";
 		
 		hierarchyName += ".hierarchy";
 
 		String hierarchyCacheFile = hierarchyName.c_str();
 
+		// the cache is only used if it is a consistent hierarchy over exactly the current triangles
+		bool loaded = false;
 		if (fileExists(hierarchyCacheFile.getPtr()))
 		{
 			// yes, load!
+			profilePush(batchPhaseName(BatchPhase_HierarchyFile));
 			m_rt->loadHierarchy(hierarchyCacheFile.getPtr(), m_rtTriangles);
-			::printf("Loaded hierarchy from %s\n", hierarchyCacheFile.getPtr());
+			profilePop();
+			BvhReport report = m_rt->analyzeHierarchy(false);
+			loaded = report.valid();
+			if (loaded)
+				::printf("Loaded hierarchy from %s\n", hierarchyCacheFile.getPtr());
+			else
+				::printf("Ignoring hierarchy %s: %s\n", hierarchyCacheFile.getPtr(), report.errors().c_str());
 		}
-		else
+
+		if (!loaded)
 		{
 			// no, construct...
-			LARGE_INTEGER start, stop, frequency;
-			QueryPerformanceFrequency(&frequency);
-			QueryPerformanceCounter(&start); // Start time stamp		
+			auto start = std::chrono::high_resolution_clock::now(); // Start time stamp
 
+			profilePush(batchPhaseName(BatchPhase_Build));
 			m_rt->constructHierarchy(m_rtTriangles, m_settings.splitMode);
+			profilePop();
 
-			QueryPerformanceCounter(&stop); // Stop time stamp
-
-			int build_time = (int)((stop.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart); // Get timer result in milliseconds
+			int build_time = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count(); // Get timer result in milliseconds
 			std::cout << "Build time: " << build_time << " ms" << std::endl;
+			reportPresplit();
+
+			if (m_settings.optimize_bvh)
+				optimizeTracer();
 			// .. and save!
+			profilePush(batchPhaseName(BatchPhase_HierarchyFile));
 			m_rt->saveHierarchy(hierarchyCacheFile.getPtr(), m_rtTriangles);
+			profilePop();
 			::printf("Saved hierarchy to %s\n", hierarchyCacheFile.getPtr());
 		}
 	}
@@ -934,16 +1006,33 @@ void App::constructTracer()
 	{
 		// nope, bite the bullet and construct it
 
-		LARGE_INTEGER start, stop, frequency;
-		QueryPerformanceFrequency(&frequency);
-		QueryPerformanceCounter(&start); // Start time stamp		
+		auto start = std::chrono::high_resolution_clock::now(); // Start time stamp
+		profilePush(batchPhaseName(BatchPhase_Build));
 		
-		m_rt->constructHierarchy(m_rtTriangles, m_settings.splitMode);
-
-		QueryPerformanceCounter(&stop); // Stop time stamp
+		if (m_settings.two_level)
+		{
+			// the triangles were appended submesh by submesh above, so every submesh is a contiguous range
+			std::vector<std::pair<size_t, size_t>> ranges;
+			size_t first = 0;
+			for (int i = 0; i < m_mesh->numSubmeshes(); ++i)
+			{
+				size_t count = m_mesh->indices(i).getSize();
+				ranges.emplace_back(first, first + count);
+				first += count;
+			}
+			m_rt->constructTwoLevelHierarchy(m_rtTriangles, ranges, m_settings.splitMode);
+			::printf("Built %d bottom-level hierarchies\n", (int)m_rt->getNumBottomLevel());
+		}
+		else
+			m_rt->constructHierarchy(m_rtTriangles, m_settings.splitMode);
 
-		m_results.build_time = (int)((stop.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart); // Get timer result in milliseconds
+		profilePop();
+		m_results.build_time = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count(); // Get timer result in milliseconds
 		std::cout << "Build time: " << m_results.build_time << " ms"<< std::endl;
+		reportPresplit();
+
+		if (m_settings.optimize_bvh)
+			optimizeTracer();
 	}
 
 	// m_rt is complete and mesh data will be constant from now on, so we can gather the emissive triangles
@@ -952,26 +1041,96 @@ void App::constructTracer()
 
 
 
+//------------------------------------------------------------------------
+
+void App::optimizeTracer()
+{
+	pushMemOwner("BVH");
+	BvhOptimizer::Stats stats = m_rt->optimizeHierarchy();
+	popMemOwner();
+	::printf("Treelet optimization: SAH cost %.2f -> %.2f (%.1f%%) in %d ms\n",
+		stats.sahBefore, stats.sahAfter, 100.0f * (stats.sahAfter - stats.sahBefore) / stats.sahBefore, (int)(stats.seconds * 1000.0f));
+}
+
+//------------------------------------------------------------------------
+
+// The hot treelet layout needs to know which nodes the rays actually visit, so the first
+// picture after building is preceded by a quarter resolution sample render that counts them.
+void App::layoutTracer()
+{
+	if (!m_layoutPending || !m_rt)
+		return;
+	m_layoutPending = false;
+
+	Timer timer(true);
+	Image sample(max(m_rtImage->getSize() / 4, Vec2i(1)), ImageFormat::RGBA_Vec4f);
+	m_rt->beginVisitCounting();
+	m_renderer->rayTracePicture(m_rt.get(), &sample, m_cameraCtrl, (Renderer::ShadingMode)m_shadingMode);
+	m_rt->applyLayout(BvhLayout_HotTreelets);
+	::printf("Hot treelet layout from a %dx%d sample render in %d ms\n", sample.getSize().x, sample.getSize().y, (int)(timer.getElapsed() * 1000.0f));
+}
+
+//------------------------------------------------------------------------
+
+// -validate: the hits of a sample of rays against brute force, and those of the reference library's
+// hierarchy of the same builder against the same brute force hits, so that a disagreement shows whose
+// traversal is off. The library gets its own copy of the triangles; it keeps their order as ours does.
+bool App::validateTracer()
+{
+	ReferenceRays reference;
+	bool agrees = validateTraversal(*m_rt, m_rtTriangles, m_cameraCtrl, m_rtImage->getSize(), m_settings.ao_length, m_settings.validate_rays, &reference);
+
+	std::vector<RTTriangle> libTriangles(m_rtTriangles);
+	rtlib::RayTracer lib;
+	lib.constructHierarchy(libTriangles, m_settings.splitMode);
+	HitComparison primary, ao;
+	compareWithReference(reference, libTriangles, [&](const Vec3f& orig, const Vec3f& dir) { return lib.raycast(orig, dir); }, primary, ao);
+	printHitComparison("Reference library against brute force", primary, ao);
+	return agrees && primary.agrees() && ao.agrees();
+}
+
+//------------------------------------------------------------------------
+
+void App::reportPresplit()
+{
+	if (m_rt->getNumPresplits() == 0)
+		return;
+	::printf("Pre-split: %d triangles -> %d references (+%.1f%%, capped at +%.0f%%)\n",
+		(int)m_rtTriangles.size(), (int)m_rt->getNumReferences(),
+		100.0f * m_rt->getNumPresplits() / m_rtTriangles.size(), 100.0f * m_settings.presplit_growth);
+}
+
 //------------------------------------------------------------------------
 
 void App::downscaleTextures(MeshBase* mesh)
 {
 	FW_ASSERT(mesh);
 	Hash<const Image*, Texture> hash;
+	std::vector<const Image*> images;
 	for (int submeshIdx = 0; submeshIdx < mesh->numSubmeshes(); submeshIdx++)
 		for (int textureIdx = 0; textureIdx < MeshBase::TextureType_Max; textureIdx++)
 		{
-		Texture& tex = mesh->material(submeshIdx).textures[textureIdx];
-		if (tex.exists())
+		const Texture& tex = mesh->material(submeshIdx).textures[textureIdx];
+		if (tex.exists() && !hash.contains(tex.getImage()))
 		{
-			const Image* orig = tex.getImage();
-			if (!hash.contains(orig))
-			{
-				Image* scaled = orig->downscale2x();
-				hash.add(orig, (scaled) ? Texture(scaled, tex.getID()) : tex);
-			}
-			tex = hash.get(orig);
+			hash.add(tex.getImage(), tex);
+			images.push_back(tex.getImage());
+		}
 		}
+
+	// filtering the images is independent, creating the textures touches the global texture cache
+	std::vector<Image*> scaled(images.size(), nullptr);
+	RenderPool::get().parallelFor((int)images.size(), [&](int i, int) { scaled[i] = images[i]->downscale2x(); });
+	for (size_t i = 0; i < images.size(); i++)
+		if (scaled[i])
+			hash.get(images[i]) = Texture(scaled[i], hash.get(images[i]).getID());
+
+	for (int submeshIdx = 0; submeshIdx < mesh->numSubmeshes(); submeshIdx++)
+		for (int textureIdx = 0; textureIdx < MeshBase::TextureType_Max; textureIdx++)
+		{
+		Texture& tex = mesh->material(submeshIdx).textures[textureIdx];
+		if (tex.exists())
+			tex = hash.get(tex.getImage());
 		}
 }
 
@@ -13,6 +13,7 @@
 #include "RayTracer.hpp"
 
 #include "Renderer.hpp"
+#include "BatchSettings.hpp"
 
 
 namespace FW {
@@ -31,6 +32,7 @@ private:
         Action_ReloadMesh,
         Action_SaveMesh,
 		Action_LoadBVH,
+		Action_ReportBVH,
 
         Action_ResetCamera,
         Action_EncodeCameraSignature,
@@ -73,27 +75,8 @@ private:
     };
 
 	enum bvh_build_method { None, SAH };
-	enum SamplingType { AO_sampling, AA_sampling };
-	// this structure holds the necessary arguments when rendering using command line parameters
-	struct {
-		bool batch_render;
-		SplitMode splitMode;		// the BVH builder to use
-		int spp;					// samples per pixel to use
-		SamplingType sample_type;	// AO or AA sampling; AO includes one extra sample for the primary ray
-		bool output_images;			// might be useful to compare images with the example
-		bool use_textures;			// whether or not textures are used
-		bool use_arealights;		// whether or not area light sampling is used
-		bool enable_reflections;	// whether to compute reflections in whitted integrator
-		float ao_length;			
-	} m_settings;
-	
-	struct {
-		std::string state_name;										// filenames of the state and scene files
-		std::string scene_name;
-		int rayCount;
-		int build_time, trace_time;
-
-	} m_results;
+	BatchSettings	m_settings;		// the command line of a batch render
+	BatchResults	m_results;
 
 public:
 					 App			(std::vector<std::string>& cmd_args);
@@ -104,8 +87,6 @@ public:
     virtual void    writeState      (StateDump& d) const;
 
 private:
-	void			process_args	(std::vector<std::string>& args);
-
     void            waitKey         (void);
     void            renderFrame     (GLContext* gl);
     void            renderScene     (GLContext* gl, const Mat4f& worldToCamera, const Mat4f& projection);
@@ -120,6 +101,10 @@ private:
 
     // 
 	void			constructTracer(void);
+	void			optimizeTracer(void);
+	void			reportPresplit(void);
+	void			layoutTracer(void);
+	bool			validateTracer(void);
 
 	void			blitRttToScreen(GLContext* gl);
 
@@ -161,6 +146,9 @@ private:
     bool								m_specularMapped;
     bool								m_useSAH;
     bool                                m_bilinearFiltering;
+	bool								m_layoutPending;	// hot treelet layout waits for the first render
+	bool								m_progressive;		// refine the ray traced image a little every frame
+	bool								m_showAOSamples;	// show the AO rays per pixel instead of the ray traced image
 };
 
 
@@ -0,0 +1,427 @@
+#include "BatchSettings.hpp"
+
+#include "base/Defs.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+
+
+namespace FW {
+
+
+namespace {
+
+// returns the index of the needle in the haystack or -1 if not found
+int find_argument(const std::string& needle, const std::vector<std::string>& haystack) {
+
+	for (unsigned j = 0; j < haystack.size(); ++j)
+		if (!haystack[j].compare(needle))
+			return j;
+	
+	return -1;
+}
+
+}
+
+void BatchSettings::parse(const std::vector<std::string>& args) {
+
+	// all of the possible cmd arguments and the corresponding enums (enum value is the index of the string in the vector)
+	const std::vector<std::string> argument_names = { "-builder", "-spp", "-output_images", "-use_textures", "-bat_render", "-aa", "-ao", "-ao_length", "-two_level", "-optimize_bvh", "-presplit", "-bvh_layout", "-bvh_report", "-hierarchy", "-threads", "-pin_threads", "-time_budget", "-filter", "-filter_radius", "-sampler", "-adaptive_ao", "-profile", "-trace_events", "-perf_counters", "-mem_report", "-mem_budget", "-ray_dump", "-validate", "-image_diff", "-min_psnr" };
+	enum argument { arg_not_found = -1, arg_builder = 0, arg_spp = 1, arg_output_images = 2, arg_use_textures = 3, arg_bat_render = 4, arg_AA = 5, arg_AO = 6, arg_AO_length = 7, arg_two_level = 8, arg_optimize_bvh = 9, arg_presplit = 10, arg_bvh_layout = 11, arg_bvh_report = 12, arg_hierarchy = 13, arg_threads = 14, arg_pin_threads = 15, arg_time_budget = 16, arg_filter = 17, arg_filter_radius = 18, arg_sampler = 19, arg_adaptive_ao = 20, arg_profile = 21, arg_trace_events = 22, arg_perf_counters = 23, arg_mem_report = 24, arg_mem_budget = 25, arg_ray_dump = 26, arg_validate = 27, arg_image_diff = 28, arg_min_psnr = 29 };
+
+	// similarly a list of the implemented BVH builder types
+	const std::vector<std::string> layout_names = { "dfs", "veb", "hot" };
+
+	// and the AA reconstruction filters
+	const std::vector<std::string> filter_names = { "box", "tent", "gaussian" };
+
+	// and the sample generators
+	const std::vector<std::string> sampler_names = { "random", "sobol", "halton" };
+
+	const std::vector<std::string> builder_names = { "none", "sah", "object_median", "spatial_median", "linear" };
+	enum builder_type { builder_not_found = -1, builder_None = 0, builder_SAH = 1, builder_ObjectMedian = 2, builder_SpatialMedian = 3, builder_Linear = 4 };
+
+	batch_render = false;
+	output_images = false;
+	use_textures = true;
+	use_arealights = false;
+	enable_reflections = true;
+	sample_type = AA_sampling;
+	ao_length = 1.0f;
+	spp = 1;
+	splitMode = SplitMode_Sah;
+	two_level = false;
+	optimize_bvh = false;
+	presplit = false;
+	presplit_growth = 0.3f;
+	bvh_layout = BvhLayout_DepthFirst;
+	bvh_report = false;
+	hierarchy_file.clear();
+	threads = 0;
+	pin_threads = false;
+	time_budget = 0.0f;
+	aa_filter = Renderer::Filter_Box;
+	aa_filter_radius = 0.5f;
+	sampler = Sampler_Sobol;
+	adaptive_ao = false;
+	adaptive_threshold = 0.02f;
+	profile = false;
+	trace_file.clear();
+	perf_counters = false;
+	mem_report = false;
+	mem_budget = 0.0f;
+	ray_dump_file.clear();
+	validate_rays = 0;
+	image_diff_folder.clear();
+	min_psnr = 40.0f;
+
+	for (unsigned i = 0; i < args.size(); ++i) {
+
+		// try to recognize the argument
+		argument cmd = argument(find_argument(args[i], argument_names));
+
+		switch (cmd) {
+
+		case arg_bat_render:
+			batch_render = true;
+			break;
+
+		case arg_output_images:
+			output_images = true;
+			break;
+		
+		case arg_use_textures:
+			use_textures = true;
+			break;
+		
+		case arg_AO:
+			sample_type = AO_sampling;
+			break;
+
+		case arg_AA:
+			sample_type = AA_sampling;
+			break;
+
+		case arg_spp:
+			++i;
+			spp = std::stoi(args[i]);
+			break;
+
+		case arg_AO_length:
+			++i;
+			ao_length = std::stof(args[i]);
+			break;
+
+		case arg_two_level:
+			two_level = true;
+			break;
+
+		case arg_optimize_bvh:
+			optimize_bvh = true;
+			break;
+
+		case arg_presplit:
+			++i;
+			presplit = true;
+			presplit_growth = std::stof(args[i]);
+			break;
+
+		case arg_bvh_layout: {
+			++i;
+			int layout = find_argument(args[i], layout_names);
+			if (layout < 0)
+				std::cout << "BVH layout not recognized, using depth first" << std::endl;
+			bvh_layout = layout < 0 ? BvhLayout_DepthFirst : (BvhLayout)layout;
+			break;
+		}
+
+		case arg_bvh_report:
+			bvh_report = true;
+			break;
+
+		case arg_hierarchy:
+			++i;
+			hierarchy_file = args[i];
+			break;
+
+		case arg_threads:
+			++i;
+			threads = std::stoi(args[i]);
+			break;
+
+		case arg_pin_threads:
+			pin_threads = true;
+			break;
+
+		case arg_time_budget:
+			++i;
+			time_budget = std::stof(args[i]);
+			break;
+
+		case arg_filter: {
+			++i;
+			int type = find_argument(args[i], filter_names);
+			if (type < 0)
+				std::cout << "AA filter not recognized, using box" << std::endl;
+			aa_filter = type < 0 ? Renderer::Filter_Box : (Renderer::ReconstructionFilter)type;
+			break;
+		}
+
+		case arg_filter_radius:
+			++i;
+			aa_filter_radius = std::stof(args[i]);
+			break;
+
+		case arg_sampler: {
+			++i;
+			int type = find_argument(args[i], sampler_names);
+			if (type < 0)
+				std::cout << "Sampler not recognized, using Sobol" << std::endl;
+			sampler = type < 0 ? Sampler_Sobol : (SamplerType)type;
+			break;
+		}
+
+		case arg_adaptive_ao:
+			++i;
+			adaptive_ao = true;
+			adaptive_threshold = std::stof(args[i]);
+			break;
+
+		case arg_profile:
+			profile = true;
+			break;
+
+		case arg_trace_events:
+			++i;
+			trace_file = args[i];
+			break;
+
+		case arg_perf_counters:
+			perf_counters = true;
+			break;
+
+		case arg_mem_report:
+			mem_report = true;
+			break;
+
+		case arg_mem_budget:
+			++i;
+			mem_budget = std::stof(args[i]);
+			break;
+
+		case arg_ray_dump:
+			++i;
+			ray_dump_file = args[i];
+			break;
+
+		case arg_validate:
+			++i;
+			validate_rays = std::stoi(args[i]);
+			break;
+
+		case arg_image_diff:
+			++i;
+			image_diff_folder = args[i];
+			break;
+
+		case arg_min_psnr:
+			++i;
+			min_psnr = std::stof(args[i]);
+			break;
+
+		case arg_builder: {
+
+			++i;
+			builder_type type = builder_type(find_argument(args[i], builder_names));
+
+			if (type==builder_not_found) {
+				type = builder_SAH;
+				std::cout << "BVH builder not recognized, using Surface Area Heuristic" << std::endl;
+				break;
+			}
+
+			switch (type) {
+
+			case builder_None:
+				splitMode = SplitMode_None;
+				break;
+			
+			case builder_SAH:
+				splitMode = SplitMode_Sah;
+				break;
+
+			case builder_ObjectMedian:
+				splitMode = SplitMode_ObjectMedian;
+				break;
+
+			case builder_SpatialMedian:
+				splitMode = SplitMode_SpatialMedian;
+				break;
+
+			case builder_Linear:
+				splitMode = SplitMode_Linear;
+				break;
+			}
+
+			break;
+		}
+
+
+		default:
+			if (args[i][0] == '-')std::cout << "argument \"" << args[i] << "\" not found!" << std::endl;
+
+		}
+	}
+	if (batch_render)
+		use_textures = false;
+}
+
+const char* batchPhaseName(BatchPhase phase) {
+	static const char* const names[BatchPhase_Max] = { "Mesh load", "Texture decode", "Triangle setup", "MD5", "BVH build",
+		"Hierarchy file", "Primary rays", "Shading", "Texture sampling", "Image export" };
+	return names[phase];
+}
+
+const char* batchPhaseColumn(BatchPhase phase) {
+	static const char* const columns[BatchPhase_Max] = { "mesh_load", "texture_decode", "triangle_setup", "md5", "bvh_build",
+		"hierarchy_file", "primary_rays", "shading", "texture_sampling", "image_export" };
+	return columns[phase];
+}
+
+void profileRenderPhases(const Renderer& renderer) {
+	profileAdd(batchPhaseName(BatchPhase_PrimaryRays), renderer.getPhaseTime(Renderer::RenderPhase_PrimaryRays));
+	profileAdd(batchPhaseName(BatchPhase_Shading), renderer.getPhaseTime(Renderer::RenderPhase_Shading));
+	profileAdd(batchPhaseName(BatchPhase_TextureSampling), renderer.getPhaseTime(Renderer::RenderPhase_TextureSampling));
+}
+
+void printPerfCounters(const char* what, const PerfCounters& counters, double count, const char* per) {
+	if (!counters.isValid()) {
+		std::cout << what << " counters unavailable: " << counters.getError() << std::endl;
+		return;
+	}
+	std::cout << what << " counters per " << per;
+	const char* separator = ": ";
+	for (int i = 0; i < PerfCounters::Counter_Max; ++i) {
+		double value = counters.get((PerfCounters::Counter)i);
+		if (std::isnan(value))
+			continue;
+		std::cout << separator << value / count << " " << PerfCounters::name((PerfCounters::Counter)i);
+		separator = ", ";
+	}
+	double cycles = counters.get(PerfCounters::Counter_Cycles), instructions = counters.get(PerfCounters::Counter_Instructions);
+	if (cycles > 0.0 && !std::isnan(instructions))
+		std::cout << " (IPC " << instructions / cycles << ")";
+	std::cout << std::endl;
+}
+
+void printMemoryReport(const char* when) {
+	const double megs = 1.0 / (1024.0 * 1024.0);
+	::printf("\nMemory %-17s%10s  %10s\n", when, "now MB", "peak MB");
+	::printf("  %-22s%10.1f  %10.1f\n", "Total", getMemoryUsed() * megs, getMemoryPeak() * megs);
+	for (S32 i = 0; i < getNumMemOwners(); ++i)
+		::printf("  %-22s%10.1f  %10.1f\n", getMemOwnerID(i), getMemOwnerUsed(i) * megs, getMemOwnerPeak(i) * megs);
+	if (!getNumMemOwners())
+		::printf("  (the split by owner needs a build with FW_MEM_DEBUG, e.g. cmake -DRAYTRACER_MEM_OWNERS=ON)\n");
+	::printf("\n");
+}
+
+bool checkMemoryBudget(float budgetMegs) {
+	double peak = getMemoryPeak() / (1024.0 * 1024.0);
+	if (budgetMegs <= 0.0f || peak <= budgetMegs)
+		return true;
+	::printf("Memory budget exceeded: peak %.1f MB, budget %.1f MB\n", peak, budgetMegs);
+	return false;
+}
+
+void BatchResults::collectThreads(const Renderer& renderer) {
+	const std::vector<float>& busy = renderer.getThreadBusyTimes();
+	if (busy.empty())
+		return;
+	busy_min = *std::min_element(busy.begin(), busy.end()) * 1000.0f;
+	busy_max = *std::max_element(busy.begin(), busy.end()) * 1000.0f;
+	busy_avg = std::accumulate(busy.begin(), busy.end(), 0.0f) / busy.size() * 1000.0f;
+	tiles = renderer.getNumTiles();
+	tiles_stolen = renderer.getNumTilesStolen();
+	has_threads = true;
+}
+
+void BatchResults::collectPhases() {
+	for (int i = 0; i < BatchPhase_Max; ++i)
+		phase_times[i] = profileGetTotal(batchPhaseName((BatchPhase)i)) * 1000.0f;
+	has_phases = true;
+}
+
+void BatchResults::collectCounters(const PerfCounters& build, const PerfCounters& trace, size_t triangles) {
+	for (int i = 0; i < PerfCounters::Counter_Max; ++i) {
+		build_counters[i] = triangles ? build.get((PerfCounters::Counter)i) / triangles : NAN;
+		trace_counters[i] = rayCount ? trace.get((PerfCounters::Counter)i) / rayCount : NAN;
+	}
+	has_counters = true;
+}
+
+void BatchResults::append(const std::string& fileName, const std::string& setName) const {
+	bool created = !fileExists(fileName);
+
+	// a file keeps the columns it was created with, the thread balance, phases and counters are only written to files that have them
+	bool withThreads = has_threads;
+	bool withPhases = has_phases;
+	bool withCounters = has_counters;
+	if (!created) {
+		std::ifstream existing(fileName);
+		std::string header;
+		std::getline(existing, header);
+		withThreads = header.find("busy_min(ms)") != std::string::npos;
+		withPhases = header.find(std::string(batchPhaseColumn((BatchPhase)0)) + "(ms)") != std::string::npos;
+		withCounters = header.find(std::string("trace_") + PerfCounters::name((PerfCounters::Counter)0) + "_per_ray") != std::string::npos;
+	}
+
+	// phases that were not timed and counters the machine does not have are nan, which the plotter reads as a number
+	auto counter = [](double value) { return std::isnan(value) ? std::string("nan") : std::to_string(value); };
+
+	std::ofstream result(fileName, std::ios_base::out | std::ios_base::app);
+
+	if (created) {
+		result << "set_name scene_name state_name build_time(ms) trace_time(ms) ray_count";
+		if (withThreads)
+			result << " busy_min(ms) busy_avg(ms) busy_max(ms) tiles tiles_stolen";
+		for (int i = 0; withPhases && i < BatchPhase_Max; ++i)
+			result << " " << batchPhaseColumn((BatchPhase)i) << "(ms)";
+		for (int i = 0; withCounters && i < PerfCounters::Counter_Max; ++i)
+			result << " build_" << PerfCounters::name((PerfCounters::Counter)i) << "_per_tri";
+		for (int i = 0; withCounters && i < PerfCounters::Counter_Max; ++i)
+			result << " trace_" << PerfCounters::name((PerfCounters::Counter)i) << "_per_ray";
+		result << std::endl;
+	}
+
+	result << setName << " " << scene_name << " " << state_name << " " << build_time << " " << trace_time << " " << rayCount;
+	if (withThreads && has_threads)
+		result << " " << busy_min << " " << busy_avg << " " << busy_max << " " << tiles << " " << tiles_stolen;
+	else if (withThreads)
+		result << " nan nan nan nan nan";
+	for (int i = 0; withPhases && i < BatchPhase_Max; ++i)
+		result << " " << (has_phases ? std::to_string(phase_times[i]) : "nan");
+	for (int i = 0; withCounters && i < PerfCounters::Counter_Max; ++i)
+		result << " " << (has_counters ? counter(build_counters[i]) : "nan");
+	for (int i = 0; withCounters && i < PerfCounters::Counter_Max; ++i)
+		result << " " << (has_counters ? counter(trace_counters[i]) : "nan");
+	result << std::endl;
+}
+
+std::string baseName(const std::string& path) {
+	size_t begin = path.find_last_of("/\\") + 1,
+		end = path.find_last_of(".");
+	if (end == std::string::npos || end < begin)
+		end = path.size();
+	return path.substr(begin, end - begin);
+}
+
+bool fileExists(const std::string& fileName) {
+	return std::ifstream(fileName).good();
+}
+
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+
+#include "Renderer.hpp"
+#include "BvhLayout.hpp"
+#include "PerfCounters.hpp"
+#include "rtutil.hpp"
+
+#include <vector>
+#include <string>
+
+
+namespace FW {
+
+
+enum SamplingType { AO_sampling, AA_sampling };
+
+// The command line options of a batch render. App's -bat_render mode and the headless renderer
+// parse the same arguments, so the timing scripts can drive either one.
+struct BatchSettings {
+	bool batch_render;
+	SplitMode splitMode;		// the BVH builder to use
+	int spp;					// samples per pixel to use
+	SamplingType sample_type;	// AO or AA sampling; AO includes one extra sample for the primary ray
+	bool output_images;			// might be useful to compare images with the example
+	bool use_textures;			// whether or not textures are used
+	bool use_arealights;		// whether or not area light sampling is used
+	bool enable_reflections;	// whether to compute reflections in whitted integrator
+	float ao_length;
+	bool two_level;				// one BVH per submesh, instanced into a top-level BVH
+	bool optimize_bvh;			// treelet restructuring pass after the builder
+	bool presplit;				// early split clipping of large triangles before the builder
+	float presplit_growth;		// maximum relative growth of the reference count when pre-splitting
+	BvhLayout bvh_layout;		// order of the BVH nodes in memory and in the hierarchy file
+	bool bvh_report;			// write BVH quality statistics next to the results file
+	std::string hierarchy_file;	// evaluate this hierarchy file instead of building one
+	int threads;				// render worker threads including the main thread, 0 = one per hardware thread
+	float time_budget;			// seconds for a progressive render to equal time, 0 renders all samples
+	Renderer::ReconstructionFilter aa_filter;	// weighting of the AA samples
+	float aa_filter_radius;		// in pixels, 0.5 covers the pixel
+	SamplerType sampler;		// sample points of the AA and AO rays
+	bool adaptive_ao;			// stop casting AO rays once a pixel's estimate is good enough
+	float adaptive_threshold;	// standard error of the AO estimate at which a pixel stops
+	bool pin_threads;			// bind each worker thread to its own core
+	bool profile;				// time the phases of the batch render, see BatchPhase
+	std::string trace_file;		// write a Chrome trace of the load, build and render threads here, see TraceEvents
+	bool perf_counters;			// hardware counters of the build and the render, see PerfCounters
+	bool mem_report;			// print the memory in use and its peak per owner (FW::pushMemOwner) after the render
+	float mem_budget;			// MB the peak memory may reach before the run fails, 0 = no limit
+	std::string ray_dump_file;	// record the rays of the render here for ray_replay, see RayDump
+	int validate_rays;			// check this many random primary rays and their AO rays against brute force before the render
+	std::string image_diff_folder;	// compare the image with the PNG of the state's name in this folder
+	float min_psnr;				// dB the image must reach against the reference for the run to pass
+
+	// resets everything to the defaults and then applies the recognized arguments
+	void parse(const std::vector<std::string>& args);
+};
+
+// The phases of a batch render that -profile times with the framework profiler (FW::profilePush). Mesh
+// load includes texture decode; primary rays, shading and texture sampling are the render time split by
+// where the render threads spent it (Renderer::setPhaseTiming).
+enum BatchPhase {
+	BatchPhase_MeshLoad,		// OBJ parse
+	BatchPhase_TextureDecode,
+	BatchPhase_Triangles,		// RTTriangle construction
+	BatchPhase_Md5,
+	BatchPhase_Build,
+	BatchPhase_HierarchyFile,	// hierarchy save and load
+	BatchPhase_PrimaryRays,
+	BatchPhase_Shading,			// AO and headlight shading without texture sampling
+	BatchPhase_TextureSampling,
+	BatchPhase_ImageExport,
+	BatchPhase_Max
+};
+
+const char* batchPhaseName(BatchPhase phase);		// the profiler id, e.g. "Mesh load"
+const char* batchPhaseColumn(BatchPhase phase);		// the results column without the unit, e.g. "mesh_load"
+
+// adds the render phases of the renderer's last render to the profiler, as children of the current timer
+void profileRenderPhases(const Renderer& renderer);
+
+// the memory of the whole process and of each owner now and at its peak, when is e.g. "after render"
+void printMemoryReport(const char* when);
+
+// false, with a message, if the peak memory is over the budget in MB; a budget of 0 always passes
+bool checkMemoryBudget(float budgetMegs);
+
+// prints the counters divided by count, e.g. "Trace counters per ray: 812 cycles, 1024 instructions (IPC 1.26), ..."
+void printPerfCounters(const char* what, const PerfCounters& counters, double count, const char* per);
+
+// One line of the results file of a batch render.
+struct BatchResults {
+	std::string state_name;										// filenames of the state and scene files
+	std::string scene_name;
+	int rayCount;
+	int build_time, trace_time;
+	bool has_threads = false;
+	float busy_min, busy_avg, busy_max;							// ms each render thread spent on tiles
+	int tiles, tiles_stolen;
+	bool has_phases = false;
+	float phase_times[BatchPhase_Max];							// ms
+	bool has_counters = false;
+	double build_counters[PerfCounters::Counter_Max];			// per triangle
+	double trace_counters[PerfCounters::Counter_Max];			// per ray
+
+	// the load balance of the renderer's last render, if it has one (see Renderer::getThreadBusyTimes)
+	void collectThreads(const Renderer& renderer);
+
+	// reads the phase times from the running profiler
+	void collectPhases();
+
+	// the counters of the build per triangle and of the render per ray, rayCount must be set
+	void collectCounters(const PerfCounters& build, const PerfCounters& trace, size_t triangles);
+
+	// appends "set_name scene_name state_name build_time(ms) trace_time(ms) ray_count", with the header if the file is new,
+	// and then the thread balance, the phase times and the counters if the file was created with them
+	void append(const std::string& fileName, const std::string& setName) const;
+};
+
+// the file name without preceding folders and extension, e.g. the state or scene name
+std::string baseName(const std::string& path);
+
+bool fileExists(const std::string& fileName);
+
+
+}
@@ -0,0 +1,64 @@
+#include "BuildKernels.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace FW {
+
+
+void sortByCentroid(std::vector<uint32_t>& indices, const std::vector<BuildRef>& refs, size_t start, size_t end, int axis) {
+    std::sort(indices.begin() + start, indices.begin() + end, [&refs, axis](uint32_t num1, uint32_t num2) {
+        Vec3f tmp1 = (refs[num1].bb.min + refs[num1].bb.max) * 0.5;
+        Vec3f tmp2 = (refs[num2].bb.min + refs[num2].bb.max) * 0.5;
+        return tmp1[axis] < tmp2[axis];
+    });
+}
+
+AABB centroidBounds(const std::vector<uint32_t>& indices, const std::vector<BuildRef>& refs, size_t start, size_t end) {
+    AABB box(refs[indices[start]].centroid, refs[indices[start]].centroid);
+    for (size_t i = start + 1; i < end; ++i) {
+        const Vec3f& c = refs[indices[i]].centroid;
+        box.min = FW::min(box.min, c);
+        box.max = FW::max(box.max, c);
+    }
+    return box;
+}
+
+float sahSweep(const std::vector<uint32_t>& indices, const std::vector<BuildRef>& refs, size_t start, size_t end,
+               size_t& optMid, std::vector<float>& areas) {
+    // first compute all AABB areas of [start, i] and [i, end), reduce redundant computation
+    size_t count = end - start;
+    areas.resize(2 * count);
+    float* leftChildrenArea = areas.data();
+    float* rightChildrenArea = areas.data() + count;
+
+    AABB leftBox(refs[indices[start]].centroid, refs[indices[start]].centroid);
+    AABB rightBox(refs[indices[end - 1]].centroid, refs[indices[end - 1]].centroid);
+    for (size_t i = start; i < end; ++i) {
+        const Vec3f& left = refs[indices[i]].centroid;
+        leftBox.min = FW::min(leftBox.min, left);
+        leftBox.max = FW::max(leftBox.max, left);
+        leftChildrenArea[i - start] = leftBox.area();
+
+        const Vec3f& right = refs[indices[start + end - i - 1]].centroid;
+        rightBox.min = FW::min(rightBox.min, right);
+        rightBox.max = FW::max(rightBox.max, right);
+        rightChildrenArea[end - 1 - i] = rightBox.area();
+    }
+
+    optMid = start + (count / 2);
+    float minCost = std::numeric_limits<float>::max();
+    float totalArea = centroidBounds(indices, refs, start, end).area();
+    for (size_t i = start; i < end; ++i) {
+        float cost = (leftChildrenArea[i - start] * (i - start) + rightChildrenArea[i - start] * (end - i)) / totalArea;
+        if (cost < minCost) {
+            minCost = cost;
+            optMid = i;
+        }
+    }
+    return minCost;
+}
+
+
+}
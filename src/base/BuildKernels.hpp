@@ -0,0 +1,36 @@
+#pragma once
+
+
+#include "Presplit.hpp"
+
+#include <vector>
+#include <cstdint>
+
+
+namespace FW {
+
+
+// The inner loops of the BVH builders, separate so that the microbenchmarks time the same code.
+
+// the axis the median builders split, ties go to the later axis
+inline int largestAxis(const Vec3f& diagonal) {
+    if (diagonal.x > diagonal.y && diagonal.x > diagonal.z)
+        return 0;
+    return diagonal.y > diagonal.z ? 1 : 2;
+}
+
+// sorts indices[start, end) by the centers of the reference boxes along axis
+void sortByCentroid(std::vector<uint32_t>& indices, const std::vector<BuildRef>& refs, size_t start, size_t end, int axis);
+
+// O(n) SAH sweep over the range sorted by sortByCentroid: grows the centroid boxes of [start, i] from the left
+// and of [i, end) from the right and returns the cost of the cheapest split, whose position goes to optMid.
+// areas is scratch space that the caller reuses between calls (RayTracer keeps one per build thread), so that
+// the nodes do not allocate.
+float sahSweep(const std::vector<uint32_t>& indices, const std::vector<BuildRef>& refs, size_t start, size_t end,
+               size_t& optMid, std::vector<float>& areas);
+
+// the box of the reference centroids in [start, end)
+AABB centroidBounds(const std::vector<uint32_t>& indices, const std::vector<BuildRef>& refs, size_t start, size_t end);
+
+
+}
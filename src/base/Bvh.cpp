@@ -3,19 +3,80 @@
 #include "filesaves.hpp"
 
 #include <algorithm>
+#include <unordered_map>
 
 
 namespace FW {
 
 
-Bvh::Bvh() { }
+// Files written before the flat node array start directly with the split mode; the magic
+// number cannot be mistaken for one, so both kinds of files can be loaded.
+static const uint32_t FileMagic = 0x4c485642; // "BVHL"
+static const uint32_t FileVersion = 2;
 
 
-// reconstruct from a file
-Bvh::Bvh(std::istream& is)
+Bvh::Bvh() :
+    mode_(SplitMode_None),
+    layout_(BvhLayout_DepthFirst),
+    depth_(0)
+{ }
+
+
+// Rebuilds the node tree of a flat array, inner node ranges are the union of their children.
+// Every layout stores children after their parent; a file that does not is rejected with nullptr.
+static std::unique_ptr<BvhNode> unflatten(const std::vector<BvhFlatNode>& nodes, uint32_t index) {
+    const BvhFlatNode& flat = nodes[index];
+    std::unique_ptr<BvhNode> node = std::make_unique<BvhNode>();
+    node->bb = AABB(flat.bbMin, flat.bbMax);
+
+    if (flat.isLeaf()) {
+        node->startPrim = flat.a;
+        node->endPrim = flat.a + flat.count();
+    }
+    else {
+        if (flat.a <= index || flat.b <= index || flat.a >= nodes.size() || flat.b >= nodes.size())
+            return nullptr;
+        node->left = unflatten(nodes, flat.a);
+        node->right = unflatten(nodes, flat.b);
+        if (!node->left || !node->right)
+            return nullptr;
+        node->startPrim = node->left->startPrim;
+        node->endPrim = node->right->endPrim;
+    }
+    return node;
+}
+
+// whether the stream still holds at least the given number of bytes, so that
+// a truncated or foreign file cannot make us allocate garbage sized arrays
+static bool hasBytes(std::istream& is, size_t bytes) {
+    if (!is)
+        return false;
+    std::streampos pos = is.tellg();
+    is.seekg(0, std::ios::end);
+    std::streampos end = is.tellg();
+    is.seekg(pos);
+    return (size_t)(end - pos) >= bytes;
+}
+
+// reconstruct from a file, an unreadable file leaves the hierarchy empty
+Bvh::Bvh(std::istream& is) :
+    layout_(BvhLayout_DepthFirst),
+    depth_(0)
 {
     // Load file header.
-    fileload(is, mode_);
+    uint32_t magic;
+    fileload(is, magic);
+    uint32_t version = 1;
+    if (magic == FileMagic) {
+        fileload(is, version);
+        fileload(is, mode_);
+        fileload(is, layout_);
+    }
+    else
+        mode_ = (SplitMode)magic;
+    if (!is || version > FileVersion)
+        return;
+
     Statusbar nodeInfo("Loading nodes", 0);
     Loader loader(is, nodeInfo);
 
@@ -23,35 +84,143 @@ Bvh::Bvh(std::istream& is)
     {
         size_t size;
         fileload(is, size);
-
-        for(size_t i = 0; i < size; ++i) {
-            uint32_t idx;
-			loader(idx);
-            indices_.push_back(idx);
-        }
+        if (!hasBytes(is, size * sizeof(uint32_t)))
+            return;
+        indices_.resize(size);
+        loader.array(indices_.data(), size);
     }
 
     // Load the rest.
-    rootNode_.reset(new BvhNode(loader));
+    if (version >= 2) {
+        size_t size;
+        fileload(is, size);
+        if (size == 0 || !hasBytes(is, size * sizeof(BvhFlatNode)))
+            return;
+        nodes_.resize(size);
+        loader.array(nodes_.data(), size);
+        rootNode_ = unflatten(nodes_, 0);
+        if (!rootNode_) {
+            nodes_.clear();
+            return;
+        }
+        depth_ = rootNode_->depth();
+    }
+    else {
+        rootNode_.reset(new BvhNode(loader));
+        flatten(BvhLayout_DepthFirst);
+    }
 }
 
 void Bvh::save(std::ostream& os) {
     // Save file header.
+    filesave(os, FileMagic);
+    filesave(os, FileVersion);
     filesave(os, mode_);
+    filesave(os, layout_);
     Statusbar nodeInfo("Saving nodes", 0);
     Saver saver(os, nodeInfo);
 
     // Save elements.
     {
         filesave(os, (size_t)indices_.size());
+        saver.array(indices_.data(), indices_.size());
+    }
 
-        for(auto& i : indices_) {
-            saver(i);
+    // Save the rest, in the order of the current layout.
+    filesave(os, (size_t)nodes_.size());
+    saver.array(nodes_.data(), nodes_.size());
+}
+
+float Bvh::sahCost(const BvhNode& node) {
+    if (!node.hasChildren())
+        return intersectCost * node.bb.area() * (node.endPrim - node.startPrim);
+    return traversalCost * node.bb.area() + sahCost(*node.left) + sahCost(*node.right);
+}
+
+float Bvh::sahCost() const {
+    if (!rootNode_)
+        return 0.0f;
+    return sahCost(*rootNode_) / rootNode_->bb.area();
+}
+
+static void repackNode(BvhNode& node, const std::vector<uint32_t>& oldIndices, std::vector<uint32_t>& newIndices) {
+    if (!node.hasChildren()) {
+        size_t start = newIndices.size();
+        newIndices.insert(newIndices.end(), oldIndices.begin() + node.startPrim, oldIndices.begin() + node.endPrim);
+        node.startPrim = start;
+        node.endPrim = newIndices.size();
+        return;
+    }
+
+    repackNode(*node.left, oldIndices, newIndices);
+    repackNode(*node.right, oldIndices, newIndices);
+    node.startPrim = node.left->startPrim;
+    node.endPrim = node.right->endPrim;
+}
+
+void Bvh::repackIndices() {
+    if (!rootNode_)
+        return;
+
+    std::vector<uint32_t> newIndices;
+    newIndices.reserve(indices_.size());
+    repackNode(*rootNode_, indices_, newIndices);
+    indices_.swap(newIndices);
+}
+
+// visit counts of the previous flat array, found by walking it alongside the node tree
+static void gatherVisits(const BvhNode& node, const std::vector<BvhFlatNode>& nodes, const std::atomic<uint32_t>* visits,
+                         uint32_t index, std::unordered_map<const BvhNode*, float>& weights) {
+    weights[&node] = (float)visits[index].load(std::memory_order_relaxed);
+    if (node.hasChildren()) {
+        gatherVisits(*node.left, nodes, visits, nodes[index].a, weights);
+        gatherVisits(*node.right, nodes, visits, nodes[index].b, weights);
+    }
+}
+
+void Bvh::flatten(BvhLayout layout) {
+    std::unordered_map<const BvhNode*, float> weights;
+    bool hasVisits = rootNode_ && visits_ && !nodes_.empty();
+    if (hasVisits)
+        gatherVisits(*rootNode_, nodes_, visits_.get(), 0, weights);
+    visits_.reset();
+
+    nodes_.clear();
+    depth_ = 0;
+    layout_ = layout;
+    if (!rootNode_)
+        return;
+
+    std::vector<const BvhNode*> order = layoutNodes(*rootNode_, layout, hasVisits ? &weights : nullptr);
+
+    std::unordered_map<const BvhNode*, uint32_t> position;
+    position.reserve(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        position[order[i]] = (uint32_t)i;
+
+    nodes_.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const BvhNode& node = *order[i];
+        BvhFlatNode& flat = nodes_[i];
+        flat.bbMin = node.bb.min;
+        flat.bbMax = node.bb.max;
+        if (node.hasChildren()) {
+            flat.a = position[node.left.get()];
+            flat.b = position[node.right.get()];
+        }
+        else {
+            flat.a = (uint32_t)node.startPrim;
+            flat.b = BvhFlatNode::LeafFlag | (uint32_t)(node.endPrim - node.startPrim);
         }
     }
 
-    // Save the rest.
-    rootNode_->save(saver);
+    depth_ = rootNode_->depth();
+}
+
+void Bvh::beginVisitCounting() {
+    visits_.reset(new std::atomic<uint32_t>[nodes_.size()]);
+    for (size_t i = 0; i < nodes_.size(); ++i)
+        visits_[i].store(0, std::memory_order_relaxed);
 }
 
 }
@@ -2,11 +2,13 @@
 
 
 #include "BvhNode.hpp"
+#include "BvhLayout.hpp"
 
 
 #include <vector>
 #include <iostream>
 #include <memory>
+#include <atomic>
 
 
 namespace FW {
@@ -18,14 +20,30 @@ public:
     Bvh();
     Bvh(std::istream& is);
 
+    // move construction so that hierarchies can live in containers (two-level BVH)
+    Bvh(Bvh&& other) :
+        mode_(other.mode_),
+        layout_(other.layout_),
+        rootNode_(std::move(other.rootNode_)),
+        indices_(std::move(other.indices_)),
+        nodes_(std::move(other.nodes_)),
+        depth_(other.depth_),
+        visits_(std::move(other.visits_))
+    {}
+
     // move assignment for performance
     Bvh& operator=(Bvh&& other) {
         mode_ = other.mode_;
+        layout_ = other.layout_;
         std::swap(rootNode_, other.rootNode_);
         std::swap(indices_, other.indices_);
+        std::swap(nodes_, other.nodes_);
+        depth_ = other.depth_;
+        std::swap(visits_, other.visits_);
         return *this;
     }
 
+    bool                hasRoot() const { return !!rootNode_; }
     BvhNode&			root() { return *rootNode_; }
     const BvhNode&		root() const { return *rootNode_; }
 
@@ -38,13 +56,43 @@ public:
     std::vector<uint32_t>& getIndices() { return indices_; }
     const std::vector<uint32_t>& getIndices() const { return indices_; }
 
+    // relative costs of visiting an inner node and intersecting one triangle in the SAH cost model
+    static constexpr float traversalCost = 1.2f;
+    static constexpr float intersectCost = 1.0f;
+
+    // expected cost of tracing a random ray through the hierarchy, normalized by the root area
+    float               sahCost() const;
+    static float        sahCost(const BvhNode& node);   // unnormalized cost of a subtree
+
+    // rewrites the index list in depth first order so that every subtree covers a
+    // contiguous [startPrim, endPrim) range again after the tree has been restructured
+    void                repackIndices();
+
+    // Flat node array used for traversal, (re)built from the node tree with flatten. It has to be
+    // rebuilt after every change to the tree. save writes the flat array, so the file is in layout order.
+    void                flatten(BvhLayout layout = BvhLayout_DepthFirst);
+    const std::vector<BvhFlatNode>& nodes() const { return nodes_; }
+    BvhLayout           layout() const { return layout_; }
+    int                 depth() const { return depth_; }    // levels in the tree, a leaf-only tree has depth 1
+
+    // Counts the traversal visits of every flat node until the next flatten, which then uses
+    // the counts to rank the nodes of the hot treelet layout.
+    void                beginVisitCounting();
+    bool                isCountingVisits() const { return !!visits_; }
+    inline void         countVisit(uint32_t node) const { visits_[node].fetch_add(1, std::memory_order_relaxed); }
+
 private:
 
 
     SplitMode						mode_;
+    BvhLayout                       layout_;
     std::unique_ptr<BvhNode>		rootNode_;
     
 	std::vector<uint32_t>			indices_; // triangle index list that will be sorted during BVH construction
+
+    std::vector<BvhFlatNode>                    nodes_;
+    int                                         depth_;
+    std::unique_ptr<std::atomic<uint32_t>[]>    visits_;    // per flat node, only while counting
 };
 
 
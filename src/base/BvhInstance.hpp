@@ -0,0 +1,50 @@
+#pragma once
+
+#include "rtutil.hpp"
+
+#include "base/Math.hpp"
+
+#include <limits>
+
+
+namespace FW {
+
+
+// One placement of a bottom-level hierarchy in the world, used by the two-level BVH.
+// The bottom-level BVH is shared between all instances that reference it, so only the
+// transforms and the world space bounds are stored per instance.
+struct BvhInstance {
+    size_t  blas;               // index of the bottom-level hierarchy in RayTracer
+    Mat4f   objectToWorld;
+    Mat4f   worldToObject;      // rays are transformed into object space with this
+    Mat3f   normalToWorld;      // inverse transpose of the upper 3x3 of objectToWorld
+    AABB    worldBounds;        // object space root box transformed to world space
+
+    BvhInstance() : blas(0) {}
+
+    BvhInstance(size_t blas, const Mat4f& xform, const AABB& objectBounds) :
+        blas(blas)
+    {
+        setTransform(xform, objectBounds);
+    }
+
+    void setTransform(const Mat4f& xform, const AABB& objectBounds) {
+        objectToWorld = xform;
+        worldToObject = xform.inverted();
+        normalToWorld = worldToObject.getXYZ().transposed();
+
+        // transform all eight corners, the transformed box is not axis aligned anymore
+        worldBounds = AABB(Vec3f(std::numeric_limits<float>::max()), Vec3f(-std::numeric_limits<float>::max()));
+        for (int i = 0; i < 8; ++i) {
+            Vec3f corner((i & 1) ? objectBounds.max.x : objectBounds.min.x,
+                         (i & 2) ? objectBounds.max.y : objectBounds.min.y,
+                         (i & 4) ? objectBounds.max.z : objectBounds.min.z);
+            Vec3f p = (objectToWorld * Vec4f(corner, 1.0f)).getXYZ();
+            worldBounds.min = FW::min(worldBounds.min, p);
+            worldBounds.max = FW::max(worldBounds.max, p);
+        }
+    }
+};
+
+
+}
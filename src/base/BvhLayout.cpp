@@ -0,0 +1,123 @@
+#include "BvhLayout.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_set>
+#include <utility>
+
+
+namespace FW {
+
+
+namespace {
+
+// 4 KB pages of 32 byte nodes, so that a hot treelet costs a single TLB entry
+const size_t TreeletNodes = 4096 / sizeof(BvhFlatNode);
+
+void layoutDepthFirst(const BvhNode& node, std::vector<const BvhNode*>& order) {
+    order.push_back(&node);
+    if (node.hasChildren()) {
+        layoutDepthFirst(*node.left, order);
+        layoutDepthFirst(*node.right, order);
+    }
+}
+
+// Lays out the top `levels` levels below node and appends the roots of the cut off subtrees to
+// frontier. The top half is laid out first, then each bottom subtree in turn, recursively.
+void layoutVanEmdeBoas(const BvhNode& node, int levels, std::vector<const BvhNode*>& order, std::vector<const BvhNode*>& frontier) {
+    if (levels == 1) {
+        order.push_back(&node);
+        if (node.hasChildren()) {
+            frontier.push_back(node.left.get());
+            frontier.push_back(node.right.get());
+        }
+        return;
+    }
+
+    int top = (levels + 1) / 2;
+    std::vector<const BvhNode*> bottoms;
+    layoutVanEmdeBoas(node, top, order, bottoms);
+    for (const BvhNode* bottom : bottoms)
+        layoutVanEmdeBoas(*bottom, levels - top, order, frontier);
+}
+
+void layoutHotTreelets(const BvhNode& root, const std::unordered_map<const BvhNode*, float>* weights, std::vector<const BvhNode*>& order) {
+    float rootArea = std::max(root.bb.area(), 1e-30f);
+
+    // visit counts are whole numbers, the relative area only breaks ties between equally visited nodes
+    auto weight = [&](const BvhNode* node) {
+        float w = node->bb.area() / rootArea;
+        if (weights) {
+            auto found = weights->find(node);
+            if (found != weights->end())
+                w += found->second;
+        }
+        return w;
+    };
+
+    typedef std::pair<float, const BvhNode*> Entry;
+    std::priority_queue<Entry> roots;
+    roots.emplace(weight(&root), &root);
+
+    while (!roots.empty()) {
+        const BvhNode* treeletRoot = roots.top().second;
+        roots.pop();
+
+        // grow the treelet from its root by always taking the hottest node on its border
+        std::unordered_set<const BvhNode*> members;
+        std::priority_queue<Entry> border;
+        border.emplace(0.0f, treeletRoot);
+        while (members.size() < TreeletNodes && !border.empty()) {
+            const BvhNode* node = border.top().second;
+            border.pop();
+            members.insert(node);
+            if (node->hasChildren()) {
+                border.emplace(weight(node->left.get()), node->left.get());
+                border.emplace(weight(node->right.get()), node->right.get());
+            }
+        }
+
+        // depth first inside the treelet, which is the order the traversal touches the nodes in
+        std::vector<const BvhNode*> stack(1, treeletRoot);
+        while (!stack.empty()) {
+            const BvhNode* node = stack.back();
+            stack.pop_back();
+            if (!members.count(node))
+                continue;
+            order.push_back(node);
+            if (node->hasChildren()) {
+                stack.push_back(node->right.get());
+                stack.push_back(node->left.get());
+            }
+        }
+
+        for (; !border.empty(); border.pop())
+            roots.push(border.top());
+    }
+}
+
+}
+
+
+std::vector<const BvhNode*> layoutNodes(const BvhNode& root, BvhLayout layout, const std::unordered_map<const BvhNode*, float>* weights) {
+    std::vector<const BvhNode*> order;
+
+    switch (layout) {
+    case BvhLayout_VanEmdeBoas: {
+        std::vector<const BvhNode*> frontier;
+        layoutVanEmdeBoas(root, root.depth(), order, frontier);
+        break;
+    }
+    case BvhLayout_HotTreelets:
+        layoutHotTreelets(root, weights, order);
+        break;
+    default:
+        layoutDepthFirst(root, order);
+        break;
+    }
+
+    return order;
+}
+
+
+}
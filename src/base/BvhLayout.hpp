@@ -0,0 +1,44 @@
+#pragma once
+
+
+#include "BvhNode.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+
+namespace FW {
+
+
+// Order in which the nodes of a hierarchy are stored in the flat node array used for traversal.
+enum BvhLayout {
+    BvhLayout_DepthFirst,       // pre-order, left child right after its parent
+    BvhLayout_VanEmdeBoas,      // recursive split at half height, cache-oblivious
+    BvhLayout_HotTreelets,      // page sized treelets grown along the most visited nodes, hottest treelets first
+};
+
+
+// Compact node of the flat array, two nodes per 64 byte cache line. Children are referenced by
+// index, so any layout can be stored without changing the traversal.
+struct BvhFlatNode {
+    static const uint32_t LeafFlag = 0x80000000u;
+
+    Vec3f       bbMin;
+    uint32_t    a;          // inner: left child, leaf: first index into the triangle index list
+    Vec3f       bbMax;
+    uint32_t    b;          // inner: right child, leaf: LeafFlag | triangle count
+
+    inline bool         isLeaf() const { return (b & LeafFlag) != 0; }
+    inline uint32_t     count() const { return b & ~LeafFlag; }
+};
+
+
+// Returns the nodes of the tree in the order of the given layout, the root always comes first.
+// The hot treelet layout ranks nodes by their weight, e.g. visit counts of a sample render;
+// nodes without a weight are ranked by their surface area relative to the root.
+std::vector<const BvhNode*> layoutNodes(const BvhNode& root, BvhLayout layout,
+                                        const std::unordered_map<const BvhNode*, float>* weights = nullptr);
+
+
+}
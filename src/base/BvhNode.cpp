@@ -1,6 +1,7 @@
 
 #include "Bvh.hpp"
 #include <iostream>
+#include <algorithm>
 
 
 namespace FW {
@@ -20,6 +21,12 @@ BvhNode::BvhNode(Loader& stream, size_t depth) {
     }
 }
 
+int BvhNode::depth() const {
+    if (!left)
+        return 1;
+    return 1 + std::max(left->depth(), right->depth());
+}
+
 void BvhNode::save(Saver& stream) {
     bool children = (left != nullptr);
     stream(bb.min.x)(bb.min.y)(bb.min.z);
@@ -28,7 +28,7 @@ struct BvhNode : noncopyable {
         startPrim(0), endPrim(0)
     {}
 
-    BvhNode::BvhNode(size_t start, size_t end) :
+    BvhNode(size_t start, size_t end) :
         bb(),
         startPrim(start), endPrim(end)
     {}
@@ -41,6 +41,9 @@ struct BvhNode : noncopyable {
         return !!left;
     }
 
+    // number of levels in the subtree, 1 for a leaf
+    int depth() const;
+
     void save(Saver& os);
 };
 
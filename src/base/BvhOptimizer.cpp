@@ -0,0 +1,221 @@
+#include "BvhOptimizer.hpp"
+#include "RenderPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+
+namespace FW {
+
+
+namespace {
+
+const int MaxTreeletLeaves = 8;
+
+// Scratch state for restructuring one treelet.
+struct Treelet {
+    int                                     numLeaves;
+    BvhNode*                                leaves[MaxTreeletLeaves];
+    std::unique_ptr<BvhNode>                leafPtrs[MaxTreeletLeaves];
+    std::vector<std::unique_ptr<BvhNode>>   internal;   // inner nodes below the treelet root, reused for the new topology
+    std::vector<float>                      cost;       // optimal cost per leaf subset
+    std::vector<int>                        split;      // best left child subset per leaf subset
+};
+
+int lowestBit(int mask) {
+    int i = 0;
+    while (!(mask & (1 << i)))
+        ++i;
+    return i;
+}
+
+// moves the treelet leaves and inner nodes out of the tree
+void detach(Treelet& t, std::unique_ptr<BvhNode>& ptr) {
+    for (int i = 0; i < t.numLeaves; ++i) {
+        if (t.leaves[i] == ptr.get()) {
+            t.leafPtrs[i] = std::move(ptr);
+            return;
+        }
+    }
+
+    BvhNode* node = ptr.get();
+    t.internal.push_back(std::move(ptr));
+    detach(t, node->left);
+    detach(t, node->right);
+}
+
+std::unique_ptr<BvhNode> rebuild(Treelet& t, int subset, std::unordered_map<const BvhNode*, float>& costs) {
+    if ((subset & (subset - 1)) == 0)
+        return std::move(t.leafPtrs[lowestBit(subset)]);
+
+    std::unique_ptr<BvhNode> node = std::move(t.internal.back());
+    t.internal.pop_back();
+
+    node->left = rebuild(t, t.split[subset], costs);
+    node->right = rebuild(t, subset ^ t.split[subset], costs);
+    node->bb = AABB(FW::min(node->left->bb.min, node->right->bb.min), FW::max(node->left->bb.max, node->right->bb.max));
+    costs[node.get()] = t.cost[subset];
+    return node;
+}
+
+}
+
+
+BvhOptimizer::BvhOptimizer(int treeletLeaves, int iterations) :
+    m_treeletLeaves(std::max(3, std::min(treeletLeaves, MaxTreeletLeaves))),
+    m_iterations(iterations)
+{}
+
+float BvhOptimizer::restructure(BvhNode& root, CostMap& costs) const {
+    Treelet t;
+    t.numLeaves = 2;
+    t.leaves[0] = root.left.get();
+    t.leaves[1] = root.right.get();
+
+    // grow the treelet by opening the leaf with the largest surface area
+    while (t.numLeaves < m_treeletLeaves) {
+        int best = -1;
+        float bestArea = -1.0f;
+        for (int i = 0; i < t.numLeaves; ++i) {
+            if (t.leaves[i]->hasChildren() && t.leaves[i]->bb.area() > bestArea) {
+                best = i;
+                bestArea = t.leaves[i]->bb.area();
+            }
+        }
+        if (best < 0)
+            break;
+
+        BvhNode* opened = t.leaves[best];
+        t.leaves[best] = opened->left.get();
+        t.leaves[t.numLeaves++] = opened->right.get();
+    }
+
+    float currentCost = costs[&root];
+    if (t.numLeaves < 3)
+        return currentCost;
+
+    // optimal topology for every subset of leaves; a subset is always visited after its own subsets
+    int numSubsets = 1 << t.numLeaves;
+    std::vector<float> area(numSubsets);
+    t.cost.resize(numSubsets);
+    t.split.resize(numSubsets);
+
+    for (int s = 1; s < numSubsets; ++s) {
+        AABB bb = t.leaves[lowestBit(s)]->bb;
+        for (int i = 0; i < t.numLeaves; ++i) {
+            if (s & (1 << i)) {
+                bb.min = FW::min(bb.min, t.leaves[i]->bb.min);
+                bb.max = FW::max(bb.max, t.leaves[i]->bb.max);
+            }
+        }
+        area[s] = bb.area();
+    }
+
+    for (int i = 0; i < t.numLeaves; ++i)
+        t.cost[1 << i] = costs[t.leaves[i]];
+
+    for (int s = 1; s < numSubsets; ++s) {
+        if ((s & (s - 1)) == 0)
+            continue;
+
+        // only partitions where the left side holds the lowest leaf, the rest are mirror images
+        int low = s & -s;
+        float bestCost = std::numeric_limits<float>::max();
+        int bestSplit = low;
+        for (int p = (s - 1) & s; p > 0; p = (p - 1) & s) {
+            if (!(p & low))
+                continue;
+            float c = t.cost[p] + t.cost[s ^ p];
+            if (c < bestCost) {
+                bestCost = c;
+                bestSplit = p;
+            }
+        }
+        t.cost[s] = Bvh::traversalCost * area[s] + bestCost;
+        t.split[s] = bestSplit;
+    }
+
+    int full = numSubsets - 1;
+    if (t.cost[full] >= currentCost * 0.9999f)
+        return currentCost;
+
+    detach(t, root.left);
+    detach(t, root.right);
+    root.left = rebuild(t, t.split[full], costs);
+    root.right = rebuild(t, full ^ t.split[full], costs);
+    costs[&root] = t.cost[full];
+    return t.cost[full];
+}
+
+float BvhOptimizer::optimizeSubtree(BvhNode& node, CostMap& costs) const {
+    if (!node.hasChildren()) {
+        float c = Bvh::sahCost(node);
+        costs[&node] = c;
+        return c;
+    }
+
+    float c = Bvh::traversalCost * node.bb.area() + optimizeSubtree(*node.left, costs) + optimizeSubtree(*node.right, costs);
+    costs[&node] = c;
+    return restructure(node, costs);
+}
+
+float BvhOptimizer::optimizeTop(BvhNode& node, CostMap& costs) const {
+    // roots of the subtrees that were already optimized in parallel
+    auto found = costs.find(&node);
+    if (found != costs.end())
+        return found->second;
+
+    float c = Bvh::traversalCost * node.bb.area() + optimizeTop(*node.left, costs) + optimizeTop(*node.right, costs);
+    costs[&node] = c;
+    return restructure(node, costs);
+}
+
+void BvhOptimizer::collectJobs(BvhNode& node, int depth, int maxDepth, std::vector<BvhNode*>& jobs) const {
+    if (depth == maxDepth || !node.hasChildren()) {
+        jobs.push_back(&node);
+        return;
+    }
+    collectJobs(*node.left, depth + 1, maxDepth, jobs);
+    collectJobs(*node.right, depth + 1, maxDepth, jobs);
+}
+
+BvhOptimizer::Stats BvhOptimizer::optimize(Bvh& bvh) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    Stats stats;
+    stats.sahBefore = bvh.sahCost();
+
+    int numThreads = RenderPool::get().getNumThreads();
+
+    // a few jobs per thread to even out unbalanced subtrees
+    int maxDepth = 0;
+    while ((1 << maxDepth) < 4 * numThreads)
+        ++maxDepth;
+
+    for (int iter = 0; iter < m_iterations; ++iter) {
+        std::vector<BvhNode*> jobs;
+        collectJobs(bvh.root(), 0, maxDepth, jobs);
+
+        std::vector<CostMap> jobCosts(jobs.size());
+
+        RenderPool::get().parallelFor((int)jobs.size(), [&](int i, int) {
+            optimizeSubtree(*jobs[i], jobCosts[i]);
+        });
+
+        CostMap costs;
+        for (auto& c : jobCosts)
+            costs.insert(c.begin(), c.end());
+        optimizeTop(bvh.root(), costs);
+    }
+
+    // inner node ranges are no longer contiguous after moving subtrees around
+    bvh.repackIndices();
+
+    stats.sahAfter = bvh.sahCost();
+    stats.seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
+
+
+}
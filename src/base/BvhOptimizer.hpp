@@ -0,0 +1,47 @@
+#pragma once
+
+
+#include "Bvh.hpp"
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+
+namespace FW {
+
+
+// Post-build optimizer that lowers the SAH cost of an existing hierarchy by treelet restructuring
+// (Karras & Aila 2013, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies").
+// A treelet is grown below every inner node by repeatedly opening its largest leaf, and the
+// optimal binary tree over the treelet leaves is found by dynamic programming over leaf subsets.
+// Leaves of the original hierarchy are kept as they are, so only the tree topology changes.
+class BvhOptimizer {
+public:
+    struct Stats {
+        float   sahBefore;
+        float   sahAfter;
+        float   seconds;
+    };
+
+    explicit BvhOptimizer(int treeletLeaves = 7, int iterations = 3);
+
+    Stats               optimize(Bvh& bvh);
+
+private:
+    typedef std::unordered_map<const BvhNode*, float> CostMap;
+
+    // bottom-up pass over a subtree, returns the SAH cost of the restructured subtree
+    float               optimizeSubtree(BvhNode& node, CostMap& costs) const;
+    float               restructure(BvhNode& root, CostMap& costs) const;
+
+    // children of top level nodes are optimized in parallel before the top itself
+    void                collectJobs(BvhNode& node, int depth, int maxDepth, std::vector<BvhNode*>& jobs) const;
+    float               optimizeTop(BvhNode& node, CostMap& costs) const;
+
+    int                 m_treeletLeaves;
+    int                 m_iterations;
+};
+
+
+}
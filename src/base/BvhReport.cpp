@@ -0,0 +1,252 @@
+#include "BvhReport.hpp"
+#include "Presplit.hpp"
+#include "RenderPool.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <numeric>
+
+
+namespace FW {
+
+
+namespace {
+
+bool inside(const AABB& child, const AABB& parent) {
+    Vec3f extent = parent.max - parent.min;
+    float eps = 1e-5f * std::max(extent.x, std::max(extent.y, extent.z)) + 1e-30f;
+    return child.min.x >= parent.min.x - eps && child.min.y >= parent.min.y - eps && child.min.z >= parent.min.z - eps
+        && child.max.x <= parent.max.x + eps && child.max.y <= parent.max.y + eps && child.max.z <= parent.max.z + eps;
+}
+
+bool overlaps(const AABB& a, const AABB& b) {
+    return a.min.x <= b.max.x && a.min.y <= b.max.y && a.min.z <= b.max.z
+        && b.min.x <= a.max.x && b.min.y <= a.max.y && b.min.z <= a.max.z;
+}
+
+void walk(const BvhNode& node, int depth, size_t numReferences, BvhReport& r, double& depthSum) {
+    ++r.nodes;
+    r.maxDepth = std::max(r.maxDepth, depth);
+
+    if (!node.hasChildren()) {
+        ++r.leaves;
+        depthSum += depth;
+        size_t count = node.endPrim - node.startPrim;
+        if (node.endPrim <= node.startPrim || node.endPrim > numReferences)
+            ++r.badRanges;
+        else
+            ++r.leafSizes[std::min(count, (size_t)BvhReport::MaxLeafHistogram) - 1];
+        return;
+    }
+
+    if (node.left->startPrim != node.startPrim || node.left->endPrim != node.right->startPrim || node.right->endPrim != node.endPrim)
+        ++r.badRanges;
+    if (!inside(node.left->bb, node.bb))
+        ++r.childOutside;
+    if (!inside(node.right->bb, node.bb))
+        ++r.childOutside;
+
+    walk(*node.left, depth + 1, numReferences, r, depthSum);
+    walk(*node.right, depth + 1, numReferences, r, depthSum);
+}
+
+// the flat array has to describe the same tree, node by node
+bool matchesFlat(const BvhNode& node, const std::vector<BvhFlatNode>& nodes, uint32_t index) {
+    if (index >= nodes.size())
+        return false;
+    const BvhFlatNode& flat = nodes[index];
+    if (flat.bbMin != node.bb.min || flat.bbMax != node.bb.max || flat.isLeaf() == node.hasChildren())
+        return false;
+    if (flat.isLeaf())
+        return flat.a == node.startPrim && flat.count() == node.endPrim - node.startPrim;
+    return matchesFlat(*node.left, nodes, flat.a) && matchesFlat(*node.right, nodes, flat.b);
+}
+
+float polygonArea(const Vec3f* poly, int n) {
+    Vec3f sum(0.0f);
+    for (int i = 1; i + 1 < n; ++i)
+        sum += cross(poly[i] - poly[0], poly[i + 1] - poly[0]);
+    return 0.5f * sum.length();
+}
+
+}
+
+
+BvhReport::BvhReport() :
+    triangles(0), references(0), nodes(0), leaves(0), leafSizes(MaxLeafHistogram, 0),
+    maxDepth(0), avgDepth(0.0f), sahCost(0.0f), epo(-1.0f), triangleArea(0.0f),
+    flatBytes(0), treeBytes(0), indexBytes(0),
+    badIndices(0), unreferenced(0), badRanges(0), childOutside(0), flatMismatch(false)
+{}
+
+bool BvhReport::valid() const {
+    return nodes > 0 && badIndices == 0 && unreferenced == 0 && badRanges == 0 && childOutside == 0 && !flatMismatch;
+}
+
+std::string BvhReport::errors() const {
+    std::ostringstream os;
+    if (nodes == 0)
+        os << "empty hierarchy; ";
+    if (badIndices)
+        os << badIndices << " invalid triangle indices; ";
+    if (unreferenced)
+        os << unreferenced << " triangles not referenced; ";
+    if (badRanges)
+        os << badRanges << " inconsistent node ranges; ";
+    if (childOutside)
+        os << childOutside << " child boxes outside their parent; ";
+    if (flatMismatch)
+        os << "flat node array does not match the tree; ";
+    return os.str();
+}
+
+void BvhReport::merge(const BvhReport& o) {
+    if (o.leaves + leaves > 0)
+        avgDepth = (avgDepth * leaves + o.avgDepth * o.leaves) / (leaves + o.leaves);
+    if (epo >= 0.0f && o.epo >= 0.0f && triangleArea + o.triangleArea > 0.0f)
+        epo = (epo * triangleArea + o.epo * o.triangleArea) / (triangleArea + o.triangleArea);
+    else
+        epo = -1.0f;
+
+    triangles += o.triangles;
+    references += o.references;
+    nodes += o.nodes;
+    leaves += o.leaves;
+    for (int i = 0; i < MaxLeafHistogram; ++i)
+        leafSizes[i] += o.leafSizes[i];
+    maxDepth = std::max(maxDepth, o.maxDepth);
+    sahCost += o.sahCost;
+    triangleArea += o.triangleArea;
+    flatBytes += o.flatBytes;
+    treeBytes += o.treeBytes;
+    indexBytes += o.indexBytes;
+
+    badIndices += o.badIndices;
+    unreferenced += o.unreferenced;
+    badRanges += o.badRanges;
+    childOutside += o.childOutside;
+    flatMismatch = flatMismatch || o.flatMismatch;
+}
+
+void BvhReport::print() const {
+    ::printf("BVH: %d nodes, %d leaves, %d references to %d triangles\n", (int)nodes, (int)leaves, (int)references, (int)triangles);
+    ::printf("  leaf sizes:");
+    for (int i = 0; i < MaxLeafHistogram; ++i)
+        ::printf(" %d%s:%d", i + 1, i + 1 == MaxLeafHistogram ? "+" : "", (int)leafSizes[i]);
+    ::printf("\n  depth max %d, average %.2f\n", maxDepth, avgDepth);
+    if (epo >= 0.0f)
+        ::printf("  SAH cost %.2f, EPO %.2f\n", sahCost, epo);
+    else
+        ::printf("  SAH cost %.2f\n", sahCost);
+    ::printf("  memory: nodes %.1f MB, node tree %.1f MB, indices %.1f MB\n",
+        flatBytes / 1048576.0f, treeBytes / 1048576.0f, indexBytes / 1048576.0f);
+    if (valid())
+        ::printf("  valid\n");
+    else
+        ::printf("  INVALID: %s\n", errors().c_str());
+}
+
+const char* BvhReport::header() {
+    return "nodes leaves references triangles max_depth avg_depth sah_cost epo memory_bytes valid leaf_sizes";
+}
+
+void BvhReport::writeLine(std::ostream& os) const {
+    os << nodes << " " << leaves << " " << references << " " << triangles << " " << maxDepth << " " << avgDepth << " "
+       << sahCost << " " << epo << " " << (flatBytes + treeBytes + indexBytes) << " " << (valid() ? 1 : 0) << " ";
+    for (int i = 0; i < MaxLeafHistogram; ++i)
+        os << (i ? "," : "") << leafSizes[i];
+}
+
+
+BvhReport analyzeBvh(const Bvh& bvh, const std::vector<RTTriangle>& triangles, bool computeEpo, size_t first, size_t end) {
+    BvhReport r;
+    end = std::min(end, triangles.size());
+    const std::vector<uint32_t>& indices = bvh.getIndices();
+
+    r.triangles = end - first;
+    r.references = indices.size();
+    r.indexBytes = indices.size() * sizeof(uint32_t);
+    r.flatBytes = bvh.nodes().size() * sizeof(BvhFlatNode);
+
+    std::vector<bool> referenced(end - first, false);
+    for (uint32_t index : indices) {
+        if (index < first || index >= end)
+            ++r.badIndices;
+        else
+            referenced[index - first] = true;
+    }
+    r.unreferenced = std::count(referenced.begin(), referenced.end(), false);
+
+    for (size_t i = first; i < end; ++i)
+        r.triangleArea += triangles[i].area();
+
+    if (!bvh.hasRoot())
+        return r;
+
+    double depthSum = 0.0;
+    walk(bvh.root(), 1, indices.size(), r, depthSum);
+    r.avgDepth = r.leaves ? (float)(depthSum / r.leaves) : 0.0f;
+    r.treeBytes = r.nodes * sizeof(BvhNode);
+    r.sahCost = bvh.sahCost();
+    r.flatMismatch = bvh.nodes().size() != r.nodes || !matchesFlat(bvh.root(), bvh.nodes(), 0);
+
+    if (!computeEpo || r.badIndices || r.badRanges)
+        return r;
+
+    // positions of every triangle in the index list, a node holds a triangle if one of them is in its range
+    std::vector<uint32_t> offsets(end - first + 1, 0);
+    for (uint32_t index : indices)
+        ++offsets[index - first + 1];
+    for (size_t i = 1; i < offsets.size(); ++i)
+        offsets[i] += offsets[i - 1];
+    std::vector<uint32_t> positions(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t p = 0; p < indices.size(); ++p)
+            positions[fill[indices[p] - first]++] = (uint32_t)p;
+    }
+
+    // EPO: the surface of triangles outside a subtree that still lies inside its box, weighted by the
+    // cost of visiting the node, relative to the total triangle surface
+    RenderPool& pool = RenderPool::get();
+    std::vector<double> overlap(pool.getNumThreads(), 0.0);
+    pool.parallelFor((int)(end - first), [&](int t, int thread) {
+        const RTTriangle& tri = triangles[first + t];
+        AABB triBox(tri.min(), tri.max());
+        Vec3f poly[MaxClipVertices];
+        double triOverlap = 0.0;
+
+        std::vector<const BvhNode*> stack(1, &bvh.root());
+        while (!stack.empty()) {
+            const BvhNode* node = stack.back();
+            stack.pop_back();
+            if (!overlaps(node->bb, triBox))
+                continue;
+
+            bool holds = false;
+            for (uint32_t i = offsets[t]; i < offsets[t + 1] && !holds; ++i)
+                holds = positions[i] >= node->startPrim && positions[i] < node->endPrim;
+
+            if (!holds) {
+                float area = polygonArea(poly, clipTriangle(tri, node->bb, poly));
+                if (area <= 0.0f)
+                    continue;
+                float cost = node->hasChildren() ? Bvh::traversalCost : Bvh::intersectCost * (node->endPrim - node->startPrim);
+                triOverlap += cost * area;
+            }
+
+            if (node->hasChildren()) {
+                stack.push_back(node->left.get());
+                stack.push_back(node->right.get());
+            }
+        }
+        overlap[thread] += triOverlap;
+    });
+    double totalOverlap = std::accumulate(overlap.begin(), overlap.end(), 0.0);
+    r.epo = r.triangleArea > 0.0f ? (float)(totalOverlap / r.triangleArea) : 0.0f;
+    return r;
+}
+
+
+}
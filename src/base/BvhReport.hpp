@@ -0,0 +1,64 @@
+#pragma once
+
+
+#include "Bvh.hpp"
+#include "RTTriangle.hpp"
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+
+namespace FW {
+
+
+// Quality statistics and consistency checks of a hierarchy, used to compare builders and to
+// decide whether a cached hierarchy file can be used for the current mesh.
+struct BvhReport {
+    static const int MaxLeafHistogram = 8;  // the last bucket counts leaves of this size and larger
+
+    size_t              triangles;
+    size_t              references;         // entries in the index list, more than triangles after pre-splitting
+    size_t              nodes;
+    size_t              leaves;
+    std::vector<size_t> leafSizes;          // histogram, leafSizes[i] = leaves with i+1 triangles
+    int                 maxDepth;
+    float               avgDepth;           // of the leaves, the root is at depth 1
+    float               sahCost;            // Bvh::sahCost
+    float               epo;                // end-point overlap (Aila et al. 2013), -1 if not computed
+    float               triangleArea;       // surface area of the referenced triangles, used to weight epo
+    size_t              flatBytes;          // traversal node array
+    size_t              treeBytes;          // node tree kept for building and optimizing
+    size_t              indexBytes;
+
+    // validation
+    size_t              badIndices;         // index list entries that are not valid triangle indices
+    size_t              unreferenced;       // triangles that are in no leaf
+    size_t              badRanges;          // inner node ranges that are not the union of their children, or empty leaves
+    size_t              childOutside;       // child boxes that are not inside their parent box
+    bool                flatMismatch;       // flat node array out of sync with the node tree
+
+    BvhReport();
+
+    bool                valid() const;
+    std::string         errors() const;     // human readable list of the failed checks
+
+    // accumulates the report of another hierarchy, e.g. the bottom levels of a two-level BVH
+    void                merge(const BvhReport& other);
+
+    void                print() const;
+
+    // one whitespace separated line per hierarchy, in the style of the timing results file
+    static const char*  header();
+    void                writeLine(std::ostream& os) const;
+};
+
+
+// Walks the hierarchy and checks it against the triangles [first, end), which it must reference
+// exactly. Computing the end-point overlap clips every triangle against the boxes it overlaps,
+// which is much slower than the rest.
+BvhReport analyzeBvh(const Bvh& bvh, const std::vector<RTTriangle>& triangles, bool computeEpo,
+                     size_t first = 0, size_t end = (size_t)-1);
+
+
+}
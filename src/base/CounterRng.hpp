@@ -0,0 +1,56 @@
+#pragma once
+
+
+#include "QMC.hpp"
+
+#include <cstdint>
+
+
+namespace FW {
+
+
+// Counter-based random numbers: Philox2x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as
+// 1, 2, 3", 2011). The numbers are a pure function of the key and a counter, so there is no state to
+// carry between samples or to give to each thread. Keyed by pixel and counted by sample index and
+// dimension, every sample of a render is the same whatever thread or pass computes it.
+class CounterRng {
+public:
+    explicit CounterRng(uint32_t key) : m_key(key) {}
+
+    // two independent 32 bit numbers for sample index of the dimension
+    void get(uint32_t index, uint32_t dimension, uint32_t& a, uint32_t& b) const {
+        uint32_t c0 = index, c1 = dimension, key = m_key;
+        for (int round = 0; round < 10; ++round) {
+            uint64_t product = (uint64_t)0xd256d193u * c0;
+            c0 = (uint32_t)(product >> 32) ^ key ^ c1;
+            c1 = (uint32_t)product;
+            key += 0x9e3779b9u;
+        }
+        a = c0;
+        b = c1;
+    }
+
+    // uniform point in [0, 1)^2
+    Vec2f getVec2f(uint32_t index, uint32_t dimension) const {
+        uint32_t a, b;
+        get(index, dimension, a, b);
+        return Vec2f(toUnitFloat(a), toUnitFloat(b));
+    }
+
+    // the points of indices [first, first + count) in x and y; the lanes do not depend on each other
+    // and the loop has no branches, so the compiler can spread it over SIMD lanes
+    void fill(uint32_t first, uint32_t dimension, float* x, float* y, int count) const {
+        for (int k = 0; k < count; ++k) {
+            uint32_t a, b;
+            get(first + k, dimension, a, b);
+            x[k] = toUnitFloat(a);
+            y[k] = toUnitFloat(b);
+        }
+    }
+
+private:
+    uint32_t    m_key;
+};
+
+
+}
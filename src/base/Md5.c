@@ -39,8 +39,8 @@
 
 #include <stddef.h>
 
-/* typedef a 32 bit type */
-typedef unsigned long int UINT4;
+/* typedef a 32 bit type (long is 64 bits on Linux) */
+typedef unsigned int UINT4;
 
 /* Data structure for MD5 (Message Digest) computation */
 typedef struct {
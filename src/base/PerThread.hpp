@@ -0,0 +1,53 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+
+namespace FW {
+
+
+// One T for each RenderPool thread, every one starting on a cache line of its own and padded to whole
+// lines, so that threads updating their own T do not invalidate each other's lines. An alignas on T
+// would not do: C++14 new ignores alignments past 16 bytes, and FW's operator new gives 16, so the
+// storage is allocated with a line to spare and aligned by hand.
+template <class T>
+class PerThread {
+public:
+    static const size_t CacheLine = 64;
+
+                        PerThread           (void) = default;
+                        ~PerThread          (void) { reset(0); }
+
+    // destroys the current elements and default-constructs count new ones
+    void                reset               (int count)
+    {
+        for (int i = 0; i < m_count; ++i)
+            (*this)[i].~T();
+        m_count = 0;
+        m_storage.reset(count > 0 ? new char[count * Stride + CacheLine - 1] : nullptr);
+        m_base = m_storage ? (char*)(((uintptr_t)m_storage.get() + CacheLine - 1) & ~(uintptr_t)(CacheLine - 1)) : nullptr;
+        for (; m_count < count; ++m_count)
+            new (m_base + m_count * Stride) T();
+    }
+
+    int                 size                (void) const { return m_count; }
+    T&                  operator[]          (int i) { return *(T*)(m_base + i * Stride); }
+    const T&            operator[]          (int i) const { return *(const T*)(m_base + i * Stride); }
+
+                        PerThread           (const PerThread&) = delete;
+    PerThread&          operator=           (const PerThread&) = delete;
+
+private:
+    static const size_t Stride = (sizeof(T) + CacheLine - 1) / CacheLine * CacheLine;
+
+    std::unique_ptr<char[]> m_storage;
+    char*               m_base  = nullptr;
+    int                 m_count = 0;
+};
+
+
+}
@@ -0,0 +1,183 @@
+#include "PerfCounters.hpp"
+
+#include <cmath>
+#include <limits>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#endif
+
+
+namespace FW {
+
+
+namespace {
+
+const double NotCounted = std::numeric_limits<double>::quiet_NaN();
+
+#ifdef __linux__
+
+// type and config of each Counter
+void counterEvent(PerfCounters::Counter c, __u32& type, __u64& config) {
+    auto cache = [](uint64_t cache, uint64_t op, uint64_t result) { return cache | (op << 8) | (result << 16); };
+    type = PERF_TYPE_HARDWARE;
+    switch (c) {
+    case PerfCounters::Counter_Cycles:          config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case PerfCounters::Counter_Instructions:    config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case PerfCounters::Counter_BranchMisses:    config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    case PerfCounters::Counter_L1DMisses:
+        type = PERF_TYPE_HW_CACHE;
+        config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+        break;
+    case PerfCounters::Counter_LLCMisses:
+        type = PERF_TYPE_HW_CACHE;
+        config = cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+        break;
+    default:
+        type = PERF_TYPE_HW_CACHE;
+        config = cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+        break;
+    }
+}
+
+std::vector<int> processThreads(void) {
+    std::vector<int> tids;
+    if (DIR* dir = opendir("/proc/self/task")) {
+        while (dirent* entry = readdir(dir))
+            if (entry->d_name[0] != '.')
+                tids.push_back(std::atoi(entry->d_name));
+        closedir(dir);
+    }
+    return tids;
+}
+
+#endif
+
+}
+
+
+PerfCounters::PerfCounters(void) {
+    for (double& v : m_values)
+        v = NotCounted;
+}
+
+PerfCounters::~PerfCounters(void) {
+    close();
+}
+
+const char* PerfCounters::name(Counter c) {
+    static const char* const names[Counter_Max] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses" };
+    return names[c];
+}
+
+bool PerfCounters::isValid(void) const {
+    for (double v : m_values)
+        if (!std::isnan(v))
+            return true;
+    return false;
+}
+
+#ifdef __linux__
+
+bool PerfCounters::start(void) {
+    close();
+    m_error.clear();
+    for (double& v : m_values)
+        v = NotCounted;
+
+    std::vector<int> tids = processThreads();
+    bool any = false;
+    for (int c = 0; c < Counter_Max; ++c) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        counterEvent((Counter)c, attr.type, attr.config);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        for (int tid : tids) {
+            int fd = (int)syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+            if (fd < 0) {
+                // a counter the CPU lacks fails on every thread, keep the first reason
+                if (m_error.empty())
+                    m_error = std::string(name((Counter)c)) + ": " + std::strerror(errno);
+                break;
+            }
+            m_fds[c].push_back(fd);
+        }
+        // all threads or none, a partial count would not be comparable
+        if (m_fds[c].size() != tids.size()) {
+            for (int fd : m_fds[c])
+                ::close(fd);
+            m_fds[c].clear();
+        }
+        any = any || !m_fds[c].empty();
+    }
+
+    if (!any) {
+        if (m_error.empty())
+            m_error = "no threads";
+        return false;
+    }
+    for (auto& fds : m_fds)
+        for (int fd : fds)
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    return true;
+}
+
+void PerfCounters::stop(void) {
+    for (auto& fds : m_fds)
+        for (int fd : fds)
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int c = 0; c < Counter_Max; ++c) {
+        if (m_fds[c].empty())
+            continue;
+        double total = 0.0;
+        for (int fd : m_fds[c]) {
+            uint64_t data[3];   // value, time enabled, time running
+            if (::read(fd, data, sizeof(data)) != (ssize_t)sizeof(data))
+                continue;
+            if (data[2] > 0)
+                total += (double)data[0] * ((double)data[1] / (double)data[2]);
+        }
+        m_values[c] = total;
+    }
+    close();
+}
+
+void PerfCounters::close(void) {
+    for (auto& fds : m_fds) {
+        for (int fd : fds)
+            ::close(fd);
+        fds.clear();
+    }
+}
+
+#else
+
+bool PerfCounters::start(void) {
+    m_error = "perf_event_open is Linux only";
+    return false;
+}
+
+void PerfCounters::stop(void) {
+}
+
+void PerfCounters::close(void) {
+}
+
+#endif
+
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+
+
+namespace FW {
+
+
+// Hardware performance counters of the whole process between start() and stop(), through Linux
+// perf_event_open. The counters are opened on every thread that exists at start(), so the RenderPool
+// workers are included as long as the pool is not reconfigured in between. Only user space is
+// counted, which perf_event_paranoid <= 2 allows without privileges. On other platforms, in
+// containers without the perf syscall and in VMs without a virtual PMU, start() fails and every
+// value is NaN; counters the CPU lacks are NaN on their own. When more counters are open than the
+// PMU has registers the kernel multiplexes them, and the values are scaled to the full time.
+class PerfCounters {
+public:
+    enum Counter {
+        Counter_Cycles,
+        Counter_Instructions,
+        Counter_L1DMisses,          // L1 data cache read misses
+        Counter_LLCMisses,          // last level cache read misses
+        Counter_BranchMisses,
+        Counter_DTLBMisses,         // data TLB read misses
+        Counter_Max
+    };
+
+                        PerfCounters        (void);
+                        ~PerfCounters       (void);
+                        PerfCounters        (const PerfCounters&) = delete;
+    PerfCounters&       operator=           (const PerfCounters&) = delete;
+
+    // false if none of the counters could be opened, getError() tells why
+    bool                start               (void);
+    void                stop                (void);
+
+    bool                isValid             (void) const;           // stop() got at least one counter
+    double              get                 (Counter c) const       { return m_values[c]; }
+    const std::string&  getError            (void) const            { return m_error; }
+
+    // column name part, e.g. "l1d_misses"
+    static const char*  name                (Counter c);
+
+private:
+    void                close               (void);
+
+    std::vector<int>    m_fds[Counter_Max];     // one per thread
+    double              m_values[Counter_Max];
+    std::string         m_error;
+};
+
+
+}
@@ -0,0 +1,142 @@
+#include "Presplit.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <utility>
+
+
+namespace FW {
+
+
+int clipTriangle(const RTTriangle& tri, const AABB& box, Vec3f* poly) {
+    Vec3f tmp[MaxClipVertices];
+    int n = 3;
+    for (int i = 0; i < 3; ++i)
+        poly[i] = tri.m_vertices[i].p;
+
+    for (int plane = 0; plane < 6 && n > 0; ++plane) {
+        int axis = plane >> 1;
+        bool isMax = (plane & 1) != 0;
+        float bound = isMax ? box.max[axis] : box.min[axis];
+
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const Vec3f& a = poly[i];
+            const Vec3f& b = poly[(i + 1) % n];
+            float da = isMax ? bound - a[axis] : a[axis] - bound;
+            float db = isMax ? bound - b[axis] : b[axis] - bound;
+
+            // a triangle clipped by six planes has at most nine vertices; round-off on near-degenerate
+            // polygons can add crossings, which are dropped rather than overrun poly
+            if (da >= 0.0f && m < MaxClipVertices)
+                tmp[m++] = a;
+            if ((da < 0.0f) != (db < 0.0f) && m < MaxClipVertices) {
+                Vec3f p = a + (b - a) * (da / (da - db));
+                p[axis] = bound;
+                tmp[m++] = p;
+            }
+        }
+        n = m;
+        std::copy(tmp, tmp + n, poly);
+    }
+    return n;
+}
+
+
+namespace {
+
+// bounds of what is left of the triangle after clipping it against the box
+bool clipBounds(const RTTriangle& tri, const AABB& box, AABB& result) {
+    Vec3f poly[MaxClipVertices];
+    int n = clipTriangle(tri, box, poly);
+    if (n == 0)
+        return false;
+
+    result = AABB(poly[0], poly[0]);
+    for (int i = 1; i < n; ++i) {
+        result.min = FW::min(result.min, poly[i]);
+        result.max = FW::max(result.max, poly[i]);
+    }
+
+    // guard against round-off pushing the bounds outside of the box
+    result.min = FW::max(result.min, box.min);
+    result.max = FW::min(result.max, box.max);
+    return true;
+}
+
+}
+
+
+size_t presplitReferences(const std::vector<RTTriangle>& triangles, size_t first, size_t end,
+                          float maxGrowth, std::vector<BuildRef>& refs, float areaFraction) {
+    refs.clear();
+    refs.reserve(end - first);
+
+    AABB scene(Vec3f(std::numeric_limits<float>::max()), Vec3f(-std::numeric_limits<float>::max()));
+    for (size_t i = first; i < end; ++i) {
+        BuildRef ref;
+        ref.bb = AABB(triangles[i].min(), triangles[i].max());
+        ref.centroid = triangles[i].centroid();
+        ref.tri = (uint32_t)i;
+        refs.push_back(ref);
+
+        scene.min = FW::min(scene.min, ref.bb.min);
+        scene.max = FW::max(scene.max, ref.bb.max);
+    }
+
+    size_t budget = (size_t)(std::max(0.0f, maxGrowth) * (end - first));
+    if (budget == 0)
+        return 0;
+    refs.reserve(refs.size() + budget);
+
+    // always split the largest box first, so that the budget goes where the overlap is worst
+    float threshold = areaFraction * scene.area();
+    std::priority_queue<std::pair<float, size_t>> largest;
+    for (size_t i = 0; i < refs.size(); ++i) {
+        float area = refs[i].bb.area();
+        if (area > threshold)
+            largest.emplace(area, i);
+    }
+
+    size_t splits = 0;
+    while (!largest.empty() && splits < budget) {
+        size_t index = largest.top().second;
+        largest.pop();
+
+        BuildRef ref = refs[index];
+        const RTTriangle& tri = triangles[ref.tri];
+
+        Vec3f diagonal = ref.bb.max - ref.bb.min;
+        int axis = (diagonal.x > diagonal.y && diagonal.x > diagonal.z) ? 0 : (diagonal.y > diagonal.z ? 1 : 2);
+        float mid = 0.5f * (ref.bb.min[axis] + ref.bb.max[axis]);
+
+        AABB leftBox = ref.bb, rightBox = ref.bb;
+        leftBox.max[axis] = mid;
+        rightBox.min[axis] = mid;
+
+        AABB leftClipped, rightClipped;
+        if (!clipBounds(tri, leftBox, leftClipped) || !clipBounds(tri, rightBox, rightClipped))
+            continue;
+
+        BuildRef left = ref, right = ref;
+        left.bb = leftClipped;
+        left.centroid = (leftClipped.min + leftClipped.max) * 0.5f;
+        right.bb = rightClipped;
+        right.centroid = (rightClipped.min + rightClipped.max) * 0.5f;
+
+        refs[index] = left;
+        refs.push_back(right);
+        ++splits;
+
+        if (left.bb.area() > threshold)
+            largest.emplace(left.bb.area(), index);
+        if (right.bb.area() > threshold)
+            largest.emplace(right.bb.area(), refs.size() - 1);
+    }
+
+    return splits;
+}
+
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+
+#include "RTTriangle.hpp"
+#include "rtutil.hpp"
+
+#include <vector>
+#include <cstdint>
+
+
+namespace FW {
+
+
+// A box the BVH builders sort and partition instead of the triangle itself. Without pre-splitting
+// there is exactly one reference per triangle; a split triangle has several references with
+// tighter boxes that all point to the same triangle.
+struct BuildRef {
+    AABB        bb;
+    Vec3f       centroid;
+    uint32_t    tri;        // index into the triangle array
+};
+
+
+// Sutherland-Hodgman clipping of a triangle against a box. Writes the clipped polygon to poly,
+// which needs room for MaxClipVertices, and returns its vertex count (0 if nothing is left).
+static const int MaxClipVertices = 9;
+int clipTriangle(const RTTriangle& tri, const AABB& box, Vec3f* poly);
+
+
+// Early split clipping (Ernst & Greiner 2007). Creates the references for triangles [first, end)
+// and then repeatedly splits the reference with the largest box in the middle of its longest
+// axis, clipping the triangle against both halves, until no box is larger than areaFraction of
+// the scene box or the number of references has grown by maxGrowth (0.3 = 30% more references).
+// maxGrowth <= 0 creates one reference per triangle. Returns the number of splits performed.
+size_t presplitReferences(const std::vector<RTTriangle>& triangles, size_t first, size_t end,
+                          float maxGrowth, std::vector<BuildRef>& refs, float areaFraction = 1e-4f);
+
+
+}
@@ -1,2 +1,111 @@
 #pragma once
 
+
+#include "base/Math.hpp"
+
+#include <cstdint>
+
+
+namespace FW {
+
+
+// Low-discrepancy sample points for the renderer.
+
+// mixes the bits of x, used to derive independent scrambles from pixel coordinates and seeds
+inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash32(uint32_t x, uint32_t y) {
+    return hash32(x ^ hash32(y + 0x9e3779b9u));
+}
+
+inline uint32_t reverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// the 32 bit fixed point fraction v as a float in [0, 1)
+inline float toUnitFloat(uint32_t v) {
+    return (v >> 8) * (1.0f / 16777216.0f);
+}
+
+// The first two dimensions of the Sobol sequence (the second one after Kollig & Keller 2002). Together
+// they form a (0,2)-sequence: the first 2^k points have one point in every elementary interval of area 2^-k.
+inline uint32_t sobolDim0(uint32_t i) {
+    return reverseBits(i);
+}
+
+inline uint32_t sobolDim1(uint32_t i) {
+    uint32_t r = 0;
+    for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1)
+        if (i & 1)
+            r ^= v;
+    return r;
+}
+
+// Owen scrambling in base 2 (the hash based version of Laine & Karras 2011 with Burley's 2020 constants):
+// randomly flips whole subtrees of the binary digits, which keeps the stratification of the sequence and
+// removes the structured artifacts of XOR scrambling.
+inline uint32_t owenScramble(uint32_t v, uint32_t seed) {
+    uint32_t x = reverseBits(v);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// The Halton sequence in bases 2 and 3.
+inline float radicalInverse2(uint32_t i) {
+    return toUnitFloat(reverseBits(i));
+}
+
+inline float radicalInverse3(uint32_t i) {
+    double inverse = 0.0, scale = 1.0 / 3.0;
+    for (; i; i /= 3, scale /= 3.0)
+        inverse += (i % 3) * scale;
+    return (float)inverse;
+}
+
+// Shirley & Chiu's concentric mapping of [0, 1)^2 to the unit disk, which keeps the stratification
+// of the points without a rejection loop.
+inline Vec2f concentricDisk(const Vec2f& u) {
+    float a = 2.0f * u.x - 1.0f;
+    float b = 2.0f * u.y - 1.0f;
+    if (a == 0.0f && b == 0.0f)
+        return Vec2f(0.0f);
+
+    float r, phi;
+    if (a * a > b * b) {
+        r = a;
+        phi = (FW_PI / 4.0f) * (b / a);
+    } else {
+        r = b;
+        phi = FW_PI / 2.0f - (FW_PI / 4.0f) * (a / b);
+    }
+    return Vec2f(r * cosf(phi), r * sinf(phi));
+}
+
+// cosine weighted direction around +z (Malley's method: lift the disk point to the hemisphere)
+inline Vec3f cosineHemisphere(const Vec2f& u) {
+    Vec2f d = concentricDisk(u);
+    return Vec3f(d.x, d.y, sqrtf(FW::max(0.0f, 1.0f - d.x * d.x - d.y * d.y)));
+}
+
+// Point i of the Owen scrambled 2D Sobol sequence in [0, 1)^2, different seeds decorrelate pixels.
+inline Vec2f sobol2D(uint32_t i, uint32_t seedX, uint32_t seedY) {
+    return Vec2f(toUnitFloat(owenScramble(sobolDim0(i), seedX)), toUnitFloat(owenScramble(sobolDim1(i), seedY)));
+}
+
+
+}
@@ -2,7 +2,7 @@
 
 
 #include "3d/Mesh.hpp"
-#include "base/math.hpp"
+#include "base/Math.hpp"
 
 
 namespace FW {
@@ -81,7 +81,7 @@ namespace FW {
 
 		//Triangle intersection as suggested in [Woop04]
 
-		bool RTTriangle::intersect_woop(const Vec3f& orig, const Vec3f& dir, float& t, float& u, float& v) const {
+		bool intersect_woop(const Vec3f& orig, const Vec3f& dir, float& t, float& u, float& v) const {
 
 			Vec3f transformed_orig = m_data.M*orig + m_data.N,
 				transformed_dir = m_data.M*dir;
@@ -0,0 +1,130 @@
+#include "RayDump.hpp"
+#include "RenderPool.hpp"
+
+#include <cstring>
+#include <fstream>
+
+
+namespace FW {
+
+
+namespace {
+
+const char      Tag[8]      = { 'R', 'a', 'y', 'D', 'u', 'm', 'p', ' ' };
+const S32       Version     = 1;
+const size_t    RayBytes    = 6 * sizeof(F32) + sizeof(F32) + sizeof(S32) + sizeof(U8);
+
+}
+
+
+std::atomic<bool>                   RayDump::s_enabled(false);
+PerThread<RayDump::Buffer>          RayDump::s_buffers;
+
+
+void RayDump::enable(void) {
+    s_buffers.reset(RenderPool::get().getNumThreads());
+    for (int i = 0; i < s_buffers.size(); ++i)
+        s_buffers[i].type = RayType_Other;
+    s_enabled = true;
+}
+
+void RayDump::disable(void) {
+    s_enabled = false;
+}
+
+void RayDump::setType(RayType type) {
+    int thread = RenderPool::currentThread();
+    if (isEnabled() && thread < s_buffers.size())
+        s_buffers[thread].type = (U8)type;
+}
+
+void RayDump::record(const Vec3f& orig, const Vec3f& dir, S32 triangle, F32 t) {
+    // the pool may have been reconfigured with more threads since enable, their rays are dropped
+    int thread = RenderPool::currentThread();
+    if (!isEnabled() || thread >= s_buffers.size())
+        return;
+
+    Buffer& buffer = s_buffers[thread];
+    Ray ray = { orig, dir, t, triangle, buffer.type };
+    buffer.rays.push_back(ray);
+}
+
+bool RayDump::write(const std::string& fileName, S32 numTriangles) {
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out)
+        return false;
+
+    S64 numRays = 0;
+    for (int thread = 0; thread < s_buffers.size(); ++thread)
+        numRays += (S64)s_buffers[thread].rays.size();
+    out.write(Tag, sizeof(Tag));
+    out.write((const char*)&Version, sizeof(Version));
+    out.write((const char*)&numTriangles, sizeof(numTriangles));
+    out.write((const char*)&numRays, sizeof(numRays));
+
+    // packed in chunks, the struct has padding
+    std::vector<char> chunk;
+    for (int thread = 0; thread < s_buffers.size(); ++thread) {
+        const std::vector<Ray>& rays = s_buffers[thread].rays;
+        chunk.resize(rays.size() * RayBytes);
+        char* p = chunk.data();
+        for (const Ray& r : rays) {
+            memcpy(p, &r.orig, sizeof(Vec3f));                  p += sizeof(Vec3f);
+            memcpy(p, &r.dir, sizeof(Vec3f));                   p += sizeof(Vec3f);
+            memcpy(p, &r.t, sizeof(F32));                       p += sizeof(F32);
+            memcpy(p, &r.triangle, sizeof(S32));                p += sizeof(S32);
+            *p++ = (char)r.type;
+        }
+        out.write(chunk.data(), chunk.size());
+    }
+    return (bool)out;
+}
+
+bool RayDump::read(const std::string& fileName, std::vector<Ray>& rays, S32& numTriangles, std::string& error) {
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in) {
+        error = "cannot open the file";
+        return false;
+    }
+
+    char tag[sizeof(Tag)];
+    S32 version = 0;
+    S64 numRays = 0;
+    in.read(tag, sizeof(tag));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&numTriangles, sizeof(numTriangles));
+    in.read((char*)&numRays, sizeof(numRays));
+    if (!in || memcmp(tag, Tag, sizeof(Tag)) != 0 || numRays < 0) {
+        error = "not a ray dump";
+        return false;
+    }
+    if (version != Version) {
+        error = "unsupported version " + std::to_string(version);
+        return false;
+    }
+
+    std::vector<char> data((size_t)numRays * RayBytes);
+    in.read(data.data(), data.size());
+    if (!in) {
+        error = "the file is truncated";
+        return false;
+    }
+    rays.resize((size_t)numRays);
+    const char* p = data.data();
+    for (Ray& r : rays) {
+        memcpy(&r.orig, p, sizeof(Vec3f));                      p += sizeof(Vec3f);
+        memcpy(&r.dir, p, sizeof(Vec3f));                       p += sizeof(Vec3f);
+        memcpy(&r.t, p, sizeof(F32));                           p += sizeof(F32);
+        memcpy(&r.triangle, p, sizeof(S32));                    p += sizeof(S32);
+        r.type = (U8)min((int)(U8)*p++, (int)RayType_Other);
+    }
+    return true;
+}
+
+const char* RayDump::typeName(RayType type) {
+    static const char* const names[RayType_Max] = { "primary", "ao", "other" };
+    return names[type];
+}
+
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+
+#include "PerThread.hpp"
+
+#include "base/Math.hpp"
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+
+namespace FW {
+
+
+// Every ray RayTracer::raycast and raycastBatch trace while recording, with the closest hit the traversal
+// found, so that ray_replay can trace the same rays against other builders, layouts and traversals without
+// the shading, texture fetches and sampling of a render. Every pool thread appends to its own buffer, so
+// recording takes no lock; while recording is off, raycast only tests a flag.
+//
+// The file is "RayDump " followed by the version, the triangle count of the scene (S32 each), the ray
+// count (S64) and 33 bytes per ray: origin and direction (6 F32), t of the hit (F32), triangle index
+// (S32, -1 for a miss) and the ray type (U8), all little-endian. The rays of a thread are in the order
+// traced, so a tile's primary rays stay together.
+class RayDump {
+public:
+    enum RayType {
+        RayType_Primary,
+        RayType_AO,
+        RayType_Other,          // anything traced without setType, e.g. picking in the app
+        RayType_Max
+    };
+
+    struct Ray {
+        Vec3f           orig, dir;          // as passed to raycast, the segment is [orig, orig + dir]
+        F32             t;                  // of the closest hit, meaningless on a miss
+        S32             triangle;           // index into the tracer's triangles, -1 on a miss
+        U8              type;               // RayType
+    };
+
+    // starts a new recording, must not be called while a parallel loop is running
+    static void         enable              (void);
+    static void         disable             (void);
+    static bool         isEnabled           (void) { return s_enabled.load(std::memory_order_relaxed); }
+
+    // the type of the rays the calling thread traces from now on; callers on hot paths test isEnabled first
+    static void         setType             (RayType type);
+    static void         record              (const Vec3f& orig, const Vec3f& dir, S32 triangle, F32 t);
+
+    // writes the rays recorded since enable, false if the file cannot be written
+    static bool         write               (const std::string& fileName, S32 numTriangles);
+    // false with the reason in error if the file cannot be read
+    static bool         read                (const std::string& fileName, std::vector<Ray>& rays, S32& numTriangles, std::string& error);
+
+    static const char*  typeName            (RayType type);     // e.g. "primary"
+
+private:
+    // one per pool thread, on cache lines of its own
+    struct Buffer {
+        std::vector<Ray>    rays;
+        U8                  type;
+    };
+
+    static std::atomic<bool>            s_enabled;
+    static PerThread<Buffer>            s_buffers;
+};
+
+
+}
@@ -3,6 +3,7 @@
 #include "base/Defs.hpp"
 #include "base/Math.hpp"
 #include "RayTracer.hpp"
+#include "BuildKernels.hpp"
 #include <stdio.h>
 #include "rtIntersect.inl"
 #include <fstream>
@@ -11,6 +12,9 @@
 #include <vector>
 #include <numeric>
 #include "rtlib.hpp"
+#include "RenderPool.hpp"
+#include "TraceEvents.hpp"
+#include "RayDump.hpp"
 
 
 // Helper function for hashing scene data for caching BVHs
@@ -99,7 +103,13 @@ String RayTracer::computeMD5( const std::vector<Vec3f>& vertices )
 // --------------------------------------------------------------------------
 
 
-RayTracer::RayTracer()
+RayTracer::RayTracer() :
+    m_triangles(nullptr),
+    m_indices(nullptr),
+    m_presplitGrowth(0.0f),
+    m_layout(BvhLayout_DepthFirst),
+    m_numReferences(0),
+    m_numSplits(0)
 {
 }
 
@@ -110,16 +120,32 @@ RayTracer::~RayTracer()
 
 void RayTracer::loadHierarchy(const char* filename, std::vector<RTTriangle>& triangles)
 {
+    TraceSpan span("loadHierarchy", "io");
+    pushMemOwner("BVH");
 	std::ifstream ifs(filename, std::ios::binary);
     m_bvh = Bvh(ifs);
 
+    m_blas.clear();
+    m_blasRanges.clear();
+    m_instances.clear();
+
     m_triangles = &triangles;
     m_indices = &(m_bvh.getIndices());
+
+    // a cached hierarchy may have been built with pre-splitting; a truncated or mismatched file has fewer
+    // indices than triangles, which must not wrap around to a huge split count
+    m_numReferences = m_indices->size();
+    m_numSplits = m_numReferences >= triangles.size() ? m_numReferences - triangles.size() : 0;
+
+    if (m_bvh.layout() != m_layout)
+        m_bvh.flatten(m_layout);
+    popMemOwner();
 }
 
 void RayTracer::saveHierarchy(const char* filename, const std::vector<RTTriangle>& triangles) {
 	(void)triangles; // Not used.
 
+    TraceSpan span("saveHierarchy", "io");
 	std::ofstream ofs(filename, std::ios::binary);
 	m_bvh.save(ofs);
 }
@@ -131,11 +157,11 @@ std::unique_ptr<BvhNode> RayTracer::constructBvh(size_t start, size_t end) {
 
     if (end - start <= 1) {
         size_t index = m_indices->at(start);
-        AABB box(m_triangles->at(index).min(), m_triangles->at(index).max());
+        AABB box(m_refs[index].bb.min, m_refs[index].bb.max);
         for (size_t i = start + 1; i < end; ++i) {
             index = m_indices->at(i);
-            box.min = FW::min(box.min, m_triangles->at(index).min());
-            box.max = FW::max(box.max, m_triangles->at(index).max());
+            box.min = FW::min(box.min, m_refs[index].bb.min);
+            box.max = FW::max(box.max, m_refs[index].bb.max);
         }
 
         node->bb = std::move(box);
@@ -148,42 +174,13 @@ std::unique_ptr<BvhNode> RayTracer::constructBvh(size_t start, size_t end) {
     }
     else 
     {
-        size_t index = m_indices->at(start);
-        AABB box(m_triangles->at(index).centroid(), m_triangles->at(index).centroid());
-        for (size_t i = start + 1; i < end; ++i) {
-            index = m_indices->at(i);
-            box.min = FW::min(box.min, m_triangles->at(index).centroid());
-            box.max = FW::max(box.max, m_triangles->at(index).centroid());
-        }
-
+        AABB box = centroidBounds(*m_indices, m_refs, start, end);
         Vec3f diagonal = box.max - box.min;
-
-        if (diagonal.x > diagonal.y && diagonal.x > diagonal.z) {
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.x < tmp2.x;
-            });
-        }
-        else if (diagonal.y > diagonal.z) {
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.y < tmp2.y;
-            });
-        } 
-        else {
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.z < tmp2.z;
-            });
-        }
+        sortByCentroid(*m_indices, m_refs, start, end, largestAxis(diagonal));
 
         size_t mid = start + ((end - start) / 2);
 
-        node->left = constructBvh(start, mid);
-        node->right = constructBvh(mid, end);
+        buildChildren(*node, start, mid, end, &RayTracer::constructBvh);
         node->startPrim = start;
         node->endPrim = end;
         node->bb = AABB(FW::min(node->left->bb.min, node->right->bb.min), FW::max(node->left->bb.max, node->right->bb.max));
@@ -197,11 +194,11 @@ std::unique_ptr<BvhNode> RayTracer::constructBvhSah(size_t start, size_t end) {
 
     if (end - start <= 2) {
         size_t index = m_indices->at(start);
-        AABB box(m_triangles->at(index).min(), m_triangles->at(index).max());
+        AABB box(m_refs[index].bb.min, m_refs[index].bb.max);
         for (size_t i = start + 1; i < end; ++i) {
             index = m_indices->at(i);
-            box.min = FW::min(box.min, m_triangles->at(index).min());
-            box.max = FW::max(box.max, m_triangles->at(index).max());
+            box.min = FW::min(box.min, m_refs[index].bb.min);
+            box.max = FW::max(box.max, m_refs[index].bb.max);
         }
 
         node->bb = std::move(box);
@@ -214,106 +211,19 @@ std::unique_ptr<BvhNode> RayTracer::constructBvhSah(size_t start, size_t end) {
     }
     else
     {
-        size_t index = m_indices->at(start);
-        AABB box(m_triangles->at(index).centroid(), m_triangles->at(index).centroid());
-        for (size_t i = start + 1; i < end; ++i) {
-            index = m_indices->at(i);
-            box.min = FW::min(box.min, m_triangles->at(index).centroid());
-            box.max = FW::max(box.max, m_triangles->at(index).centroid());
-        }
-
+        AABB box = centroidBounds(*m_indices, m_refs, start, end);
         Vec3f diagonal = box.max - box.min;
-
-        if (diagonal.x > diagonal.y && diagonal.x > diagonal.z) {
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.x < tmp2.x;
-                });
-        }
-        else if (diagonal.y > diagonal.z) {
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.y < tmp2.y;
-                });
-        }
-        else {
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.z < tmp2.z;
-                });
-        }
-
-        size_t optMid = start + ((end - start) / 2);
-        float minCost = std::numeric_limits<float>::max();
+        sortByCentroid(*m_indices, m_refs, start, end, largestAxis(diagonal));
 
         // ****** unoptimized version of SAH, O(n^2) ******
-        //for (size_t i = start; i < end; ++i) {
-        //    size_t leftIndex= m_indices->at(start);
-        //    size_t rightIndex = m_indices->at(i);
-        //    AABB leftBox(m_triangles->at(leftIndex).centroid(), m_triangles->at(leftIndex).centroid());
-        //    AABB rightBox(m_triangles->at(rightIndex).centroid(), m_triangles->at(rightIndex).centroid());
-
-        //    for (size_t ii = start + 1; ii < i; ++ii) {
-        //        leftIndex = m_indices->at(ii);
-        //        leftBox.min = FW::min(leftBox.min, m_triangles->at(leftIndex).centroid());
-        //        leftBox.max = FW::max(leftBox.max, m_triangles->at(leftIndex).centroid());
-        //    }
-
-        //    for (size_t ii = i + 1; ii < end; ++ii) {
-        //        rightIndex = m_indices->at(ii);
-        //        rightBox.min = FW::min(rightBox.min, m_triangles->at(rightIndex).centroid());
-        //        rightBox.max = FW::max(rightBox.max, m_triangles->at(rightIndex).centroid());
-        //    }
-
-        //    float leftArea = leftBox.area();
-        //    float rightArea = rightBox.area();
-        //    float totalArea = box.area();
-        //    float cost = (leftArea * (i - start) + rightArea * (end - i)) / totalArea;
-        //    if (cost < minCost) {
-        //        minCost = cost;
-        //        optMid = i;
-        //    }
-        //}
-
-
-        // ****** optimized version of SAH, O(n) ******
-        // ****** first compute all AABB area of [start,i] and [i,end], reduce redundant computation ******
-        size_t leftIndex = m_indices->at(start);
-        size_t rightIndex = m_indices->at(end - 1);
-        AABB leftBox(m_triangles->at(leftIndex).centroid(), m_triangles->at(leftIndex).centroid());
-        AABB rightBox(m_triangles->at(rightIndex).centroid(), m_triangles->at(rightIndex).centroid());
-
-        std::vector<float> leftChildrenArea(end - start);
-        std::vector<float> rightChildrenArea(end - start);
-
-        for (size_t i = start; i < end; ++i) {
-            leftIndex = m_indices->at(i);
-            leftBox.min = FW::min(leftBox.min, m_triangles->at(leftIndex).centroid());
-            leftBox.max = FW::max(leftBox.max, m_triangles->at(leftIndex).centroid());
-            leftChildrenArea[i - start] = leftBox.area();
-
-            rightIndex = m_indices->at(start + end - i - 1);
-            rightBox.min = FW::min(rightBox.min, m_triangles->at(rightIndex).centroid());
-            rightBox.max = FW::max(rightBox.max, m_triangles->at(rightIndex).centroid());
-            rightChildrenArea[end - 1 - i] = rightBox.area();
-        }
+        // for every split i, grow the centroid boxes of [start, i) and (i, end) from scratch and
+        // take the i with the lowest (leftArea * (i - start) + rightArea * (end - i)) / totalArea
 
-        float totalArea = box.area();
-        for (size_t i = start; i < end; ++i) {
-            float leftArea = leftChildrenArea[i - start];
-            float rightArea = rightChildrenArea[i - start];
-            float cost = (leftArea * (i - start) + rightArea * (end - i)) / totalArea;
-            if (cost < minCost) {
-                minCost = cost;
-                optMid = i;
-            }
-        }
+        // ****** optimized version of SAH, O(n), see sahSweep ******
+        size_t optMid;
+        sahSweep(*m_indices, m_refs, start, end, optMid, m_sahScratch[RenderPool::currentThread()]);
 
-        node->left = constructBvhSah(start, optMid);
-        node->right = constructBvhSah(optMid, end);
+        buildChildren(*node, start, optMid, end, &RayTracer::constructBvhSah);
         node->startPrim = start;
         node->endPrim = end;
         node->bb = AABB(FW::min(node->left->bb.min, node->right->bb.min), FW::max(node->left->bb.max, node->right->bb.max));
@@ -327,11 +237,11 @@ std::unique_ptr<BvhNode> RayTracer::constructBvhSahOptimalDim(size_t start, size
 
     if (end - start <= 2) {
         size_t index = m_indices->at(start);
-        AABB box(m_triangles->at(index).min(), m_triangles->at(index).max());
+        AABB box(m_refs[index].bb.min, m_refs[index].bb.max);
         for (size_t i = start + 1; i < end; ++i) {
             index = m_indices->at(i);
-            box.min = FW::min(box.min, m_triangles->at(index).min());
-            box.max = FW::max(box.max, m_triangles->at(index).max());
+            box.min = FW::min(box.min, m_refs[index].bb.min);
+            box.max = FW::max(box.max, m_refs[index].bb.max);
         }
 
         node->bb = std::move(box);
@@ -346,75 +256,12 @@ std::unique_ptr<BvhNode> RayTracer::constructBvhSahOptimalDim(size_t start, size
         int optDim = 0;
         size_t optMidDim = start + ((end - start) / 2);
         float minCostDim = std::numeric_limits<float>::max();
+        std::vector<float>& areas = m_sahScratch[RenderPool::currentThread()];
         for (int dim = 0; dim < 3; ++dim) {
-            switch (dim) {
-            case 0:
-                std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                    Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                    Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                    return tmp1.x < tmp2.x;
-                    });
-                break;
-            case 1:
-                std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                    Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                    Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                    return tmp1.y < tmp2.y;
-                    });
-                break;
-            case 2:
-                std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                    Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                    Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                    return tmp1.z < tmp2.z;
-                    });
-                break;
-            }
-
-            size_t index = m_indices->at(start);
-            AABB box(m_triangles->at(index).centroid(), m_triangles->at(index).centroid());
-            for (size_t i = start + 1; i < end; ++i) {
-                index = m_indices->at(i);
-                box.min = FW::min(box.min, m_triangles->at(index).centroid());
-                box.max = FW::max(box.max, m_triangles->at(index).centroid());
-            }
-
-            size_t optMid = start + ((end - start) / 2);
-            float minCost = std::numeric_limits<float>::max();
-
-            // ****** optimized version of SAH, O(n) ******
-            // ****** first compute all AABB area of [start,i] and [i,end], reduce redundant computation ******
-            size_t leftIndex = m_indices->at(start);
-            size_t rightIndex = m_indices->at(end - 1);
-            AABB leftBox(m_triangles->at(leftIndex).centroid(), m_triangles->at(leftIndex).centroid());
-            AABB rightBox(m_triangles->at(rightIndex).centroid(), m_triangles->at(rightIndex).centroid());
-
-            std::vector<float> leftChildrenArea(end - start);
-            std::vector<float> rightChildrenArea(end - start);
-
-            for (size_t i = start; i < end; ++i) {
-                leftIndex = m_indices->at(i);
-                leftBox.min = FW::min(leftBox.min, m_triangles->at(leftIndex).centroid());
-                leftBox.max = FW::max(leftBox.max, m_triangles->at(leftIndex).centroid());
-                leftChildrenArea[i - start] = leftBox.area();
-
-                rightIndex = m_indices->at(start + end - i - 1);
-                rightBox.min = FW::min(rightBox.min, m_triangles->at(rightIndex).centroid());
-                rightBox.max = FW::max(rightBox.max, m_triangles->at(rightIndex).centroid());
-                rightChildrenArea[end - 1 - i] = rightBox.area();
-            }
-
-            float totalArea = box.area();
-            for (size_t i = start; i < end; ++i) {
-                float leftArea = leftChildrenArea[i - start];
-                float rightArea = rightChildrenArea[i - start];
-                float cost = (leftArea * (i - start) + rightArea * (end - i)) / totalArea;
-                if (cost < minCost) {
-                    minCost = cost;
-                    optMid = i;
-                }
-            }
+            sortByCentroid(*m_indices, m_refs, start, end, dim);
 
+            size_t optMid;
+            float minCost = sahSweep(*m_indices, m_refs, start, end, optMid, areas);
             if (minCost < minCostDim) {
                 minCostDim = minCost;
                 optMidDim = optMid;
@@ -422,24 +269,10 @@ std::unique_ptr<BvhNode> RayTracer::constructBvhSahOptimalDim(size_t start, size
             }
         }
 
-        switch (optDim) {
-        case 0:
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.x < tmp2.x;
-                });
-            break;
-        case 1:
-            std::sort(m_indices->begin() + start, m_indices->begin() + end, [this](auto num1, auto num2) {
-                Vec3f tmp1 = (m_triangles->at(num1).min() + m_triangles->at(num1).max()) * 0.5;
-                Vec3f tmp2 = (m_triangles->at(num2).min() + m_triangles->at(num2).max()) * 0.5;
-                return tmp1.y < tmp2.y;
-                });
-            break;
-        }
-        node->left = constructBvhSahOptimalDim(start, optMidDim);
-        node->right = constructBvhSahOptimalDim(optMidDim, end);
+        // the range is still sorted along the last axis
+        if (optDim != 2)
+            sortByCentroid(*m_indices, m_refs, start, end, optDim);
+        buildChildren(*node, start, optMidDim, end, &RayTracer::constructBvhSahOptimalDim);
         node->startPrim = start;
         node->endPrim = end;
         node->bb = AABB(FW::min(node->left->bb.min, node->right->bb.min), FW::max(node->left->bb.max, node->right->bb.max));
@@ -447,35 +280,351 @@ std::unique_ptr<BvhNode> RayTracer::constructBvhSahOptimalDim(size_t start, size
     }
 }
 
-void RayTracer::constructHierarchy(std::vector<RTTriangle>& triangles, SplitMode splitMode) {
-    // YOUR CODE HERE (R1):
-    // This is where you should construct your BVH.
 
-    m_triangles = &triangles;
-    m_indices = &(m_bvh.getIndices());
-    m_indices->resize(triangles.size());
-    std::iota(m_indices->begin(), m_indices->end(), 0);
-    std::unique_ptr<BvhNode> root;
+void RayTracer::buildChildren(BvhNode& node, size_t start, size_t mid, size_t end, std::unique_ptr<BvhNode> (RayTracer::*build)(size_t, size_t)) {
+    // the subtrees sort disjoint parts of the index list and only read the references, so they can be
+    // built concurrently; small ranges are not worth waking up another thread for
+    const size_t parallelMinRefs = 4096;
+    if (end - start < parallelMinRefs) {
+        node.left = (this->*build)(start, mid);
+        node.right = (this->*build)(mid, end);
+        return;
+    }
+    // the owner of the nodes is per thread, so the other thread has to be told
+    RenderPool::get().parallelInvoke([&] { TraceSpan span("subtree", "build", "refs", mid - start); pushMemOwner("BVH"); node.left = (this->*build)(start, mid); popMemOwner(); },
+                                     [&] { TraceSpan span("subtree", "build", "refs", end - mid); pushMemOwner("BVH"); node.right = (this->*build)(mid, end); popMemOwner(); });
+}
+
+std::unique_ptr<BvhNode> RayTracer::constructNode(SplitMode splitMode, size_t start, size_t end) {
     switch (splitMode) {
     case SplitMode::SplitMode_ObjectMedian:
-        root = constructBvh(0, triangles.size());
-        break;
+        return constructBvh(start, end);
     case SplitMode::SplitMode_Sah:
         // use the dimension with the largest extent, faster in build but slower in tracing
-        // root = constructBvhSah(0, triangles.size());
+        // return constructBvhSah(start, end);
         
         // find the best split dimension with the lowest cost, build time is 3 times slower than spilting the dimension with the largest extent
         // but about 15% faster in tracing
-        root = constructBvhSahOptimalDim(0, triangles.size());
-        break;
+        return constructBvhSahOptimalDim(start, end);
     default:
-        root = constructBvhSahOptimalDim(0, triangles.size());
-        break;
+        return constructBvhSahOptimalDim(start, end);
+    }
+}
+
+void RayTracer::constructHierarchy(std::vector<RTTriangle>& triangles, SplitMode splitMode) {
+    // YOUR CODE HERE (R1):
+    // This is where you should construct your BVH.
+    TraceSpan span("constructHierarchy", "build", "triangles", triangles.size());
+    pushMemOwner("BVH");
+
+    m_blas.clear();
+    m_blasRanges.clear();
+    m_instances.clear();
+    m_numReferences = m_numSplits = 0;
+
+    m_triangles = &triangles;
+    m_indices = &(m_bvh.getIndices());
+    m_bvh.setRoot(buildFromReferences(splitMode, 0, triangles.size()));
+    TraceSpan flattenSpan("flatten", "build");
+    m_bvh.flatten(m_layout);
+    popMemOwner();
+}
+
+std::unique_ptr<BvhNode> RayTracer::buildFromReferences(SplitMode splitMode, size_t first, size_t end) {
+    {
+        TraceSpan span("presplit", "build", "triangles", end - first);
+        m_numSplits += presplitReferences(*m_triangles, first, end, m_presplitGrowth, m_refs);
     }
-    m_bvh.setRoot(std::move(root));
+
+    // the builders partition the references, the finished hierarchy indexes the triangles
+    m_indices->resize(m_refs.size());
+    std::iota(m_indices->begin(), m_indices->end(), 0);
+    m_sahScratch.reset(RenderPool::get().getNumThreads());
+    std::unique_ptr<BvhNode> root = constructNode(splitMode, 0, m_refs.size());
+    m_sahScratch.reset(0);
+    for (auto& index : *m_indices)
+        index = m_refs[index].tri;
+
+    m_refs.clear();
+    m_refs.shrink_to_fit();
+    m_numReferences += m_indices->size();
+    return root;
+}
+
+void RayTracer::constructTwoLevelHierarchy(std::vector<RTTriangle>& triangles, const std::vector<std::pair<size_t, size_t>>& ranges, SplitMode splitMode) {
+    TraceSpan span("constructTwoLevelHierarchy", "build", "triangles", triangles.size(), "meshes", ranges.size());
+    pushMemOwner("BVH");
+    m_triangles = &triangles;
+    m_blas.clear();
+    m_blasRanges.clear();
+    m_instances.clear();
+    m_numReferences = m_numSplits = 0;
+
+    // bottom level: the indices of each hierarchy point directly into the shared triangle array,
+    // so the builders work unchanged on a subset of the triangles
+    for (auto& range : ranges) {
+        if (range.second <= range.first)
+            continue;
+
+        TraceSpan blasSpan("bottomLevel", "build", "triangles", range.second - range.first);
+        m_blas.emplace_back();
+        m_blasRanges.push_back(range);
+        Bvh& blas = m_blas.back();
+        m_indices = &(blas.getIndices());
+        blas.setRoot(buildFromReferences(splitMode, range.first, range.second));
+        blas.flatten(m_layout);
+
+        addInstance(m_blas.size() - 1, Mat4f());
+    }
+
+    rebuildTopLevel();
+    m_indices = nullptr;
+    popMemOwner();
+}
+
+BvhOptimizer::Stats RayTracer::optimizeHierarchy(int iterations) {
+    TraceSpan span("optimizeHierarchy", "build");
+    BvhOptimizer optimizer(7, iterations);
+    if (m_instances.empty()) {
+        BvhOptimizer::Stats stats = optimizer.optimize(m_bvh);
+        m_bvh.flatten(m_layout);
+        return stats;
+    }
+
+    BvhOptimizer::Stats total = { 0.0f, 0.0f, 0.0f };
+    for (auto& blas : m_blas) {
+        BvhOptimizer::Stats stats = optimizer.optimize(blas);
+        blas.flatten(m_layout);
+        total.sahBefore += stats.sahBefore;
+        total.sahAfter += stats.sahAfter;
+        total.seconds += stats.seconds;
+    }
+
+    // the root boxes do not change, but keep the top level consistent with the bottom levels anyway
+    for (size_t i = 0; i < m_instances.size(); ++i)
+        setInstanceTransform(i, m_instances[i].objectToWorld);
+    rebuildTopLevel();
+    return total;
 }
 
-RaycastResult RayTracer::intersect(const BvhNode& node, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const {
+BvhReport RayTracer::analyzeHierarchy(bool computeEpo) const {
+    if (m_instances.empty())
+        return analyzeBvh(m_bvh, *m_triangles, computeEpo);
+
+    BvhReport total = analyzeBvh(m_blas[0], *m_triangles, computeEpo, m_blasRanges[0].first, m_blasRanges[0].second);
+    for (size_t i = 1; i < m_blas.size(); ++i)
+        total.merge(analyzeBvh(m_blas[i], *m_triangles, computeEpo, m_blasRanges[i].first, m_blasRanges[i].second));
+    return total;
+}
+
+void RayTracer::applyLayout(BvhLayout layout) {
+    pushMemOwner("BVH");
+    m_layout = layout;
+    if (m_instances.empty())
+        m_bvh.flatten(layout);
+    for (auto& blas : m_blas)
+        blas.flatten(layout);
+    popMemOwner();
+}
+
+void RayTracer::beginVisitCounting() {
+    if (m_instances.empty())
+        m_bvh.beginVisitCounting();
+    for (auto& blas : m_blas)
+        blas.beginVisitCounting();
+}
+
+size_t RayTracer::addInstance(size_t blas, const Mat4f& objectToWorld) {
+    FW_ASSERT(blas < m_blas.size());
+    m_instances.emplace_back(blas, objectToWorld, m_blas[blas].root().bb);
+    return m_instances.size() - 1;
+}
+
+void RayTracer::setInstanceTransform(size_t instance, const Mat4f& objectToWorld) {
+    BvhInstance& inst = m_instances.at(instance);
+    inst.setTransform(objectToWorld, m_blas[inst.blas].root().bb);
+}
+
+void RayTracer::rebuildTopLevel() {
+    std::vector<uint32_t>& indices = m_tlas.getIndices();
+    indices.resize(m_instances.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    if (m_instances.empty())
+        m_tlas.setRoot(nullptr);
+    else
+        m_tlas.setRoot(constructTopLevel(0, m_instances.size()));
+}
+
+// object median split over the world space boxes of the instances; there are only
+// a handful of instances compared to triangles, so the top level is cheap to rebuild
+std::unique_ptr<BvhNode> RayTracer::constructTopLevel(size_t start, size_t end) {
+    std::vector<uint32_t>& indices = m_tlas.getIndices();
+    std::unique_ptr<BvhNode> node = std::make_unique<BvhNode>(start, end);
+
+    AABB box = m_instances[indices[start]].worldBounds;
+    AABB centroids(box.min + box.max, box.min + box.max);
+    for (size_t i = start + 1; i < end; ++i) {
+        const AABB& bb = m_instances[indices[i]].worldBounds;
+        box.min = FW::min(box.min, bb.min);
+        box.max = FW::max(box.max, bb.max);
+        centroids.min = FW::min(centroids.min, bb.min + bb.max);
+        centroids.max = FW::max(centroids.max, bb.min + bb.max);
+    }
+    node->bb = box;
+
+    if (end - start <= 2)
+        return node;
+
+    Vec3f diagonal = centroids.max - centroids.min;
+    int dim = (diagonal.x > diagonal.y && diagonal.x > diagonal.z) ? 0 : (diagonal.y > diagonal.z ? 1 : 2);
+    size_t mid = start + ((end - start) / 2);
+    std::nth_element(indices.begin() + start, indices.begin() + mid, indices.begin() + end, [this, dim](uint32_t a, uint32_t b) {
+        const AABB& ba = m_instances[a].worldBounds;
+        const AABB& bb = m_instances[b].worldBounds;
+        return (ba.min + ba.max)[dim] < (bb.min + bb.max)[dim];
+    });
+
+    node->left = constructTopLevel(start, mid);
+    node->right = constructTopLevel(mid, end);
+    return node;
+}
+
+// deeper trees than this are traversed recursively over the node tree
+static const int MaxTraversalDepth = 128;
+
+RaycastResult RayTracer::intersect(const Bvh& bvh, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const {
+    if (bvh.nodes().empty())
+        return RaycastResult();
+    if (bvh.depth() > MaxTraversalDepth)
+        return intersect(bvh.root(), bvh.getIndices(), orig, dir, normDir, invDir);
+    if (bvh.isCountingVisits())
+        return intersectFlat<true>(bvh, orig, dir, normDir, invDir);
+    return intersectFlat<false>(bvh, orig, dir, normDir, invDir);
+}
+
+// Stack based traversal of the flat node array. Like the recursive version, both children of every
+// hit node are visited, so the node order in memory is the only thing the layout changes.
+template <bool CountVisits>
+RaycastResult RayTracer::intersectFlat(const Bvh& bvh, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const {
+
+    const BvhFlatNode* nodes = bvh.nodes().data();
+    const std::vector<uint32_t>& indices = bvh.getIndices();
+    std::array<bool, 3> dirIsNeg{ normDir.x > 0, normDir.y > 0, normDir.z > 0 };
+
+    uint32_t stack[MaxTraversalDepth];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    float closest_t = 1.0f, closest_u = 0.0f, closest_v = 0.0f;
+    int closest_i = -1;
+
+    while (stackSize > 0) {
+        uint32_t current = stack[--stackSize];
+        const BvhFlatNode& node = nodes[current];
+        if (CountVisits)
+            bvh.countVisit(current);
+
+        if (AABB(node.bbMin, node.bbMax).intersect(orig, invDir, dirIsNeg) == false)
+            continue;
+
+        if (node.isLeaf()) {
+            for (uint32_t i = node.a; i < node.a + node.count(); ++i) {
+                float t, u, v;
+                uint32_t index = indices[i];
+                if ((*m_triangles)[index].intersect_woop(orig, dir, t, u, v)) {
+                    if (t > 0.0f && t < closest_t) {
+                        closest_i = index;
+                        closest_t = t;
+                        closest_u = u;
+                        closest_v = v;
+                    }
+                }
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.b;
+        stack[stackSize++] = node.a;
+    }
+
+    if (closest_i != -1)
+        return RaycastResult(&(*m_triangles)[closest_i], closest_t, closest_u, closest_v, orig + closest_t * dir, orig, dir);
+    return RaycastResult();
+}
+
+// the active rays of a packet are a bit mask
+static const int MaxPacketSize = 64;
+
+// Like intersectFlat, but every node is tested against all rays that hit its parent and is skipped
+// once none of them hits it, so each ray visits exactly the nodes it would visit alone.
+void RayTracer::intersectPacket(const Bvh& bvh, const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count) const {
+
+    const BvhFlatNode* nodes = bvh.nodes().data();
+    const std::vector<uint32_t>& indices = bvh.getIndices();
+
+    Vec3f invDir[MaxPacketSize];
+    std::array<bool, 3> dirIsNeg[MaxPacketSize];
+    float closest_t[MaxPacketSize], closest_u[MaxPacketSize], closest_v[MaxPacketSize];
+    int closest_i[MaxPacketSize];
+    for (int r = 0; r < count; ++r) {
+        Vec3f normDir = dir[r].normalized();
+        invDir[r] = Vec3f(1. / normDir.x, 1. / normDir.y, 1. / normDir.z);
+        dirIsNeg[r] = std::array<bool, 3>{ normDir.x > 0, normDir.y > 0, normDir.z > 0 };
+        closest_t[r] = 1.0f;
+        closest_u[r] = closest_v[r] = 0.0f;
+        closest_i[r] = -1;
+    }
+
+    uint32_t stack[MaxTraversalDepth];
+    uint64_t stackMask[MaxTraversalDepth];
+    int stackSize = 0;
+    stack[stackSize] = 0;
+    stackMask[stackSize++] = count == MaxPacketSize ? ~0ull : (1ull << count) - 1;
+
+    while (stackSize > 0) {
+        --stackSize;
+        const BvhFlatNode& node = nodes[stack[stackSize]];
+        uint64_t mask = stackMask[stackSize];
+
+        uint64_t hitMask = 0;
+        for (int r = 0; r < count; ++r)
+            if (((mask >> r) & 1) && AABB(node.bbMin, node.bbMax).intersect(orig[r], invDir[r], dirIsNeg[r]))
+                hitMask |= 1ull << r;
+        if (hitMask == 0)
+            continue;
+
+        if (node.isLeaf()) {
+            for (uint32_t i = node.a; i < node.a + node.count(); ++i) {
+                uint32_t index = indices[i];
+                const RTTriangle& tri = (*m_triangles)[index];
+                for (int r = 0; r < count; ++r) {
+                    float t, u, v;
+                    if (((hitMask >> r) & 1) && tri.intersect_woop(orig[r], dir[r], t, u, v) && t > 0.0f && t < closest_t[r]) {
+                        closest_i[r] = index;
+                        closest_t[r] = t;
+                        closest_u[r] = u;
+                        closest_v[r] = v;
+                    }
+                }
+            }
+            continue;
+        }
+
+        stack[stackSize] = node.b;
+        stackMask[stackSize++] = hitMask;
+        stack[stackSize] = node.a;
+        stackMask[stackSize++] = hitMask;
+    }
+
+    for (int r = 0; r < count; ++r) {
+        if (closest_i[r] != -1)
+            results[r] = RaycastResult(&(*m_triangles)[closest_i[r]], closest_t[r], closest_u[r], closest_v[r], orig[r] + closest_t[r] * dir[r], orig[r], dir[r]);
+        else
+            results[r] = RaycastResult();
+    }
+}
+
+RaycastResult RayTracer::intersect(const BvhNode& node, const std::vector<uint32_t>& indices, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const {
 
     std::array<bool, 3> dirIsNeg{ normDir.x > 0, normDir.y > 0, normDir.z > 0 };
     if (node.bb.intersect(orig, invDir, dirIsNeg) == false) {
@@ -491,7 +640,7 @@ RaycastResult RayTracer::intersect(const BvhNode& node, const Vec3f& orig, const
         for ( int i = node.startPrim; i < node.endPrim; ++i )
         {
             float t, u, v;
-            index = m_indices->at(i);
+            index = indices[i];
             if ( (*m_triangles)[index].intersect_woop( orig, dir, t, u, v ) )
             {
                 if ( t > 0.0f && t < closest_t)
@@ -510,18 +659,78 @@ RaycastResult RayTracer::intersect(const BvhNode& node, const Vec3f& orig, const
         return castresult;
     }
 
-    RaycastResult leftHit = intersect(*(node.left), orig, dir, normDir, invDir);
-    RaycastResult rightHit = intersect(*(node.right), orig, dir, normDir, invDir);
+    RaycastResult leftHit = intersect(*(node.left), indices, orig, dir, normDir, invDir);
+    RaycastResult rightHit = intersect(*(node.right), indices, orig, dir, normDir, invDir);
 
     return leftHit.t < rightHit.t ? std::move(leftHit) : std::move(rightHit);
 }
 
+// Traverses the top level in world space and each hit instance in its object space.
+// The ray direction is transformed without normalization, so t is the same in both spaces.
+RaycastResult RayTracer::intersectTopLevel(const BvhNode& node, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const {
+
+    std::array<bool, 3> dirIsNeg{ normDir.x > 0, normDir.y > 0, normDir.z > 0 };
+    if (node.bb.intersect(orig, invDir, dirIsNeg) == false) {
+        return RaycastResult();
+    }
+
+    if (!node.hasChildren()) {
+        RaycastResult closest;
+        for (size_t i = node.startPrim; i < node.endPrim; ++i) {
+            const BvhInstance& inst = m_instances[m_tlas.getIndex((uint32_t)i)];
+            const Bvh& blas = m_blas[inst.blas];
+
+            Vec3f localOrig = (inst.worldToObject * Vec4f(orig, 1.0f)).getXYZ();
+            Vec3f localDir = (inst.worldToObject * Vec4f(dir, 0.0f)).getXYZ();
+            Vec3f localNormDir = localDir.normalized();
+            Vec3f localInvDir = Vec3f(1.0f / localNormDir.x, 1.0f / localNormDir.y, 1.0f / localNormDir.z);
+
+            RaycastResult hit = intersect(blas, localOrig, localDir, localNormDir, localInvDir);
+            if (hit.t < closest.t) {
+                closest = hit;
+                closest.instance = &inst;
+            }
+        }
+
+        if (closest.tri != nullptr) {
+            closest.point = orig + closest.t * dir;
+            closest.orig = orig;
+            closest.dir = dir;
+        }
+        return closest;
+    }
+
+    RaycastResult leftHit = intersectTopLevel(*(node.left), orig, dir, normDir, invDir);
+    RaycastResult rightHit = intersectTopLevel(*(node.right), orig, dir, normDir, invDir);
+
+    return leftHit.t < rightHit.t ? std::move(leftHit) : std::move(rightHit);
+}
+
+void RayTracer::raycastBatch(const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count) const {
+    // two-level hierarchies, trees too deep for the flat traversal and visit counting take the single ray path
+    if (!m_instances.empty() || m_bvh.nodes().empty() || m_bvh.depth() > MaxTraversalDepth || m_bvh.isCountingVisits()) {
+        for (int r = 0; r < count; ++r)
+            results[r] = raycast(orig[r], dir[r]);
+        return;
+    }
+
+    m_rayCount += count;
+    for (int first = 0; first < count; first += MaxPacketSize)
+        intersectPacket(m_bvh, orig + first, dir + first, results + first, std::min(count - first, MaxPacketSize));
+    if (RayDump::isEnabled())
+        for (int r = 0; r < count; ++r)
+            RayDump::record(orig[r], dir[r], results[r].tri ? (S32)(results[r].tri - m_triangles->data()) : -1, results[r].t);
+}
+
 RaycastResult RayTracer::raycast(const Vec3f& orig, const Vec3f& dir) const {
 	++m_rayCount;
 
     Vec3f normDir = dir.normalized();
     Vec3f invDir = Vec3f(1. / normDir.x, 1. / normDir.y, 1. / normDir.z);
-    return intersect(m_bvh.root(), orig, dir, normDir, invDir);
+    RaycastResult result = m_instances.empty() ? intersect(m_bvh, orig, dir, normDir, invDir) : intersectTopLevel(m_tlas.root(), orig, dir, normDir, invDir);
+    if (RayDump::isEnabled())
+        RayDump::record(orig, dir, result.tri ? (S32)(result.tri - m_triangles->data()) : -1, result.t);
+    return result;
 
     // YOUR CODE HERE (R1):
     // This is where you traverse the tree you built! It's probably easiest
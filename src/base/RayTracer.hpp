@@ -5,6 +5,11 @@
 #include "RaycastResult.hpp"
 #include "rtlib.hpp"
 #include "Bvh.hpp"
+#include "BvhInstance.hpp"
+#include "BvhOptimizer.hpp"
+#include "Presplit.hpp"
+#include "BvhReport.hpp"
+#include "PerThread.hpp"
 
 #include "base/String.hpp"
 
@@ -31,11 +36,50 @@ public:
 
 						void					constructHierarchy(std::vector<RTTriangle>& triangles, SplitMode splitMode);
 
+    // Two-level hierarchy: one bottom-level BVH for each [begin, end) triangle range (e.g. a submesh),
+    // placed into the world by instances that are collected into a small top-level BVH.
+    // Every range gets one instance with an identity transform; more can be added with addInstance.
+    void				constructTwoLevelHierarchy(std::vector<RTTriangle>& triangles, const std::vector<std::pair<size_t, size_t>>& ranges, SplitMode splitMode);
+
+    // Instances share the geometry and hierarchy of their bottom-level BVH. After adding or moving
+    // instances, call rebuildTopLevel; the bottom-level hierarchies are left untouched.
+    size_t				addInstance				(size_t blas, const Mat4f& objectToWorld);
+    void				setInstanceTransform	(size_t instance, const Mat4f& objectToWorld);
+    void				rebuildTopLevel			(void);
+
+    // Improves the SAH cost of the constructed hierarchy (every bottom level one in two-level mode)
+    // by treelet restructuring. The returned SAH costs are summed over all optimized hierarchies.
+    BvhOptimizer::Stats	optimizeHierarchy		(int iterations = 3);
+
+    // Early split clipping of large triangles before the build, applied to every following construct*Hierarchy
+    // call. maxGrowth caps the number of extra references relative to the triangle count, 0 disables it.
+    void				setPresplit				(float maxGrowth) { m_presplitGrowth = maxGrowth; }
+    size_t				getNumReferences		(void) const { return m_numReferences; }	// references in the last build, >= triangle count
+    size_t				getNumPresplits			(void) const { return m_numSplits; }
+
+    // Node layout of the flat arrays used for traversal, applied to every following build or load.
+    // applyLayout re-lays out the current hierarchies; after beginVisitCounting, the visits of the
+    // rays traced in between rank the nodes of the hot treelet layout.
+    void				setLayout				(BvhLayout layout) { m_layout = layout; }
+    void				applyLayout				(BvhLayout layout);
+    void				beginVisitCounting		(void);
+
+    // Quality statistics and consistency checks of the current hierarchy, summed over the bottom
+    // levels in two-level mode. An invalid report means the hierarchy must not be used for tracing.
+    BvhReport			analyzeHierarchy		(bool computeEpo) const;
+
+    size_t				getNumBottomLevel		(void) const { return m_blas.size(); }
+    size_t				getNumInstances			(void) const { return m_instances.size(); }
+
     void				saveHierarchy			(const char* filename, const std::vector<RTTriangle>& triangles);
     void				loadHierarchy			(const char* filename, std::vector<RTTriangle>& triangles);
 
     RaycastResult		raycast					(const Vec3f& orig, const Vec3f& dir) const;
 
+    // Traces count rays as a packet that shares one traversal of the hierarchy, which saves node fetches
+    // when the rays are coherent, e.g. the sub-pixel rays of one pixel. The results are the same as raycast's.
+    void				raycastBatch			(const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count) const;
+
     // This function computes an MD5 checksum of the input scene data,
     // WITH the assumption that all vertices are allocated in one big chunk.
     static FW::String	computeMD5				(const std::vector<Vec3f>& vertices);
@@ -49,11 +93,36 @@ private:
     std::unique_ptr<BvhNode> constructBvh(size_t start, size_t end);
     std::unique_ptr<BvhNode> constructBvhSah(size_t start, size_t end);
     std::unique_ptr<BvhNode> constructBvhSahOptimalDim(size_t start, size_t end);
-    RaycastResult intersect(const BvhNode& node, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const;
+    std::unique_ptr<BvhNode> constructNode(SplitMode splitMode, size_t start, size_t end);
+    // builds both children of a node with the given builder, on two threads when the range is large
+    void buildChildren(BvhNode& node, size_t start, size_t mid, size_t end, std::unique_ptr<BvhNode> (RayTracer::*build)(size_t, size_t));
+    std::unique_ptr<BvhNode> buildFromReferences(SplitMode splitMode, size_t first, size_t end);
+    std::unique_ptr<BvhNode> constructTopLevel(size_t start, size_t end);
+    RaycastResult intersect(const Bvh& bvh, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const;
+    template <bool CountVisits>
+    RaycastResult intersectFlat(const Bvh& bvh, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const;
+    RaycastResult intersect(const BvhNode& node, const std::vector<uint32_t>& indices, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const;
+    void intersectPacket(const Bvh& bvh, const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count) const;
+    RaycastResult intersectTopLevel(const BvhNode& node, const Vec3f& orig, const Vec3f& dir, const Vec3f& normDir, const Vec3f& invDir) const;
 	mutable std::atomic<int> m_rayCount;
 	Bvh m_bvh;
 
+    // two-level hierarchy; m_bvh is unused when there are instances
+    std::vector<Bvh>            m_blas;
+    std::vector<std::pair<size_t, size_t>> m_blasRanges;   // triangles of each bottom level
+    std::vector<BvhInstance>    m_instances;
+    Bvh                         m_tlas;
+
     std::vector<uint32_t>* m_indices;
+
+    // build references of the hierarchy under construction, m_indices points into these during the build
+    std::vector<BuildRef>   m_refs;
+    // sahSweep's scratch space of each build thread, kept from node to node during a build
+    PerThread<std::vector<float>> m_sahScratch;
+    float                   m_presplitGrowth;
+    BvhLayout               m_layout;
+    size_t                  m_numReferences;
+    size_t                  m_numSplits;
 };
 
 
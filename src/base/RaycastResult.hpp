@@ -2,6 +2,7 @@
 
 
 #include "RTTriangle.hpp"
+#include "BvhInstance.hpp"
 
 #include "base/Math.hpp"
 
@@ -14,6 +15,7 @@ namespace FW {
 // Result information of a raycast.
 struct RaycastResult {
 	const RTTriangle* tri; // The triangle that was hit.
+	const BvhInstance* instance; // Instance of the hit triangle in the two-level BVH, nullptr for world space triangles.
 	float t;               // Hit position is orig + t * dir.
 	float u, v;            // Barycentric coordinates at the hit triangle.
 	Vec3f point;           // Hit position.
@@ -26,6 +28,7 @@ struct RaycastResult {
                   float t, float u, float v,
 	              Vec3f point, const Vec3f& orig, const Vec3f& dir)
 		: tri(tri),
+          instance(nullptr),
           t(t),
           u(u), v(v),
           point(point),
@@ -34,6 +37,7 @@ struct RaycastResult {
 
 	RaycastResult()
         : tri(nullptr),
+          instance(nullptr),
           t(std::numeric_limits<float>::max()),
 	      u(), v(),
           point(),
@@ -41,6 +45,11 @@ struct RaycastResult {
     {}
 
 	inline operator bool() { return tri != nullptr; }
+
+	// Geometric normal of the hit triangle in world space.
+	inline Vec3f normal() const {
+		return instance ? (instance->normalToWorld * tri->normal()).normalized() : tri->normal();
+	}
 };
 
 
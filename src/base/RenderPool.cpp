@@ -0,0 +1,177 @@
+#include "RenderPool.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include "base/DLLImports.hpp"
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace FW {
+
+
+namespace {
+
+thread_local int t_thread = 0;
+
+void pinToCore(std::thread& thread, int core) {
+#ifdef _WIN32
+    SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << core);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+}
+
+}
+
+
+RenderPool& RenderPool::get(void) {
+    static RenderPool pool;
+    return pool;
+}
+
+RenderPool::RenderPool(void) :
+    m_quit(false),
+    m_numThreads(std::max((int)std::thread::hardware_concurrency(), 1)),
+    m_pinned(false)
+{
+    start();
+}
+
+RenderPool::~RenderPool(void) {
+    stop();
+}
+
+void RenderPool::configure(int numThreads, bool pinThreads) {
+    int hardware = std::max((int)std::thread::hardware_concurrency(), 1);
+    numThreads = numThreads > 0 ? numThreads : hardware;
+    if (numThreads == m_numThreads && pinThreads == m_pinned)
+        return;
+
+    stop();
+    m_numThreads = numThreads;
+    m_pinned = pinThreads;
+    start();
+}
+
+int RenderPool::currentThread(void) {
+    return t_thread;
+}
+
+void RenderPool::start(void) {
+    m_quit = false;
+    int hardware = std::max((int)std::thread::hardware_concurrency(), 1);
+    for (int i = 1; i < m_numThreads; ++i) {
+        m_workers.emplace_back(&RenderPool::workerLoop, this, i);
+        if (m_pinned)
+            pinToCore(m_workers.back(), i % hardware);
+    }
+}
+
+void RenderPool::stop(void) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+}
+
+void RenderPool::workerLoop(int thread) {
+    t_thread = thread;
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+        if (m_quit)
+            return;
+
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+        lock.unlock();
+        (*job.func)(thread);
+        finish(job);
+        lock.lock();
+    }
+}
+
+void RenderPool::finish(const Job& job) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        --*job.remaining;
+    }
+    m_done.notify_all();
+}
+
+void RenderPool::run(int numJobs, const std::function<void(int thread)>& func) {
+    int thread = t_thread;
+    numJobs = std::min(numJobs, m_numThreads);
+    if (numJobs <= 1) {
+        func(thread);
+        return;
+    }
+
+    int remaining = numJobs - 1;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (int i = 1; i < numJobs; ++i)
+            m_jobs.push_back(Job{ &func, &remaining });
+    }
+    m_wake.notify_all();
+    m_done.notify_all();
+
+    func(thread);
+
+    // help with whatever is queued instead of idling, this is what makes nested loops safe
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (remaining > 0) {
+        if (m_jobs.empty()) {
+            m_done.wait(lock);
+            continue;
+        }
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+        lock.unlock();
+        (*job.func)(thread);
+        finish(job);
+        lock.lock();
+    }
+}
+
+void RenderPool::parallelFor(int count, const std::function<void(int index, int thread)>& body) {
+    if (count <= 0)
+        return;
+
+    std::atomic<int> next(0);
+    run(count, [&](int thread) {
+        for (int i = next++; i < count; i = next++)
+            body(i, thread);
+    });
+}
+
+void RenderPool::parallelForTiles(TileScheduler& tiles, const std::function<void(const TileScheduler::Tile& tile, int thread)>& body) {
+    run(m_numThreads, [&](int thread) {
+        TileScheduler::Tile tile;
+        while (tiles.next(thread, tile))
+            body(tile, thread);
+    });
+}
+
+void RenderPool::parallelInvoke(const std::function<void()>& a, const std::function<void()>& b) {
+    parallelFor(2, [&](int index, int) {
+        if (index == 0)
+            a();
+        else
+            b();
+    });
+}
+
+
+}
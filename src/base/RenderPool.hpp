@@ -0,0 +1,78 @@
+#pragma once
+
+
+#include "TileScheduler.hpp"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+namespace FW {
+
+
+// The worker threads shared by the renderer, the BVH builders and optimizer and texture processing.
+// The threads are created once and sleep between jobs, so an interactive frame only pays for waking
+// them up. The thread calling into the pool works along as thread 0, and a thread that waits for its
+// jobs to finish runs other queued jobs meanwhile, so parallel loops can be nested (e.g. the subtrees
+// of a BVH build) without running out of threads. Only one thread outside the pool should use it at
+// a time, since all of them are thread 0.
+class RenderPool {
+public:
+    static RenderPool&  get                 (void);
+
+    // numThreads counts the calling thread, 0 uses one thread per hardware thread. Pinning binds
+    // worker i to core i, which makes timings repeatable when several renders share a machine.
+    // Must not be called while a parallel loop is running.
+    void                configure           (int numThreads, bool pinThreads);
+
+    int                 getNumThreads       (void) const { return m_numThreads; }
+    bool                isPinned            (void) const { return m_pinned; }
+
+    // index of the calling thread, 0 for threads that do not belong to the pool
+    static int          currentThread       (void);
+
+    // body(index, thread) for every index in [0, count), indices are handed out one at a time
+    void                parallelFor         (int count, const std::function<void(int index, int thread)>& body);
+
+    // body(tile, thread) for every tile of the scheduler, which must be made for getNumThreads() threads
+    void                parallelForTiles    (TileScheduler& tiles, const std::function<void(const TileScheduler::Tile& tile, int thread)>& body);
+
+    // runs a and b, concurrently if another thread is free
+    void                parallelInvoke      (const std::function<void()>& a, const std::function<void()>& b);
+
+private:
+    struct Job {
+        const std::function<void(int)>* func;
+        int*                            remaining;
+    };
+
+                        RenderPool          (void);
+                        ~RenderPool         (void);
+                        RenderPool          (const RenderPool&) = delete;
+    RenderPool&         operator=           (const RenderPool&) = delete;
+
+    void                start               (void);
+    void                stop                (void);
+    void                workerLoop          (int thread);
+
+    // runs func on numJobs threads, including the calling one, and returns when all of them are done
+    void                run                 (int numJobs, const std::function<void(int thread)>& func);
+    void                finish              (const Job& job);
+
+    std::vector<std::thread>    m_workers;
+    std::deque<Job>             m_jobs;
+    std::mutex                  m_lock;
+    std::condition_variable     m_wake;         // new jobs or quit
+    std::condition_variable     m_done;         // a job has finished
+    bool                        m_quit;
+    int                         m_numThreads;
+    bool                        m_pinned;
+};
+
+
+}
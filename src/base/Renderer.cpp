@@ -1,8 +1,19 @@
 #include "Renderer.hpp"
 #include "RayTracer.hpp"
 
+#include "TileScheduler.hpp"
+#include "RenderPool.hpp"
+#include "Sampler.hpp"
+#include "TraceEvents.hpp"
+#include "RayDump.hpp"
+
+#include "base/Timer.hpp"
+
 #include <atomic>
 #include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <limits>
 
 
 namespace FW {
@@ -14,12 +25,52 @@ Renderer::Renderer()
 	m_aoNumRays = 16;
 	m_aaNumRays = 1;
     m_raysPerSecond = 0.0f;
+    m_numTiles = 0;
+    m_tilesStolen = 0;
+	m_progressiveValid = false;
+	m_progressiveUnlimited = false;
+	m_samplesPerPass = 4;
+	m_filter = Filter_Box;
+	m_filterRadius = 0.5f;
+	m_sampler = Sampler_Sobol;
+	m_adaptiveAO = false;
+	m_adaptiveThreshold = 0.02f;
+	m_adaptiveMinRays = 16;
+	m_progressiveSamples = 0;
+	m_progressivePass = 0;
+	m_phaseTiming = false;
+	beginPhases();
 }
 
 Renderer::~Renderer()
 {
 }
 
+void Renderer::beginPhases()
+{
+	for (int p = 0; p < RenderPhase_Max; ++p)
+		m_phaseSeconds[p] = 0.0f;
+	m_phaseTicks.reset(m_phaseTiming ? RenderPool::get().getNumThreads() : 0);
+}
+
+void Renderer::endPhases(float seconds)
+{
+	// the ticks are summed over the threads; their shares of all pixel ticks split the wall time.
+	// Shading is timed around texture sampling, which is taken out of it here.
+	PhaseTicks sum;
+	for (int t = 0; t < m_phaseTicks.size(); ++t)
+	{
+		for (int p = 0; p < RenderPhase_Max; ++p)
+			sum.phase[p] += m_phaseTicks[t].phase[p];
+		sum.pixel += m_phaseTicks[t].pixel;
+	}
+	if (!m_phaseTiming || sum.pixel <= 0)
+		return;
+	for (int p = 0; p < RenderPhase_Max; ++p)
+		m_phaseSeconds[p] = seconds * (float)sum.phase[p] / (float)sum.pixel;
+	m_phaseSeconds[RenderPhase_Shading] = FW::max(m_phaseSeconds[RenderPhase_Shading] - m_phaseSeconds[RenderPhase_TextureSampling], 0.0f);
+}
+
 void Renderer::gatherLightTriangles(RayTracer* rt) {
 	// gather light triangles into vector for possible later use in the area light extra
 	m_lightTriangles.clear();
@@ -39,14 +90,17 @@ timingResult Renderer::rayTracePicture( RayTracer* rt, Image* image, const Camer
 {
 
     // measure time to render
-	LARGE_INTEGER start, stop, frequency;
-	QueryPerformanceFrequency(&frequency);
-	QueryPerformanceCounter(&start); // Start time stamp	
+	auto start = std::chrono::high_resolution_clock::now(); // Start time stamp
 	rt->resetRayCounter();
+	beginPhases();
+	TraceSpan span("rayTracePicture", "render");
 
     // this has a side effect of forcing Image to reserve its memory immediately
     // otherwise we get a rendering bug & memory leak in OpenMP parallel code
+    pushMemOwner("Images");
     image->getMutablePtr();
+    popMemOwner();
+	pushMemOwner("Renderer");
 
     // get camera orientation and projection
     Mat4f worldToCamera = cameraCtrl.getWorldToCamera();
@@ -55,92 +109,340 @@ timingResult Renderer::rayTracePicture( RayTracer* rt, Image* image, const Camer
     // inverse projection from clip space to world space
     Mat4f invP = (projection * worldToCamera).inverted();
 
-    // progress counter
-    std::atomic<int> lines_done = 0;
+    // progress counter, only the first thread prints it
+    std::atomic<int> tiles_done(0);
 
     int height = image->getSize().y;
     int width = image->getSize().x;
 
+	// AO rays each pixel actually used, for the samples image of adaptive AO
+	m_aoRaysUsed.assign(width * height, 0);
+
 	for (int j = 0; j < height; j++)
 	for (int i = 0; i < width; i++)
 		image->setVec4f(Vec2i(i, j), Vec4f(.0f)); //initialize image to 0
 
+	RenderPool& pool = RenderPool::get();
+	int numThreads = pool.getNumThreads();
+
+	// tiles instead of rows, so that threads that finish early can help with the expensive parts of the image
+	TileScheduler scheduler(image->getSize(), numThreads);
+	std::vector<float> busy(numThreads, 0.0f);
+
 	// YOUR CODE HERE(R5):
-	// remove this to enable multithreading (you also need to enable it in the project properties: C++/Language/Open MP support)
-	#pragma omp parallel for
-    for ( int j = 0; j < height; ++j )
-    {
-        // Each thread must have its own random generator
-        Random rnd;
-
-        for ( int i = 0; i < width; ++i )
+	// the tiles are rendered by the persistent worker threads, see RenderPool
+	pool.parallelForTiles(scheduler, [&](const TileScheduler::Tile& tile, int thread)
+	{
+		TraceSpan tileSpan("tile", "render", "x", tile.min.x, "y", tile.min.y);
+		auto tileStart = std::chrono::high_resolution_clock::now();
+
+        for ( int j = tile.min.y; j < tile.max.y; ++j )
+        for ( int i = tile.min.x; i < tile.max.x; ++i )
         {
-            // generate ray through pixel
-				float x = (i + 0.5f) / image->getSize().x *  2.0f - 1.0f;
-				float y = (j + 0.5f) / image->getSize().y * -2.0f + 1.0f;
-				// point on front plane in homogeneous coordinates
-				Vec4f P0( x, y, 0.0f, 1.0f );
-				// point on back plane in homogeneous coordinates
-				Vec4f P1( x, y, 1.0f, 1.0f );
-
-				// apply inverse projection, divide by w to get object-space points
-				Vec4f Roh = (invP * P0);
-				Vec3f Ro = (Roh * (1.0f / Roh.w)).getXYZ();
-				Vec4f Rdh = (invP * P1);
-				Vec3f Rd = (Rdh * (1.0f / Rdh.w)).getXYZ();
-
-				// Subtract front plane point from back plane point,
-				// yields ray direction.
-				// NOTE that it's not normalized; the direction Rd is defined
-				// so that the segment to be traced is [Ro, Ro+Rd], i.e.,
-				// intersections that come _after_ the point Ro+Rd are to be discarded.
-				Rd = Rd - Ro;
-
-				// trace!
-				RaycastResult hit = rt->raycast( Ro, Rd );
-
-				// if we hit something, fetch a color and insert into image
-				Vec4f color(0,0,0,1);
-				if ( hit.tri != nullptr )
-				{
-					switch( mode )
-					{
-					case ShadingMode_Headlight:
-						color = computeShadingHeadlight( hit, cameraCtrl);
-						break;
-					case ShadingMode_AmbientOcclusion:
-						color = computeShadingAmbientOcclusion( rt, hit, cameraCtrl, rnd );
-						break;
-					case ShadingMode_Whitted:
-						color = computeShadingWhitted( rt, hit, cameraCtrl, rnd, 0 );
-						break;
-					}
-				}
-				// put pixel.
-				image->setVec4f(Vec2i(i, j), color);
+            // filter weighted average of the AA samples
+            float weight = 0.0f;
+            Vec4f color = tracePixel(rt, invP, image->getSize(), i, j, cameraCtrl, mode, 0, FW::max(m_aaNumRays, 1), m_aoNumRays, 0, weight, &m_aoRaysUsed[j * width + i]);
+            image->setVec4f(Vec2i(i, j), weight > 0.0f ? color * (1.0f / weight) : Vec4f(0.0f));
         }
 
         // Print progress info
-		#pragma omp critical
-		{
-			++lines_done;
-			::printf("%.2f%% \r", lines_done * 100.0f / height);
-		}
-    }
+		int done = ++tiles_done;
+		if (thread == 0)
+			::printf("%.2f%% \r", done * 100.0f / scheduler.getNumTiles());
+
+		// with work stealing, a thread is only idle once the whole image has been handed out
+		busy[thread] += std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - tileStart).count();
+    });
 
 	// how fast did we go?
 	timingResult result;
 
-	QueryPerformanceCounter(&stop); // Stop time stamp
-
-	result.duration = (int)((stop.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart); // Get timer result in milliseconds
+	result.duration = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count(); // Get timer result in milliseconds
 
 	// calculate average rays per second
 	result.rayCount = rt->getRayCount();
     m_raysPerSecond = 1000.0f * result.rayCount / result.duration;
+	endPhases(std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count());
 
     printf("\n");
 
+	m_threadBusy = busy;
+	m_numTiles = scheduler.getNumTiles();
+	m_tilesStolen = scheduler.getNumStolen();
+	float minBusy = *std::min_element(busy.begin(), busy.end());
+	float maxBusy = *std::max_element(busy.begin(), busy.end());
+	float avgBusy = std::accumulate(busy.begin(), busy.end(), 0.0f) / busy.size();
+	::printf("%d threads busy min %.0f / avg %.0f / max %.0f ms, %d of %d tiles stolen\n", numThreads,
+		minBusy * 1000.0f, avgBusy * 1000.0f, maxBusy * 1000.0f, scheduler.getNumStolen(), scheduler.getNumTiles());
+
+	if (mode == ShadingMode_AmbientOcclusion) {
+		long long aoRays = std::accumulate(m_aoRaysUsed.begin(), m_aoRaysUsed.end(), 0ll);
+		::printf("%lld AO rays, %.1f per pixel of at most %d\n", aoRays, (double)aoRays / m_aoRaysUsed.size(), m_aoNumRays * FW::max(m_aaNumRays, 1));
+	}
+
+	popMemOwner();
+	return result;
+}
+
+void Renderer::getAOSamplesImage(Image* image) const
+{
+	Vec2i size = image->getSize();
+	if (m_aoRaysUsed.size() != (size_t)size.x * size.y)
+		return;
+
+	float scale = 1.0f / FW::max(m_aoNumRays * FW::max(m_aaNumRays, 1), 1);
+	for (int j = 0; j < size.y; j++)
+	for (int i = 0; i < size.x; i++) {
+		float v = FW::min(m_aoRaysUsed[j * size.x + i] * scale, 1.0f);
+		image->setVec4f(Vec2i(i, j), Vec4f(v, v, v, 1.0f));
+	}
+}
+
+
+float Renderer::filterWeight(float d) const
+{
+	// separable filters, d is the offset from the pixel center in pixels
+	float r = m_filterRadius;
+	switch (m_filter)
+	{
+	case Filter_Tent:
+		return FW::max(0.0f, 1.0f - FW::abs(d) / r);
+	case Filter_Gaussian:
+	{
+		// sigma = r / 2, shifted down so that the weight reaches zero at the radius
+		float alpha = 2.0f / (r * r);
+		return FW::max(0.0f, expf(-alpha * d * d) - expf(-alpha * r * r));
+	}
+	default:
+		return 1.0f;
+	}
+}
+
+Vec4f Renderer::tracePixel(RayTracer* rt, const Mat4f& invP, const Vec2i& size, int i, int j, const CameraControls& cameraCtrl, ShadingMode mode, int firstSample, int numSamples, int aoRays, int firstAORay, float& weight, int* aoRaysUsed)
+{
+	// the sub-pixel rays go out in batches that share one BVH traversal
+	static const int MaxBatch = 64;
+	Vec3f orig[MaxBatch], dir[MaxBatch];
+	float offsetX[MaxBatch], offsetY[MaxBatch];
+	float sampleWeight[MaxBatch];
+	RaycastResult hits[MaxBatch];
+
+	// sub-pixel positions and AO directions come from separately randomized point sets of the pixel,
+	// everything random is keyed by the pixel and the sample, not by the thread that renders it
+	uint32_t pixelSeed = hash32(i, j);
+	PixelSampler aaSampler(m_sampler, pixelSeed);
+	PixelSampler aoSampler(m_sampler, hash32(pixelSeed, 1));
+	CounterRng rng(hash32(pixelSeed, 2));
+
+	// phase timing, the clock is only read when it is on
+	S64 pixelStart = m_phaseTiming ? Timer::queryTicks() : 0;
+	S64 primaryTicks = 0, shadingTicks = 0;
+
+	Vec4f sum(0.0f);
+	for (int first = firstSample; first < firstSample + numSamples; first += MaxBatch)
+	{
+		S64 batchStart = m_phaseTiming ? Timer::queryTicks() : 0;
+		int count = FW::min(MaxBatch, firstSample + numSamples - first);
+		if (m_aaNumRays > 1)
+			aaSampler.get(first, count, offsetX, offsetY);
+		for (int k = 0; k < count; ++k)
+		{
+			// without AA, the ray goes through the pixel center
+			Vec2f offset(0.0f);
+			sampleWeight[k] = 1.0f;
+			if (m_aaNumRays > 1)
+			{
+				offset = (Vec2f(offsetX[k], offsetY[k]) * 2.0f - 1.0f) * m_filterRadius;
+				sampleWeight[k] = filterWeight(offset.x) * filterWeight(offset.y);
+			}
+
+			// generate ray through the sample position
+			float x = (i + 0.5f + offset.x) / size.x *  2.0f - 1.0f;
+			float y = (j + 0.5f + offset.y) / size.y * -2.0f + 1.0f;
+			// point on front plane in homogeneous coordinates
+			Vec4f P0( x, y, 0.0f, 1.0f );
+			// point on back plane in homogeneous coordinates
+			Vec4f P1( x, y, 1.0f, 1.0f );
+
+			// apply inverse projection, divide by w to get object-space points
+			Vec4f Roh = (invP * P0);
+			Vec3f Ro = (Roh * (1.0f / Roh.w)).getXYZ();
+			Vec4f Rdh = (invP * P1);
+			Vec3f Rd = (Rdh * (1.0f / Rdh.w)).getXYZ();
+
+			// Subtract front plane point from back plane point,
+			// yields ray direction.
+			// NOTE that it's not normalized; the direction Rd is defined
+			// so that the segment to be traced is [Ro, Ro+Rd], i.e.,
+			// intersections that come _after_ the point Ro+Rd are to be discarded.
+			orig[k] = Ro;
+			dir[k] = Rd - Ro;
+		}
+
+		// trace!
+		if (RayDump::isEnabled())
+			RayDump::setType(RayDump::RayType_Primary);
+		rt->raycastBatch(orig, dir, hits, count);
+
+		S64 shadingStart = m_phaseTiming ? Timer::queryTicks() : 0;
+		if (m_phaseTiming)
+			primaryTicks += shadingStart - batchStart;
+
+		for (int k = 0; k < count; ++k)
+		{
+			// if we hit something, fetch a color
+			const RaycastResult& hit = hits[k];
+			Vec4f color(0,0,0,1);
+			if ( hit.tri != nullptr )
+			{
+				switch( mode )
+				{
+				case ShadingMode_Headlight:
+					color = computeShadingHeadlight( hit, cameraCtrl);
+					break;
+				case ShadingMode_AmbientOcclusion:
+					color = computeShadingAmbientOcclusion( rt, hit, cameraCtrl, aoSampler, firstAORay + (first + k - firstSample) * aoRays, aoRays, aoRaysUsed );
+					break;
+				case ShadingMode_Whitted:
+					color = computeShadingWhitted( rt, hit, cameraCtrl, rng, 0 );
+					break;
+				}
+			}
+			sum += color * sampleWeight[k];
+			weight += sampleWeight[k];
+		}
+		if (m_phaseTiming)
+			shadingTicks += Timer::queryTicks() - shadingStart;
+	}
+
+	if (m_phaseTiming && RenderPool::currentThread() < m_phaseTicks.size())
+	{
+		PhaseTicks& ticks = m_phaseTicks[RenderPool::currentThread()];
+		ticks.phase[RenderPhase_PrimaryRays] += primaryTicks;
+		ticks.phase[RenderPhase_Shading] += shadingTicks;
+		ticks.pixel += Timer::queryTicks() - pixelStart;
+	}
+	return sum;
+}
+
+void Renderer::resetProgressive()
+{
+	m_progressiveValid = false;
+}
+
+int Renderer::getProgressiveTarget(ShadingMode mode) const
+{
+	// with AA the samples are sub-pixel rays, otherwise only the AO rays are random and the other
+	// modes give the same color for every sample
+	if (m_aaNumRays > 1)
+		return m_progressiveUnlimited ? std::numeric_limits<int>::max() : m_aaNumRays;
+	if (mode != ShadingMode_AmbientOcclusion)
+		return 1;
+	return m_progressiveUnlimited ? std::numeric_limits<int>::max() : m_aoNumRays;
+}
+
+timingResult Renderer::renderProgressive(RayTracer* rt, Image* image, const CameraControls& cameraCtrl, ShadingMode mode, float budgetSeconds)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	auto deadline = start + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<float>(budgetSeconds));
+	rt->resetRayCounter();
+	pushMemOwner("Images");
+	image->getMutablePtr();
+	popMemOwner();
+	beginPhases();
+	TraceSpan span("renderProgressive", "render");
+	m_threadBusy.clear();
+	m_numTiles = m_tilesStolen = 0;
+	pushMemOwner("Renderer");
+
+	Vec2i size = image->getSize();
+	Mat4f projection = Mat4f::fitToView(Vec2f(-1,-1), Vec2f(2,2), size)*cameraCtrl.getCameraToClip();
+	Mat4f invP = (projection * cameraCtrl.getWorldToCamera()).inverted();
+
+	// anything that changes the picture starts the accumulation over
+	if (!m_progressiveValid || invP != m_progressiveInvP || mode != m_progressiveMode || size != m_progressiveSize
+		|| m_aoNumRays != m_progressiveAORays || m_aoRayLength != m_progressiveAOLength || m_aaNumRays != m_progressiveAARays
+		|| m_filter != m_progressiveFilter || m_filterRadius != m_progressiveFilterRadius || m_sampler != m_progressiveSampler)
+	{
+		m_progressiveValid = true;
+		m_progressiveInvP = invP;
+		m_progressiveMode = mode;
+		m_progressiveSize = size;
+		m_progressiveAORays = m_aoNumRays;
+		m_progressiveAOLength = m_aoRayLength;
+		m_progressiveAARays = m_aaNumRays;
+		m_progressiveFilter = m_filter;
+		m_progressiveFilterRadius = m_filterRadius;
+		m_progressiveSampler = m_sampler;
+		m_progressiveSamples = 0;
+		m_progressivePass = 0;
+		m_accum.assign(size.x * size.y, Vec4f(0.0f));
+		m_accumSamples.assign(size.x * size.y, 0);
+		m_accumWeight.assign(size.x * size.y, 0.0f);
+		for (int j = 0; j < size.y; j++)
+		for (int i = 0; i < size.x; i++)
+			image->setVec4f(Vec2i(i, j), Vec4f(.0f));
+	}
+
+	RenderPool& pool = RenderPool::get();
+	int target = getProgressiveTarget(mode);
+
+	// the first tile is rendered even if it overruns the budget, so that every call makes progress
+	std::atomic<bool> started(false);
+	while (m_progressiveSamples < target && std::chrono::high_resolution_clock::now() < deadline)
+	{
+		int passTarget = m_progressiveSamples + std::min(m_samplesPerPass, target - m_progressiveSamples);
+		std::atomic<int> skipped(0);
+
+		TileScheduler scheduler(size, pool.getNumThreads());
+		pool.parallelForTiles(scheduler, [&](const TileScheduler::Tile& tile, int thread)
+		{
+			// tiles are always rendered whole, so the first pixel tells how far the tile is
+			int tileSamples = m_accumSamples[tile.min.y * size.x + tile.min.x];
+			if (tileSamples >= passTarget)
+				return;
+			if (started.exchange(true) && std::chrono::high_resolution_clock::now() >= deadline)
+			{
+				++skipped;
+				return;
+			}
+
+			TraceSpan tileSpan("tile", "render", "x", tile.min.x, "y", tile.min.y);
+			int samples = passTarget - tileSamples;
+			for (int j = tile.min.y; j < tile.max.y; ++j)
+			for (int i = tile.min.x; i < tile.max.x; ++i)
+			{
+				int index = j * size.x + i;
+				float weight = 0.0f;
+				if (m_aaNumRays > 1)
+				{
+					// the next sub-pixel samples of the pixel's sequence, each with all of its AO rays
+					m_accum[index] += tracePixel(rt, invP, size, i, j, cameraCtrl, mode, tileSamples, samples, m_aoNumRays, tileSamples * m_aoNumRays, weight);
+					m_accumWeight[index] += weight;
+				}
+				else
+				{
+					// one primary ray; the AO result is the unoccluded fraction of its rays, weight it by their number
+					m_accum[index] += tracePixel(rt, invP, size, i, j, cameraCtrl, mode, 0, 1, samples, tileSamples, weight) * (float)samples;
+					m_accumWeight[index] += (float)samples;
+				}
+				m_accumSamples[index] = passTarget;
+				image->setVec4f(Vec2i(i, j), m_accumWeight[index] > 0.0f ? m_accum[index] * (1.0f / m_accumWeight[index]) : Vec4f(0.0f));
+			}
+		});
+
+		++m_progressivePass;
+		if (skipped == 0)
+			m_progressiveSamples = passTarget;
+	}
+
+	timingResult result;
+	result.duration = (int)(std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count() * 1000.0f);
+	result.rayCount = rt->getRayCount();
+	if (result.duration > 0)
+		m_raysPerSecond = 1000.0f * result.rayCount / result.duration;
+	endPhases(std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count());
+	popMemOwner();
 	return result;
 }
 
@@ -148,6 +450,11 @@ timingResult Renderer::rayTracePicture( RayTracer* rt, Image* image, const Camer
 void Renderer::getTextureParameters(const RaycastResult& hit, Vec3f& diffuse, Vec3f& n, Vec3f& specular)
 {
 	MeshBase::Material* mat = hit.tri->m_material;
+	// only lookups that sample a texture are timed, the rest is too short to be worth two clock reads
+	bool timed = m_phaseTiming && RenderPool::currentThread() < m_phaseTicks.size()
+		&& (mat->textures[MeshBase::TextureType_Diffuse].exists() || (m_normalMapped && mat->textures[MeshBase::TextureType_Normal].exists())
+			|| (m_specularMapped && mat->textures[MeshBase::TextureType_Specular].exists()));
+	S64 start = timed ? Timer::queryTicks() : 0;
 	// YOUR CODE HERE (R3):
 	// using the barycentric coordinates of the intersection (hit.u, hit.v) and the
 	// vertex texture coordinates hit.tri->m_vertices[i].t of the intersected triangle,
@@ -211,6 +518,12 @@ void Renderer::getTextureParameters(const RaycastResult& hit, Vec3f& diffuse, Ve
 		Vec3f t = ((deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r).normalized();
 		Vec3f b = ((deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r).normalized();
 
+		// tangents are computed from object space positions for instanced geometry
+		if (hit.instance) {
+			t = (hit.instance->objectToWorld * Vec4f(t, 0.0f)).getXYZ().normalized();
+			b = (hit.instance->objectToWorld * Vec4f(b, 0.0f)).getXYZ().normalized();
+		}
+
 		Mat3f tbn;
 
 		tbn.col(0) = t;
@@ -228,6 +541,9 @@ void Renderer::getTextureParameters(const RaycastResult& hit, Vec3f& diffuse, Ve
 		Vec2i texelCoords = getTexelCoords(uv, img.getSize());
 		specular = img.getVec4f(texelCoords).getXYZ();
 	}
+
+	if (timed)
+		m_phaseTicks[RenderPool::currentThread()].phase[RenderPhase_TextureSampling] += Timer::queryTicks() - start;
 }
 
 Vec4f Renderer::computeShadingHeadlight(const RaycastResult& hit, const CameraControls& cameraCtrl)
@@ -235,7 +551,7 @@ Vec4f Renderer::computeShadingHeadlight(const RaycastResult& hit, const CameraCo
 	// get diffuse color
 	MeshBase::Material* mat = hit.tri->m_material;
 	Vec3f diffuse = mat->diffuse.getXYZ();
-	Vec3f n(hit.tri->normal());
+	Vec3f n(hit.normal());
 	Vec3f specular = mat->specular; // specular color. Not used in requirements, but you can use this in extras if you wish.
 
 	if (m_useTextures)
@@ -258,12 +574,12 @@ Vec4f Renderer::computeShadingHeadlight(const RaycastResult& hit, const CameraCo
 }
 
 
-Vec4f Renderer::computeShadingAmbientOcclusion(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, Random& rnd)
+Vec4f Renderer::computeShadingAmbientOcclusion(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, PixelSampler& sampler, int firstRay, int numRays, int* raysUsed)
 {
     // YOUR CODE HERE (R4)
 	Vec3f hit2Cam((cameraCtrl.getPosition() - hit.point).normalized());
 	Vec3f hitPoint((hit2Cam * 0.001) + hit.point);
-	Vec3f n(hit.tri->normal());
+	Vec3f n(hit.normal());
 
 	if (dot(hit2Cam, n) < 0) {
 		n = -n;
@@ -271,28 +587,46 @@ Vec4f Renderer::computeShadingAmbientOcclusion(RayTracer* rt, const RaycastResul
 
 	Mat3f rotationMat = formBasis(n);
 
-	int totalNoHit = m_aoNumRays;
-	for (int i = 0; i < m_aoNumRays; ++i) {
-
-		float x, y, z;
-		do {
-			x = rnd.getF32(-1, 1);
-			y = rnd.getF32(-1, 1);
-		} while (x * x + y * y > 1.0);
-
-		Vec3f rayDirection(x, y, sqrtf(1 - x * x - y * y));
-
-		RaycastResult newHit = rt->raycast(hitPoint, (rotationMat * rayDirection) * m_aoRayLength);
-
-		if (newHit) {
-			totalNoHit--;
+	// Adaptive: the ray count doubles from m_adaptiveMinRays until the standard error of the visible
+	// fraction, estimated as for independent rays, is below the threshold. The fraction in the error is
+	// pulled towards 1/2 as (k + 1/2) / (n + 1): with the plain k / n, a first batch that happens to agree
+	// has an error of 0 and stops, which a thin occluder or contact shadow does about a third of the time
+	// at 16 rays. Pixels that see the same in every direction (open floor, deep corners) still stop early,
+	// after 64 rays at a threshold of 0.02. The variance of the batch means would be the textbook estimate,
+	// but the Sobol batches are stratified against each other and agree far more often than the error warrants.
+	bool adaptive = raysUsed && m_adaptiveAO && numRays > m_adaptiveMinRays;
+	int target = adaptive ? m_adaptiveMinRays : numRays;
+
+	int totalNoHit = 0, cast = 0;
+	if (RayDump::isEnabled())
+		RayDump::setType(RayDump::RayType_AO);
+	for (;;) {
+		for (; cast < target; ++cast) {
+
+			// cosine weighted: the sample point is mapped to the disk with the concentric mapping and lifted to the hemisphere
+			Vec3f rayDirection = cosineHemisphere(sampler.get(firstRay + cast));
+
+			RaycastResult newHit = rt->raycast(hitPoint, (rotationMat * rayDirection) * m_aoRayLength);
+
+			if (!newHit) {
+				totalNoHit++;
+			}
 		}
+
+		if (cast >= numRays)
+			break;
+		float visible = (totalNoHit + 0.5f) / (cast + 1.0f);
+		if (sqrtf(visible * (1.0f - visible) / cast) <= m_adaptiveThreshold)
+			break;
+		target = FW::min(2 * cast, numRays);
 	}
 
-	return Vec4f(static_cast<float>(totalNoHit) / static_cast<float>(m_aoNumRays));
+	if (raysUsed)
+		*raysUsed += cast;
+	return Vec4f(static_cast<float>(totalNoHit) / static_cast<float>(cast));
 }
 
-Vec4f Renderer::computeShadingWhitted(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, Random& rnd, int num_bounces)
+Vec4f Renderer::computeShadingWhitted(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, const CounterRng& rng, int num_bounces)
 {
 	//EXTRA: implement a whitted integrator
 	return Vec4f(.0f);
@@ -2,7 +2,8 @@
 
 #include "3d/CameraControls.hpp"
 #include "3d/Mesh.hpp"
-#include "base/Random.hpp"
+#include "Sampler.hpp"
+#include "PerThread.hpp"
 
 #include <vector>
 
@@ -33,10 +34,33 @@ public:
 		ShadingMode_Whitted
 	};
 
+	// how the AA samples of a pixel are weighted into its color
+	enum ReconstructionFilter
+	{
+		Filter_Box = 0,
+		Filter_Tent,
+		Filter_Gaussian
+	};
+
 	// draw a picture of the mesh from the viewpoint specified by the matrix.
 	// shading mode determined by the enum.
 	timingResult		rayTracePicture(RayTracer*, Image*, const CameraControls& camera, ShadingMode mode);
 
+	// progressive version of rayTracePicture: every pass adds samples to an accumulation buffer and the
+	// image shows their average. Returns once the budget is used up, after finishing the tile in hand,
+	// and the next call continues where it stopped. Moving the camera or changing the mode, the image
+	// size or the AO settings starts over; call resetProgressive after changing anything else.
+	timingResult		renderProgressive(RayTracer*, Image*, const CameraControls& camera, ShadingMode mode, float budgetSeconds);
+	void				resetProgressive();
+	bool				isProgressiveDone(ShadingMode mode) const	{ return m_progressiveValid && m_progressiveSamples >= getProgressiveTarget(mode); }
+	int					getProgressiveSamples() const				{ return m_progressiveSamples; }
+
+	// samples added to every pixel per pass: AA samples with AA on, AO rays otherwise
+	void				setSamplesPerPass(int i)		{ m_samplesPerPass = i; }
+
+	// keep adding AO samples until the caller stops, instead of stopping at the AO ray count; used to render to equal time
+	void				setProgressiveUnlimited(bool b)	{ m_progressiveUnlimited = b; }
+
 	// add all the emissive triangles in the mesh into m_lightTriangles
 	void				gatherLightTriangles(RayTracer* rt);
 
@@ -50,6 +74,17 @@ public:
 	// how many primary rays to shoot per pixel.
 	void				setAANumRays(int i)			{ m_aaNumRays = i; }
 
+	// the AA samples are spread over [-radius, radius] pixels around the pixel center and weighted by the filter;
+	// a box of radius 0.5 averages over the pixel.
+	void				setFilter(ReconstructionFilter f, float radius)	{ m_filter = f; m_filterRadius = radius; }
+
+	// where the sub-pixel positions and AO directions come from
+	void				setSampler(SamplerType type)	{ m_sampler = type; }
+
+	// adaptive AO: the AO rays of a pixel go out in growing batches, and sampling stops once the standard error
+	// of the occlusion estimate is below threshold; the AO ray count is the maximum. Not used by progressive passes.
+	void				setAdaptiveAO(bool enabled, float threshold)	{ m_adaptiveAO = enabled; m_adaptiveThreshold = threshold; }
+
 	// the maximum number of bounces for the whitted integrator (extra).
 	void				setWhittedBounces(int i)			{ m_whittedBounces = i; }
 
@@ -66,17 +101,54 @@ public:
 
     float				getRaysPerSecond					( void )			{ return m_raysPerSecond; }
 
+	// seconds each render thread spent on tiles in the last rayTracePicture, shows the load imbalance;
+	// empty after renderProgressive, whose passes are not timed per thread
+	const std::vector<float>&	getThreadBusyTimes			( void ) const		{ return m_threadBusy; }
+	// the tiles of the last rayTracePicture and how many of them threads took from another's queue
+	int							getNumTiles					( void ) const		{ return m_numTiles; }
+	int							getNumTilesStolen			( void ) const		{ return m_tilesStolen; }
+
+	// the AO rays each pixel of the last rayTracePicture used, as a grey scale image from 0 to the AO ray count
+	void				getAOSamplesImage					( Image* image ) const;
+
+	// Where the render threads spent the last rayTracePicture or renderProgressive call, as shares of its wall
+	// time. Off by default since it reads the clock for every batch of rays and every texture lookup.
+	enum RenderPhase
+	{
+		RenderPhase_PrimaryRays = 0,	// primary ray generation and tracing
+		RenderPhase_Shading,			// shading including secondary (AO) rays, without texture sampling
+		RenderPhase_TextureSampling,
+		RenderPhase_Max
+	};
+	void				setPhaseTiming						( bool b )			{ m_phaseTiming = b; }
+	float				getPhaseTime						( RenderPhase phase ) const	{ return m_phaseSeconds[phase]; }
+
 
 protected:
 
+	// traces and shades the AA samples [firstSample, firstSample + numSamples) of pixel (i, j), returns their
+	// filter weighted sum and adds the weights to weight. Without AA, the one ray goes through the pixel center.
+	// The AO rays of the samples continue the pixel's AO sequence from firstAORay. If aoRaysUsed is given, AO may
+	// stop early when adaptive AO is on, and the rays actually cast are added to it.
+	Vec4f				tracePixel							(RayTracer* rt, const Mat4f& invP, const Vec2i& size, int i, int j, const CameraControls& cameraCtrl, ShadingMode mode,
+															 int firstSample, int numSamples, int aoRays, int firstAORay, float& weight, int* aoRaysUsed = nullptr);
+	float				filterWeight						(float d) const;
+
+	void				beginPhases							(void);
+	void				endPhases							(float seconds);
+
+	// samples per pixel after which the progressive rendering of the mode is converged
+	int					getProgressiveTarget				(ShadingMode mode) const;
+
     // simple headlight shading, ray direction dot surface normal
     Vec4f				computeShadingHeadlight				(const RaycastResult& hit, const CameraControls& cameraCtrl);
 
     // implement ambient occlusion as per the instructions
-	Vec4f				computeShadingAmbientOcclusion		(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, Random& rnd);
+	// with the directions [firstRay, firstRay + numRays) of the sampler, or a prefix of them with adaptive AO
+	Vec4f				computeShadingAmbientOcclusion		(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, PixelSampler& sampler, int firstRay, int numRays, int* raysUsed = nullptr);
 
 	// EXTRA: implement the whitted integrator extra
-	Vec4f				computeShadingWhitted				(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, Random& rnd, int num_bounces);
+	Vec4f				computeShadingWhitted				(RayTracer* rt, const RaycastResult& hit, const CameraControls& cameraCtrl, const CounterRng& rng, int num_bounces);
 
 	// EXTRA: gets all parameters from the material's textures.
 	void				getTextureParameters				(const RaycastResult& hit, Vec3f& diffuse, Vec3f& n, Vec3f& specular);
@@ -84,6 +156,13 @@ protected:
     float						m_aoRayLength;
 	int							m_aoNumRays;
 	int							m_aaNumRays;
+	ReconstructionFilter		m_filter;
+	float						m_filterRadius;
+	SamplerType					m_sampler;
+	bool						m_adaptiveAO;
+	float						m_adaptiveThreshold;
+	int							m_adaptiveMinRays;		// AO rays of the first batch, every pixel casts at least these
+	std::vector<int>			m_aoRaysUsed;			// per pixel, from the last rayTracePicture
 	int							m_whittedBounces;
 	bool						m_useToneMapping;
 	bool						m_useReflections;
@@ -96,8 +175,41 @@ protected:
 	std::vector<RTTriangle*>	m_lightTriangles;// Contains all triangles with an emission of over 0 in the scene. 
 												 // Can be used for the area lights extra in order to sample random light-emitting triangles in the scene.
 
-    __int64						m_s64TotalRays;
+    S64							m_s64TotalRays;
     float						m_raysPerSecond;
+	std::vector<float>			m_threadBusy;
+	int							m_numTiles;
+	int							m_tilesStolen;
+
+	// each render thread sums its own ticks, endPhases adds them up
+	struct PhaseTicks
+	{
+		S64						phase[RenderPhase_Max] = {};
+		S64						pixel = 0;
+	};
+
+	bool						m_phaseTiming;
+	PerThread<PhaseTicks>		m_phaseTicks;
+	float						m_phaseSeconds[RenderPhase_Max];
+
+	// progressive rendering state, the settings it was started with and the accumulated samples
+	bool						m_progressiveValid;
+	bool						m_progressiveUnlimited;
+	int							m_samplesPerPass;
+	int							m_progressiveSamples;	// every pixel has at least this many
+	int							m_progressivePass;
+	Mat4f						m_progressiveInvP;
+	ShadingMode					m_progressiveMode;
+	Vec2i						m_progressiveSize;
+	int							m_progressiveAORays;
+	float						m_progressiveAOLength;
+	int							m_progressiveAARays;
+	ReconstructionFilter		m_progressiveFilter;
+	float						m_progressiveFilterRadius;
+	SamplerType					m_progressiveSampler;
+	std::vector<Vec4f>			m_accum;				// sum of the samples of each pixel
+	std::vector<float>			m_accumWeight;			// sum of the filter weights of each pixel
+	std::vector<int>			m_accumSamples;
 
 	bool						m_specularMapped;
 	bool						m_bilinearFiltering;
@@ -0,0 +1,74 @@
+#pragma once
+
+
+#include "QMC.hpp"
+#include "CounterRng.hpp"
+
+
+namespace FW {
+
+
+enum SamplerType {
+    Sampler_Random = 0,     // independent uniform points, from the counter-based generator
+    Sampler_Sobol,          // Owen scrambled Sobol (0,2)-sequence
+    Sampler_Halton          // Halton in bases 2 and 3, randomly rotated
+};
+
+
+// The 2D sample points of one pixel for one purpose, e.g. its sub-pixel positions or its AO
+// directions. Every pixel gets a differently randomized copy of the same well stratified point set,
+// seeded by hashing the pixel and the purpose, so that neighbouring pixels do not share their error
+// pattern. Point i is the same whenever it is asked for, so progressive passes continue a sequence.
+class PixelSampler {
+public:
+    PixelSampler(SamplerType type, uint32_t seed) :
+        m_type(type),
+        m_seedX(hash32(seed)),
+        m_seedY(hash32(seed, 0x68bc21ebu)),
+        m_rng(seed)
+    {}
+
+    Vec2f get(uint32_t index) {
+        switch (m_type) {
+        case Sampler_Sobol:
+            return sobol2D(index, m_seedX, m_seedY);
+        case Sampler_Halton:
+            return Vec2f(rotate(radicalInverse2(index), m_seedX), rotate(radicalInverse3(index), m_seedY));
+        default:
+            return m_rng.getVec2f(index, 0);
+        }
+    }
+
+    // points [first, first + count), the random ones in one batch
+    void get(uint32_t first, int count, float* x, float* y) {
+        if (m_type == Sampler_Random) {
+            m_rng.fill(first, 0, x, y, count);
+            return;
+        }
+        for (int k = 0; k < count; ++k) {
+            Vec2f p = get(first + k);
+            x[k] = p.x;
+            y[k] = p.y;
+        }
+    }
+
+private:
+    // the rotation can round up to 1
+    static float belowOne(float x) {
+        return x < 0.99999994f ? x : 0.99999994f;
+    }
+
+    // Cranley-Patterson rotation by the seed
+    static float rotate(float x, uint32_t seed) {
+        x += toUnitFloat(seed);
+        return belowOne(x >= 1.0f ? x - 1.0f : x);
+    }
+
+    SamplerType m_type;
+    uint32_t    m_seedX;
+    uint32_t    m_seedY;
+    CounterRng  m_rng;
+};
+
+
+}
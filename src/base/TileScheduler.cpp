@@ -0,0 +1,108 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+
+
+namespace FW {
+
+
+namespace {
+
+// interleaves the bits of x and y, x in the even bits
+uint32_t mortonCode(uint32_t x, uint32_t y) {
+    uint32_t code = 0;
+    for (int bit = 0; bit < 16; ++bit) {
+        code |= ((x >> bit) & 1u) << (2 * bit);
+        code |= ((y >> bit) & 1u) << (2 * bit + 1);
+    }
+    return code;
+}
+
+inline uint64_t packRange(uint32_t front, uint32_t back) {
+    return (uint64_t)front | ((uint64_t)back << 32);
+}
+
+}
+
+
+TileScheduler::TileScheduler(const Vec2i& imageSize, int numThreads, int tileSize) :
+    m_numThreads(std::max(numThreads, 1)),
+    m_stolen(0)
+{
+    int tilesX = (imageSize.x + tileSize - 1) / tileSize;
+    int tilesY = (imageSize.y + tileSize - 1) / tileSize;
+
+    std::vector<std::pair<uint32_t, Tile>> ordered;
+    ordered.reserve(tilesX * tilesY);
+    for (int y = 0; y < tilesY; ++y) {
+        for (int x = 0; x < tilesX; ++x) {
+            Tile tile;
+            tile.min = Vec2i(x, y) * tileSize;
+            tile.max = FW::min(tile.min + tileSize, imageSize);
+            ordered.emplace_back(mortonCode(x, y), tile);
+        }
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const std::pair<uint32_t, Tile>& a, const std::pair<uint32_t, Tile>& b) {
+        return a.first < b.first;
+    });
+
+    m_tiles.reserve(ordered.size());
+    for (auto& entry : ordered)
+        m_tiles.push_back(entry.second);
+
+    m_queues.reset(new Queue[m_numThreads]);
+    for (int i = 0; i < m_numThreads; ++i) {
+        uint32_t front = (uint32_t)(m_tiles.size() * i / m_numThreads);
+        uint32_t back = (uint32_t)(m_tiles.size() * (i + 1) / m_numThreads);
+        m_queues[i].range.store(packRange(front, back), std::memory_order_relaxed);
+    }
+}
+
+bool TileScheduler::popFront(Queue& q, uint32_t& index) {
+    uint64_t range = q.range.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t front = (uint32_t)range, back = (uint32_t)(range >> 32);
+        if (front >= back)
+            return false;
+        if (q.range.compare_exchange_weak(range, packRange(front + 1, back), std::memory_order_acq_rel)) {
+            index = front;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::popBack(Queue& q, uint32_t& index) {
+    uint64_t range = q.range.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t front = (uint32_t)range, back = (uint32_t)(range >> 32);
+        if (front >= back)
+            return false;
+        if (q.range.compare_exchange_weak(range, packRange(front, back - 1), std::memory_order_acq_rel)) {
+            index = back - 1;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::next(int thread, Tile& tile) {
+    uint32_t index;
+    thread %= m_numThreads;
+    if (popFront(m_queues[thread], index)) {
+        tile = m_tiles[index];
+        return true;
+    }
+
+    // steal from the neighbours first, their tiles are the closest ones in the Morton order
+    for (int i = 1; i < m_numThreads; ++i) {
+        int victim = (thread + i) % m_numThreads;
+        if (popBack(m_queues[victim], index)) {
+            m_stolen.fetch_add(1, std::memory_order_relaxed);
+            tile = m_tiles[index];
+            return true;
+        }
+    }
+    return false;
+}
+
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+
+namespace FW {
+
+
+// Hands out the tiles of an image to render threads. The tiles are ordered along a Morton curve, so
+// that consecutive tiles are close in the image and in the scene, and the order is cut into one
+// contiguous queue per thread. A thread takes tiles from the front of its own queue and, once it
+// runs dry, steals single tiles from the back of the other queues. All queues are lock-free.
+class TileScheduler {
+public:
+    struct Tile {
+        Vec2i   min;        // first pixel
+        Vec2i   max;        // one past the last pixel
+    };
+
+                        TileScheduler   (const Vec2i& imageSize, int numThreads, int tileSize = 16);
+
+    // next tile for the given thread, false when the whole image has been handed out
+    bool                next            (int thread, Tile& tile);
+
+    int                 getNumTiles     (void) const { return (int)m_tiles.size(); }
+    int                 getNumStolen    (void) const { return m_stolen.load(std::memory_order_relaxed); }
+
+private:
+    // [front, back) of a thread's part of the tile order, packed so that both ends change atomically;
+    // padded to a cache line so that the threads do not share lines
+    struct Queue {
+        std::atomic<uint64_t>   range;
+        char                    pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    bool                popFront        (Queue& q, uint32_t& index);
+    bool                popBack         (Queue& q, uint32_t& index);
+
+    std::vector<Tile>           m_tiles;
+    std::unique_ptr<Queue[]>    m_queues;
+    int                         m_numThreads;
+    std::atomic<int>            m_stolen;
+};
+
+
+}
@@ -0,0 +1,92 @@
+#include "TraceEvents.hpp"
+#include "RenderPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+
+namespace FW {
+
+
+std::atomic<bool>                       TraceEvents::s_enabled(false);
+int64_t                                 TraceEvents::s_origin = 0;
+PerThread<TraceEvents::Buffer>          TraceEvents::s_buffers;
+
+
+void TraceEvents::enable(size_t eventsPerThread) {
+    s_buffers.reset(RenderPool::get().getNumThreads());
+    for (int i = 0; i < s_buffers.size(); ++i) {
+        s_buffers[i].events.resize(std::max(eventsPerThread, (size_t)1));
+        s_buffers[i].count = 0;
+    }
+    s_origin = now();
+    s_enabled = true;
+}
+
+void TraceEvents::disable(void) {
+    s_enabled = false;
+}
+
+int64_t TraceEvents::now(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceEvents::record(const char* name, const char* category, int64_t begin, int64_t end,
+                         const char* arg0Name, int64_t arg0, const char* arg1Name, int64_t arg1) {
+    // the pool may have been reconfigured with more threads since enable, their events are dropped
+    int thread = RenderPool::currentThread();
+    if (!isEnabled() || thread >= s_buffers.size())
+        return;
+
+    Buffer& buffer = s_buffers[thread];
+    Event& e = buffer.events[buffer.count++ % buffer.events.size()];
+    e.name = name;
+    e.category = category;
+    e.begin = begin;
+    e.end = end;
+    e.argNames[0] = arg0Name;
+    e.args[0] = arg0;
+    e.argNames[1] = arg1Name;
+    e.args[1] = arg1;
+}
+
+bool TraceEvents::write(const std::string& fileName) {
+    std::ofstream out(fileName);
+    if (!out)
+        return false;
+
+    // complete events ("ph":"X") in microseconds since enable, one track per pool thread
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"raytracer\"}}";
+    size_t dropped = 0;
+    for (int thread = 0; thread < s_buffers.size(); ++thread) {
+        const Buffer& buffer = s_buffers[thread];
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":\""
+            << (thread ? "worker " + std::to_string(thread) : std::string("main")) << "\"}}";
+
+        uint64_t size = buffer.events.size();
+        uint64_t first = buffer.count > size ? buffer.count - size : 0;
+        dropped += (size_t)first;
+        for (uint64_t i = first; i < buffer.count; ++i) {
+            const Event& e = buffer.events[i % size];
+            out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+                << ",\"ts\":" << (e.begin - s_origin) / 1000.0 << ",\"dur\":" << (e.end - e.begin) / 1000.0;
+            if (e.argNames[0] || e.argNames[1]) {
+                out << ",\"args\":{";
+                for (int a = 0; a < 2; ++a)
+                    if (e.argNames[a])
+                        out << (a && e.argNames[0] ? "," : "") << "\"" << e.argNames[a] << "\":" << e.args[a];
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n],\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+    return (bool)out;
+}
+
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+
+#include "PerThread.hpp"
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+
+namespace FW {
+
+
+// Timeline of what the main thread and the RenderPool workers spent their time on: loader phases,
+// builder tasks, hierarchy I/O and render tiles. Written as Chrome trace JSON, which chrome://tracing
+// and ui.perfetto.dev open, to tell load imbalance, serial sections and long tails apart.
+// Every pool thread appends to its own ring buffer, so recording takes no lock; once a buffer is full
+// the oldest events are overwritten. While recording is off, a TraceSpan only tests a flag.
+class TraceEvents {
+public:
+    // starts a new recording with room for eventsPerThread events in each pool thread's buffer,
+    // must not be called while a parallel loop is running
+    static void         enable              (size_t eventsPerThread = 1 << 16);
+    static void         disable             (void);
+    static bool         isEnabled           (void) { return s_enabled.load(std::memory_order_relaxed); }
+
+    // nanoseconds on the clock the events are stamped with
+    static int64_t      now                 (void);
+
+    // name, category and argument names must be string literals, only the pointers are kept;
+    // an argument with a null name is left out
+    static void         record              (const char* name, const char* category, int64_t begin, int64_t end,
+                                             const char* arg0Name = nullptr, int64_t arg0 = 0,
+                                             const char* arg1Name = nullptr, int64_t arg1 = 0);
+
+    // writes the events recorded since enable, false if the file cannot be written
+    static bool         write               (const std::string& fileName);
+
+private:
+    struct Event {
+        const char*     name;
+        const char*     category;
+        int64_t         begin, end;         // ns
+        const char*     argNames[2];
+        int64_t         args[2];
+    };
+
+    // one per pool thread, on cache lines of its own
+    struct Buffer {
+        std::vector<Event>  events;
+        uint64_t            count;          // events ever recorded, the ring position is count % size
+    };
+
+    static std::atomic<bool>            s_enabled;
+    static int64_t                      s_origin;
+    static PerThread<Buffer>            s_buffers;
+};
+
+// Records the lifetime of the object, or the time until end(), as one event of the calling thread.
+class TraceSpan {
+public:
+    explicit            TraceSpan           (const char* name, const char* category,
+                                             const char* arg0Name = nullptr, int64_t arg0 = 0,
+                                             const char* arg1Name = nullptr, int64_t arg1 = 0) :
+        m_name(name), m_category(category), m_begin(TraceEvents::isEnabled() ? TraceEvents::now() : -1)
+    {
+        m_argNames[0] = arg0Name; m_args[0] = arg0;
+        m_argNames[1] = arg1Name; m_args[1] = arg1;
+    }
+                        ~TraceSpan          (void)  { end(); }
+
+    void                end                 (void)
+    {
+        if (m_begin >= 0)
+            TraceEvents::record(m_name, m_category, m_begin, TraceEvents::now(), m_argNames[0], m_args[0], m_argNames[1], m_args[1]);
+        m_begin = -1;
+    }
+                        TraceSpan           (const TraceSpan&) = delete;
+    TraceSpan&          operator=           (const TraceSpan&) = delete;
+
+private:
+    const char*     m_name;
+    const char*     m_category;
+    int64_t         m_begin;                // -1 when recording was off
+    const char*     m_argNames[2];
+    int64_t         m_args[2];
+};
+
+
+}
@@ -0,0 +1,263 @@
+#include "Validation.hpp"
+#include "RayTracer.hpp"
+#include "RenderPool.hpp"
+#include "CounterRng.hpp"
+
+#include "3d/CameraControls.hpp"
+#include "gui/Image.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+
+namespace FW {
+
+
+namespace {
+
+// rays per parallelFor item, the brute force trace of one ray takes long enough that the scheduling is lost in it
+const int   ChunkSize   = 64;
+
+// a channel differs if it is off by more than the rounding of the 8-bit export
+const float PixelTolerance = 1.0f / 255.0f;
+
+void printRow(const char* type, const HitComparison& c) {
+    ::printf("  %-10s%10zu%10zu%10zu%10zu%10zu%14.3g%14.3g\n", type, c.rays, c.lost, c.spurious, c.wrong, c.ties,
+        c.maxTError, c.meanTError());
+}
+
+}
+
+
+const float HitComparison::TieDistance = 1.0e-5f;
+
+void HitComparison::add(S32 referenceTriangle, F32 referenceT, S32 triangle, F32 t) {
+    ++rays;
+    if (triangle == referenceTriangle) {
+        if (triangle >= 0) {
+            double error = std::abs((double)t - referenceT);
+            maxTError = std::max(maxTError, error);
+            sumTError += error;
+            ++same;
+        }
+    }
+    else if (triangle < 0)
+        ++lost;
+    else if (referenceTriangle < 0)
+        ++spurious;
+    else if (std::abs(t - referenceT) <= TieDistance * std::max(1.0f, std::abs(referenceT)))
+        ++ties;
+    else
+        ++wrong;
+}
+
+void HitComparison::merge(const HitComparison& other) {
+    rays += other.rays;
+    lost += other.lost;
+    spurious += other.spurious;
+    wrong += other.wrong;
+    ties += other.ties;
+    same += other.same;
+    maxTError = std::max(maxTError, other.maxTError);
+    sumTError += other.sumTError;
+}
+
+RaycastResult bruteForceRaycast(const std::vector<RTTriangle>& triangles, const Vec3f& orig, const Vec3f& dir) {
+    float closest_t = 1.0f, closest_u = 0.0f, closest_v = 0.0f;
+    int closest_i = -1;
+    for (int i = 0; i < (int)triangles.size(); ++i) {
+        float t, u, v;
+        if (triangles[i].intersect_woop(orig, dir, t, u, v) && t > 0.0f && t < closest_t) {
+            closest_i = i;
+            closest_t = t;
+            closest_u = u;
+            closest_v = v;
+        }
+    }
+
+    if (closest_i == -1)
+        return RaycastResult();
+    return RaycastResult(&triangles[closest_i], closest_t, closest_u, closest_v, orig + closest_t * dir, orig, dir);
+}
+
+void ReferenceRays::generate(const std::vector<RTTriangle>& triangles, const CameraControls& camera, const Vec2i& size,
+    float aoLength, int count, U32 seed) {
+    Mat4f projection = Mat4f::fitToView(Vec2f(-1, -1), Vec2f(2, 2), size) * camera.getCameraToClip();
+    Mat4f invP = (projection * camera.getWorldToCamera()).inverted();
+    CounterRng rng(seed);
+
+    // primary rays as Renderer::tracePixel makes them, through a random point of a random pixel
+    numPrimary = (size_t)std::max(count, 0);
+    orig.resize(numPrimary);
+    dir.resize(numPrimary);
+    for (size_t r = 0; r < numPrimary; ++r) {
+        Vec2f pixel = rng.getVec2f((U32)r, 0), offset = rng.getVec2f((U32)r, 1);
+        float x = (std::floor(pixel.x * size.x) + offset.x) / size.x * 2.0f - 1.0f;
+        float y = (std::floor(pixel.y * size.y) + offset.y) / size.y * -2.0f + 1.0f;
+        Vec4f Roh = invP * Vec4f(x, y, 0.0f, 1.0f);
+        Vec4f Rdh = invP * Vec4f(x, y, 1.0f, 1.0f);
+        Vec3f Ro = (Roh * (1.0f / Roh.w)).getXYZ();
+        orig[r] = Ro;
+        dir[r] = (Rdh * (1.0f / Rdh.w)).getXYZ() - Ro;
+    }
+
+    std::vector<RaycastResult> hits(numPrimary);
+    int chunks = (int)((numPrimary + ChunkSize - 1) / ChunkSize);
+    RenderPool::get().parallelFor(chunks, [&](int chunk, int) {
+        size_t last = std::min((chunk + 1) * (size_t)ChunkSize, numPrimary);
+        for (size_t r = chunk * (size_t)ChunkSize; r < last; ++r)
+            hits[r] = bruteForceRaycast(triangles, orig[r], dir[r]);
+    });
+
+    // an AO ray from every hit, offset towards the camera and around the normal facing it as in
+    // Renderer::computeShadingAmbientOcclusion
+    for (size_t r = 0; r < numPrimary; ++r) {
+        const RaycastResult& hit = hits[r];
+        if (!hit.tri)
+            continue;
+        Vec3f hit2Cam = (camera.getPosition() - hit.point).normalized();
+        Vec3f n = hit.normal();
+        if (dot(hit2Cam, n) < 0.0f)
+            n = -n;
+        orig.push_back(hit.point + hit2Cam * 0.001f);
+        dir.push_back(formBasis(n) * cosineHemisphere(rng.getVec2f((U32)r, 2)) * aoLength);
+    }
+
+    triangle.resize(orig.size());
+    t.resize(orig.size());
+    for (size_t r = 0; r < numPrimary; ++r) {
+        triangle[r] = hits[r].tri ? (S32)(hits[r].tri - triangles.data()) : -1;
+        t[r] = hits[r].t;
+    }
+    chunks = (int)((orig.size() - numPrimary + ChunkSize - 1) / ChunkSize);
+    RenderPool::get().parallelFor(chunks, [&](int chunk, int) {
+        size_t last = std::min(numPrimary + (chunk + 1) * (size_t)ChunkSize, orig.size());
+        for (size_t r = numPrimary + chunk * (size_t)ChunkSize; r < last; ++r) {
+            RaycastResult hit = bruteForceRaycast(triangles, orig[r], dir[r]);
+            triangle[r] = hit.tri ? (S32)(hit.tri - triangles.data()) : -1;
+            t[r] = hit.t;
+        }
+    });
+}
+
+void compareWithReference(const ReferenceRays& reference, const std::vector<RTTriangle>& triangles, const TraceFunction& trace,
+    HitComparison& primary, HitComparison& ao) {
+    compareWithReference(reference, triangles, [&](const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count) {
+        for (int r = 0; r < count; ++r)
+            results[r] = trace(orig[r], dir[r]);
+    }, primary, ao);
+}
+
+void compareWithReference(const ReferenceRays& reference, const std::vector<RTTriangle>& triangles, const BatchTraceFunction& trace,
+    HitComparison& primary, HitComparison& ao) {
+    size_t numRays = reference.orig.size();
+    std::vector<S32> hitTriangles(numRays);
+    std::vector<F32> hitT(numRays);
+    int chunks = (int)((numRays + ChunkSize - 1) / ChunkSize);
+    RenderPool::get().parallelFor(chunks, [&](int chunk, int) {
+        size_t first = chunk * (size_t)ChunkSize;
+        int count = (int)(std::min(first + ChunkSize, numRays) - first);
+        RaycastResult hits[ChunkSize];
+        trace(&reference.orig[first], &reference.dir[first], hits, count);
+        for (int r = 0; r < count; ++r) {
+            hitTriangles[first + r] = hits[r].tri ? (S32)(hits[r].tri - triangles.data()) : -1;
+            hitT[first + r] = hits[r].t;
+        }
+    });
+    for (size_t r = 0; r < numRays; ++r)
+        (r < reference.numPrimary ? primary : ao).add(reference.triangle[r], reference.t[r], hitTriangles[r], hitT[r]);
+}
+
+void printHitComparison(const char* what, const HitComparison& primary, const HitComparison& ao, const HitComparison* packet) {
+    HitComparison all = primary;
+    all.merge(ao);
+    bool agrees = all.agrees() && (!packet || packet->agrees());
+    ::printf("%s: %s\n  %-10s%10s%10s%10s%10s%10s%14s%14s\n", what, agrees ? "agrees" : "HITS DIFFER",
+        "type", "rays", "lost", "spurious", "wrong", "ties", "max t error", "mean t error");
+    printRow("primary", primary);
+    printRow("ao", ao);
+    printRow("all", all);
+    if (packet)
+        printRow("packet", *packet);
+}
+
+bool validateTraversal(const RayTracer& rt, const std::vector<RTTriangle>& triangles, const CameraControls& camera,
+    const Vec2i& size, float aoLength, int numPrimary, ReferenceRays* reference) {
+    ReferenceRays rays;
+    ReferenceRays& r = reference ? *reference : rays;
+    r.generate(triangles, camera, size, aoLength, numPrimary, 1);
+
+    HitComparison primary, ao;
+    compareWithReference(r, triangles, [&](const Vec3f& orig, const Vec3f& dir) { return rt.raycast(orig, dir); }, primary, ao);
+
+    // all the rays again through the packet traversal the renderer uses for primary rays, ChunkSize at a time
+    HitComparison packetPrimary, packet;
+    compareWithReference(r, triangles, [&](const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count) {
+        rt.raycastBatch(orig, dir, results, count);
+    }, packetPrimary, packet);
+    packet.merge(packetPrimary);
+
+    printHitComparison("Traversal against brute force", primary, ao, &packet);
+    return primary.agrees() && ao.agrees() && packet.agrees();
+}
+
+bool compareImages(const Image& image, const Image& reference, ImageDiff& diff, Image* diffImage) {
+    diff = ImageDiff();
+    if (image.getSize() != reference.getSize())
+        return false;
+
+    double sumSquares = 0.0;
+    for (int y = 0; y < image.getSize().y; ++y)
+        for (int x = 0; x < image.getSize().x; ++x) {
+            Vec4f a = image.getVec4f(Vec2i(x, y)), b = reference.getVec4f(Vec2i(x, y));
+            Vec3f error;
+            for (int c = 0; c < 3; ++c) {
+                error[c] = std::abs(FW::clamp(a[c], 0.0f, 1.0f) - b[c]);
+                sumSquares += (double)error[c] * error[c];
+            }
+            diff.maxError = std::max(diff.maxError, (double)error.max());
+            if (error.max() > PixelTolerance)
+                ++diff.differing;
+            if (diffImage)
+                diffImage->setVec4f(Vec2i(x, y), Vec4f(FW::min(error * 8.0f, Vec3f(1.0f)), 1.0f));
+        }
+
+    diff.pixels = (size_t)image.getSize().x * image.getSize().y;
+    double mse = sumSquares / (3.0 * diff.pixels);
+    diff.rmse = std::sqrt(mse);
+    diff.psnr = mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : std::numeric_limits<double>::infinity();
+    return true;
+}
+
+bool diffBatchImage(const Image& image, const std::string& folder, const std::string& stateName, float minPsnr, bool writeDiff) {
+    std::string fileName = folder + "/" + stateName + ".png";
+    String oldError = clearError();
+    std::unique_ptr<Image> reference(importImage(fileName.c_str()));
+    String newError = getError();
+    if (restoreError(oldError) || !reference) {
+        ::printf("Image diff: cannot read the reference '%s': %s\n", fileName.c_str(), newError.getPtr());
+        return false;
+    }
+
+    ImageDiff diff;
+    Image diffImage(image.getSize(), ImageFormat::RGBA_Vec4f);
+    if (!compareImages(image, *reference, diff, &diffImage)) {
+        ::printf("Image diff: the reference '%s' is %dx%d, the render %dx%d\n", fileName.c_str(),
+            reference->getSize().x, reference->getSize().y, image.getSize().x, image.getSize().y);
+        return false;
+    }
+
+    bool passed = diff.psnr >= minPsnr;
+    ::printf("Image diff against %s: PSNR %.2f dB (at least %.2f), RMSE %.5f, max error %.4f, %zu of %zu pixels (%.3f%%) differ: %s\n",
+        fileName.c_str(), diff.psnr, minPsnr, diff.rmse, diff.maxError, diff.differing, diff.pixels,
+        100.0 * diff.differing / diff.pixels, passed ? "passed" : "FAILED");
+    if (writeDiff)
+        exportImage(("images/" + stateName + "_diff.png").c_str(), &diffImage);
+    return passed;
+}
+
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+
+#include "RTTriangle.hpp"
+#include "RaycastResult.hpp"
+
+#include "base/Math.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace FW {
+
+
+class CameraControls;
+class Image;
+class RayTracer;
+
+
+// How the closest hits of a traversal differ from those of a reference for the same rays. A ray that hits
+// another triangle is lost (the reference hit, the traversal missed), spurious (the other way round), a tie
+// (another triangle at the same distance, e.g. on a shared edge, which either may report) or wrong.
+struct HitComparison {
+    static const float  TieDistance;            // along the ray, relative to max(1, t)
+
+    size_t              rays        = 0;
+    size_t              lost        = 0;
+    size_t              spurious    = 0;
+    size_t              wrong       = 0;
+    size_t              ties        = 0;
+    size_t              same        = 0;        // rays that hit the same triangle
+    double              maxTError   = 0.0;      // |t - reference t| of those
+    double              sumTError   = 0.0;
+
+    // triangles are indices, -1 for a miss
+    void                add                 (S32 referenceTriangle, F32 referenceT, S32 triangle, F32 t);
+    void                merge               (const HitComparison& other);
+
+    bool                agrees              (void) const { return !lost && !spurious && !wrong; }
+    double              meanTError          (void) const { return same ? sumTError / same : 0.0; }
+};
+
+// The closest hit in (0, 1) along [orig, orig + dir] of all the triangles, the test RayTracer does in
+// its leaves without the hierarchy. Slow, but too simple to be wrong.
+RaycastResult bruteForceRaycast(const std::vector<RTTriangle>& triangles, const Vec3f& orig, const Vec3f& dir);
+
+// Random rays of a render of the camera's view and their brute force hits. The primary rays go through
+// random points of random pixels; from each of their hits one AO ray of aoLength leaves into the cosine
+// hemisphere, as Renderer casts them. The same seed gives the same rays.
+struct ReferenceRays {
+    std::vector<Vec3f>  orig, dir;
+    std::vector<S32>    triangle;               // index of the hit triangle, -1 for a miss
+    std::vector<F32>    t;
+    size_t              numPrimary  = 0;        // the primary rays come first, then the AO rays
+
+    void                generate            (const std::vector<RTTriangle>& triangles, const CameraControls& camera,
+                                             const Vec2i& size, float aoLength, int count, U32 seed);
+};
+
+typedef std::function<RaycastResult(const Vec3f& orig, const Vec3f& dir)> TraceFunction;
+typedef std::function<void(const Vec3f* orig, const Vec3f* dir, RaycastResult* results, int count)> BatchTraceFunction;
+
+// traces the reference's rays with trace on the pool threads and compares the hits, whose triangles are
+// indices into triangles, with the reference's; the batch version gets the rays in chunks of 64
+void compareWithReference(const ReferenceRays& reference, const std::vector<RTTriangle>& triangles, const TraceFunction& trace,
+    HitComparison& primary, HitComparison& ao);
+void compareWithReference(const ReferenceRays& reference, const std::vector<RTTriangle>& triangles, const BatchTraceFunction& trace,
+    HitComparison& primary, HitComparison& ao);
+
+// a table of the primary, AO and all rays under "what: agrees" or "what: HITS DIFFER", with a row for
+// all the rays through the packet traversal if packet is given
+void printHitComparison(const char* what, const HitComparison& primary, const HitComparison& ao, const HitComparison* packet = nullptr);
+
+// -validate: compares numPrimary random primary rays of the camera and the AO rays from their hits
+// between the tracer, both single rays and packets, and brute force, prints the result and returns whether they agree; the rays and
+// their brute force hits are left in reference for further checks if it is given
+bool validateTraversal(const RayTracer& rt, const std::vector<RTTriangle>& triangles, const CameraControls& camera,
+    const Vec2i& size, float aoLength, int numPrimary, ReferenceRays* reference = nullptr);
+
+// The difference of the RGB of a render from a reference image, with the render clamped to [0, 1]
+// as the PNG export does. A pixel differs if any channel is off by more than the 8-bit rounding.
+struct ImageDiff {
+    double              rmse        = 0.0;
+    double              psnr        = 0.0;      // dB, infinite for identical images
+    double              maxError    = 0.0;
+    size_t              differing   = 0;
+    size_t              pixels      = 0;
+};
+
+// false if the sizes differ; the difference times 8 goes to diffImage if it is given
+bool compareImages(const Image& image, const Image& reference, ImageDiff& diff, Image* diffImage = nullptr);
+
+// -image_diff: compares the render with folder/<stateName>.png, prints the difference and returns
+// whether the PSNR is at least minPsnr; the difference is written to images/<stateName>_diff.png
+// if writeDiff is set
+bool diffBatchImage(const Image& image, const std::string& folder, const std::string& stateName, float minPsnr, bool writeDiff);
+
+
+}
@@ -26,6 +26,11 @@ public:
         os.write(reinterpret_cast<const char*>(&x), sizeof(x));
         return *this;
     }
+    template <class T>
+    Saver& array(const T* x, size_t count) {
+        os.write(reinterpret_cast<const char*>(x), sizeof(T) * count);
+        return *this;
+    }
     void statusbar(size_t counter) { sbar.update(counter); }
 private:
     std::ostream& os;
@@ -40,6 +45,11 @@ public:
         is.read(reinterpret_cast<char*>(&x), sizeof(x));
         return *this;
     }
+    template <class T>
+    Loader& array(T* x, size_t count) {
+        is.read(reinterpret_cast<char*>(x), sizeof(T) * count);
+        return *this;
+    }
     void statusbar(size_t counter) { sbar.update(counter); }
 private:
     std::istream& is;
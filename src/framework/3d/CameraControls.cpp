@@ -53,8 +53,12 @@ CameraControls::CameraControls(CommonControls* commonControls, U32 features)
     m_alignZ            (false)
 {
     initDefaults();
+#if (FW_HEADLESS)
+    m_features &= ~Feature_StereoControls;
+#else
     if ((m_features & Feature_StereoControls) != 0 && !GLContext::isStereoAvailable())
         m_features &= ~Feature_StereoControls;
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -65,6 +69,8 @@ CameraControls::~CameraControls(void)
 
 //------------------------------------------------------------------------
 
+#if (!FW_HEADLESS)
+
 bool CameraControls::handleEvent(const Window::Event& ev)
 {
     if (!m_commonControls)
@@ -205,6 +211,8 @@ bool CameraControls::handleEvent(const Window::Event& ev)
     return false;
 }
 
+#endif
+
 //------------------------------------------------------------------------
 
 void CameraControls::readState(StateDump& d)
@@ -395,6 +403,8 @@ void CameraControls::decodeSignature(const String& sig)
 
 //------------------------------------------------------------------------
 
+#if (!FW_HEADLESS)
+
 void CameraControls::addGUIControls(void)
 {
     CommonControls& cc = *m_commonControls;
@@ -442,6 +452,8 @@ void CameraControls::removeGUIControls(void)
     cc.removeControl(&m_stereoConvergence);
 }
 
+#endif
+
 //------------------------------------------------------------------------
 
 void CameraControls::encodeBits(String& dst, U32 v)
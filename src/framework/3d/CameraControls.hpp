@@ -26,8 +26,12 @@
  */
 
 #pragma once
-#include "gui/CommonControls.hpp"
 #include "base/Timer.hpp"
+#if (!FW_HEADLESS)
+#   include "gui/CommonControls.hpp"
+#else
+#   include "io/StateDump.hpp"
+#endif
 
 namespace FW
 {
@@ -35,9 +39,18 @@ namespace FW
 
 class MeshBase;
 
+#if (FW_HEADLESS)
+class CommonControls;
+class Window;
+#endif
+
 //------------------------------------------------------------------------
 
+#if (FW_HEADLESS)
+class CameraControls // no window to listen to and no GUI controls, only the camera and its state
+#else
 class CameraControls : public Window::Listener, public CommonControls::StateObject
+#endif
 {
 public:
 
@@ -65,7 +78,9 @@ public:
                         CameraControls      (CommonControls* commonControls = NULL, U32 features = Feature_Default);
     virtual             ~CameraControls     (void);
 
+#if (!FW_HEADLESS)
     virtual bool        handleEvent         (const Window::Event& ev); // must be before the listener that queries things
+#endif
     virtual void        readState           (StateDump& d);
     virtual void        writeState          (StateDump& d) const;
 
@@ -103,13 +118,19 @@ public:
     String              encodeSignature     (void) const;
     void                decodeSignature     (const String& sig);
 
+#if (!FW_HEADLESS)
     void                addGUIControls      (void);             // done automatically on Window.addListener(this)
     void                removeGUIControls   (void);
+#endif
     void                setEnableMovement   (bool enable)       { m_enableMovement = enable; }
 
 private:
     bool                hasFeature          (Feature feature)   { return ((m_features & feature) != 0); }
+#if (FW_HEADLESS)
+    void                repaint             (void)              {}
+#else
     void                repaint             (void)              { if (m_window) m_window->repaint(); }
+#endif
 
     static void         encodeBits          (String& dst, U32 v);
     static U32          decodeBits          (const char*& src);
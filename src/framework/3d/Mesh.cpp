@@ -339,6 +339,8 @@ Buffer& MeshBase::getVBO(void)
 
 //------------------------------------------------------------------------
 
+#if (!FW_HEADLESS)
+
 void MeshBase::setGLAttrib(GLContext* gl, int attrib, int loc)
 {
     const AttribSpec& spec = attribSpec(attrib);
@@ -548,6 +550,8 @@ void MeshBase::draw(GLContext* gl, const Mat4f& posToCamera, const Mat4f& projec
     gl->resetAttribs();
 }
 
+#endif
+
 //------------------------------------------------------------------------
 
 void MeshBase::freeMemory(void)
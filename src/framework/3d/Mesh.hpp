@@ -27,7 +27,9 @@
 
 #pragma once
 #include "3d/Texture.hpp"
-#include "gpu/GLContext.hpp"
+#if (!FW_HEADLESS)
+#   include "gpu/GLContext.hpp"
+#endif
 
 namespace FW
 {
@@ -163,8 +165,10 @@ public:
     int                 vboIndexOffset      (int submesh)                   { getVBO(); return m_submeshes[submesh].ofsInVBO; }
     int                 vboIndexSize        (int submesh)                   { getVBO(); return m_submeshes[submesh].sizeInVBO; }
 
+#if (!FW_HEADLESS)
     void                setGLAttrib         (GLContext* gl, int attrib, int loc);
     void                draw                (GLContext* gl, const Mat4f& posToCamera, const Mat4f& projection, GLContext::Program* prog = NULL, bool gouraud = false);
+#endif
 
     bool                isInMemory          (void) const                    { return m_isInMemory; }
     void                freeMemory          (void);
@@ -26,7 +26,9 @@
  */
 
 #include "3d/Texture.hpp"
-#include "gpu/CudaModule.hpp"
+#if (!FW_HEADLESS)
+#   include "gpu/CudaModule.hpp"
+#endif
 
 using namespace FW;
 
@@ -231,11 +233,13 @@ void Texture::unreferData(Data* data)
 
     // Delete data.
 
+#if (!FW_HEADLESS) // headless builds never create the GL and CUDA copies
     if (data->glTexture != 0)
         glDeleteTextures(1, &data->glTexture);
 
     if (data->cudaArray)
         CudaModule::checkError("cuArrayDestroy", cuArrayDestroy(data->cudaArray));
+#endif
 
     delete data->image;
     delete data->nextMip;
@@ -42,7 +42,7 @@
 #   pragma warning(pop)
 #endif
 
-#if (!FW_CUDA)
+#if (!FW_CUDA && !FW_HEADLESS)
 #   define _WIN32_WINNT 0x0600
 #   define WIN32_LEAN_AND_MEAN
 #   define _KERNEL32_
@@ -128,7 +128,37 @@ typedef size_t          CUsize_t;
 // GL definitions.
 //------------------------------------------------------------------------
 
-#if (!FW_CUDA && FW_USE_GLEW)
+#if (FW_HEADLESS)
+#   define GL_FUNC_AVAILABLE(NAME) false
+
+// No GL in headless builds, only the types and the pixel formats that images describe themselves with.
+typedef unsigned int    GLenum;
+typedef unsigned int    GLuint;
+typedef int             GLint;
+typedef int             GLsizei;
+typedef unsigned char   GLboolean;
+typedef float           GLfloat;
+typedef unsigned int    GLbitfield;
+typedef char            GLchar;
+
+#define GL_NONE                             0
+#define GL_UNSIGNED_BYTE                    0x1401
+#define GL_FLOAT                            0x1406
+#define GL_ALPHA                            0x1906
+#define GL_RGB                              0x1907
+#define GL_RGBA                             0x1908
+#define GL_ALPHA8                           0x803C
+#define GL_RGB5                             0x8050
+#define GL_RGB8                             0x8051
+#define GL_RGB5_A1                          0x8057
+#define GL_RGBA8                            0x8058
+#define GL_UNSIGNED_SHORT_5_5_5_1           0x8034
+#define GL_UNSIGNED_SHORT_5_6_5             0x8363
+#define GL_RGBA32F                          0x8814
+#define GL_RGB32F                           0x8815
+#define GL_ALPHA32F_ARB                     0x8816
+
+#elif (!FW_CUDA && FW_USE_GLEW)
 #   define GL_FUNC_AVAILABLE(NAME) (NAME != NULL)
 #   define GLEW_STATIC
 #   include "3rdparty/glew/include/GL/glew.h"
@@ -369,7 +399,7 @@ typedef unsigned int    GLhandleARB;
 
 //------------------------------------------------------------------------
 
-#if (!FW_CUDA)
+#if (!FW_CUDA && !FW_HEADLESS)
 #   define FW_DLL_IMPORT_RETV(RET, CALL, NAME, PARAMS, PASS)        bool isAvailable_ ## NAME(void);
 #   define FW_DLL_IMPORT_VOID(RET, CALL, NAME, PARAMS, PASS)        bool isAvailable_ ## NAME(void);
 #   define FW_DLL_DECLARE_RETV(RET, CALL, NAME, PARAMS, PASS)       bool isAvailable_ ## NAME(void); RET CALL NAME PARAMS;
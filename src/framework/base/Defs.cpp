@@ -29,28 +29,51 @@
 #include "base/String.hpp"
 #include "base/Thread.hpp"
 #include "base/Timer.hpp"
+#if !FW_HEADLESS
 #include "gui/Window.hpp"
+#endif
 #include "io/File.hpp"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <malloc.h>
 
+#if FW_HEADLESS
+#define _msize malloc_usable_size
+#endif
+
 using namespace FW;
 
 //------------------------------------------------------------------------
 
+#ifndef FW_MEM_DEBUG
 #define FW_MEM_DEBUG    0
+#endif
 
 //------------------------------------------------------------------------
 
-struct AllocHeader
+// Padded to 16 bytes, the alignment that malloc and operator new guarantee,
+// so that the block after the header keeps it.
+struct alignas(16) AllocHeader
 {
     AllocHeader*    prev;
     AllocHeader*    next;
     size_t          size;
     const char*     ownerID;
+    S32             ownerSlot;
+};
+
+static_assert(sizeof(AllocHeader) % 16 == 0, "AllocHeader must keep the alignment of the allocations after it");
+
+//------------------------------------------------------------------------
+
+struct MemOwner
+{
+    const char*     id;
+    size_t          used;
+    size_t          peak;
 };
 
 //------------------------------------------------------------------------
@@ -59,8 +82,11 @@ struct ProfileTimer
 {
     String          id;
     Timer           timer;
+    F32             added;      // seconds from profileAdd()
     S32             parent;
     Array<S32>      children;
+
+    F32             getTotal    (void) const { return timer.getTotal() + added; }
 };
 
 //------------------------------------------------------------------------
@@ -87,6 +113,7 @@ bool SafeSpinlock::s_inited = false;
 
 static SafeSpinlock                     s_lock;
 static size_t                           s_memoryUsed        = 0;
+static size_t                           s_memoryPeak        = 0;
 static bool                             s_hasFailed         = false;
 static int                              s_nestingLevel      = 0;
 static bool                             s_discardEvents     = false;
@@ -97,8 +124,13 @@ static Array<BufferedOutputStream*>     s_logStreams;
 
 #if FW_MEM_DEBUG
 static bool                             s_memPushingOwner   = false;
-static AllocHeader                      s_memAllocs         = { &s_memAllocs, &s_memAllocs, 0, NULL };
+static AllocHeader                      s_memAllocs         = { &s_memAllocs, &s_memAllocs, 0, NULL, 0 };
 static Hash<U32, Array<const char*> >   s_memOwnerStacks;
+
+// a fixed table, since it is updated inside malloc(); the last slot takes the owners that do not fit
+static const S32                        s_maxMemOwners      = 64;
+static MemOwner                         s_memOwners[s_maxMemOwners];
+static S32                              s_numMemOwners      = 0;
 #endif
 
 static bool                             s_profileStarted    = false;
@@ -117,6 +149,28 @@ static void deinitString(void* str)
 
 //------------------------------------------------------------------------
 
+#if FW_MEM_DEBUG
+// the table slot of an owner, added if new; ids are compared by contents since the same
+// string literal may have different addresses in different translation units
+static S32 memOwnerSlot(const char* id)
+{
+    for (S32 i = 0; i < s_numMemOwners; i++)
+        if (s_memOwners[i].id == id || strcmp(s_memOwners[i].id, id) == 0)
+            return i;
+
+    if (s_numMemOwners == s_maxMemOwners)
+        return s_maxMemOwners - 1;
+
+    MemOwner& owner = s_memOwners[s_numMemOwners];
+    owner.id = (s_numMemOwners == s_maxMemOwners - 1) ? "Other" : id;
+    owner.used = 0;
+    owner.peak = 0;
+    return s_numMemOwners++;
+}
+#endif
+
+//------------------------------------------------------------------------
+
 void* FW::malloc(size_t size)
 {
     FW_ASSERT(size >= 0);
@@ -144,6 +198,11 @@ void* FW::malloc(size_t size)
                alloc->ownerID = s_memOwnerStacks[threadID].getLast();
     }
 
+    MemOwner& owner     = s_memOwners[alloc->ownerSlot = memOwnerSlot(alloc->ownerID)];
+    owner.used          += size;
+    owner.peak          = max(owner.peak, owner.used);
+    s_memoryPeak        = max(s_memoryPeak, s_memoryUsed);
+
     s_lock.leave();
 
 #else
@@ -153,6 +212,7 @@ void* FW::malloc(size_t size)
 
     s_lock.enter();
     s_memoryUsed += _msize(ptr);
+    s_memoryPeak = max(s_memoryPeak, s_memoryUsed);
     s_lock.leave();
 #endif
 
@@ -173,6 +233,7 @@ void FW::free(void* ptr)
     alloc->prev->next = alloc->next;
     alloc->next->prev = alloc->prev;
     s_memoryUsed -= alloc->size;
+    s_memOwners[alloc->ownerSlot].used -= alloc->size;
     ::free(alloc);
 
     s_lock.leave();
@@ -214,6 +275,7 @@ void* FW::realloc(void* ptr, size_t size)
 
     s_lock.enter();
     s_memoryUsed += _msize(newPtr) - oldSize;
+    s_memoryPeak = max(s_memoryPeak, s_memoryUsed);
     s_lock.leave();
 #endif
 
@@ -326,6 +388,11 @@ void FW::fail(const char* fmt, ...)
     Thread::suspendAll();
     setDiscardEvents(true);
 
+#if FW_HEADLESS
+    // No one to show a dialog to.
+
+    exit(1);
+#else
     // Display modal dialog.
 
     MessageBox(NULL, tmp.getPtr(), "Fatal error", MB_OK);
@@ -338,10 +405,12 @@ void FW::fail(const char* fmt, ...)
     // Kill the app.
 
     FatalExit(1);
+#endif
 }
 
 //------------------------------------------------------------------------
 
+#if !FW_HEADLESS
 void FW::failWin32Error(const char* funcName)
 {
     DWORD err = GetLastError();
@@ -355,6 +424,7 @@ void FW::failWin32Error(const char* funcName)
     else
         fail("%s() failed!\nError %d\n", funcName, err);
 }
+#endif
 
 //------------------------------------------------------------------------
 
@@ -436,6 +506,76 @@ size_t FW::getMemoryUsed(void)
 
 //------------------------------------------------------------------------
 
+size_t FW::getMemoryPeak(void)
+{
+    return s_memoryPeak;
+}
+
+//------------------------------------------------------------------------
+
+void FW::resetMemoryPeak(void)
+{
+    s_lock.enter();
+    s_memoryPeak = s_memoryUsed;
+#if FW_MEM_DEBUG
+    for (S32 i = 0; i < s_numMemOwners; i++)
+        s_memOwners[i].peak = s_memOwners[i].used;
+#endif
+    s_lock.leave();
+}
+
+//------------------------------------------------------------------------
+
+S32 FW::getNumMemOwners(void)
+{
+#if FW_MEM_DEBUG
+    return s_numMemOwners;
+#else
+    return 0;
+#endif
+}
+
+//------------------------------------------------------------------------
+
+const char* FW::getMemOwnerID(S32 idx)
+{
+#if FW_MEM_DEBUG
+    FW_ASSERT(idx >= 0 && idx < s_numMemOwners);
+    return s_memOwners[idx].id;
+#else
+    FW_UNREF(idx);
+    return NULL;
+#endif
+}
+
+//------------------------------------------------------------------------
+
+size_t FW::getMemOwnerUsed(S32 idx)
+{
+#if FW_MEM_DEBUG
+    FW_ASSERT(idx >= 0 && idx < s_numMemOwners);
+    return s_memOwners[idx].used;
+#else
+    FW_UNREF(idx);
+    return 0;
+#endif
+}
+
+//------------------------------------------------------------------------
+
+size_t FW::getMemOwnerPeak(S32 idx)
+{
+#if FW_MEM_DEBUG
+    FW_ASSERT(idx >= 0 && idx < s_numMemOwners);
+    return s_memOwners[idx].peak;
+#else
+    FW_UNREF(idx);
+    return 0;
+#endif
+}
+
+//------------------------------------------------------------------------
+
 void FW::pushMemOwner(const char* id)
 {
 #if !FW_MEM_DEBUG
@@ -463,6 +603,8 @@ void FW::pushMemOwner(const char* id)
 void FW::popMemOwner(void)
 {
 #if FW_MEM_DEBUG
+    // malloc() reads the stacks of other threads
+    s_lock.enter();
     U32 threadID = Thread::getID();
     Array<const char*>* stack = s_memOwnerStacks.search(threadID);
     if (stack)
@@ -475,6 +617,7 @@ void FW::popMemOwner(void)
                 s_memOwnerStacks.reset();
         }
     }
+    s_lock.leave();
 #endif
 }
 
@@ -541,13 +684,8 @@ void FW::profileStart(void)
 
 //------------------------------------------------------------------------
 
-void FW::profilePush(const char* id)
+static S32 findProfileTimer(const char* id)
 {
-    if (!s_profileStarted)
-        return;
-    if (!Thread::isMain())
-        fail("profilePush() can only be used in the main thread!");
-
     // Find or create token.
 
     S32 token;
@@ -583,10 +721,24 @@ void FW::profilePush(const char* id)
         s_profileTimerHash.add(timerKey, timerIdx);
         ProfileTimer& timer = s_profileTimers.add();
         timer.id = id;
+        timer.added = 0.0f;
         timer.parent = timerKey.x;
         if (timerKey.x != -1)
             s_profileTimers[timerKey.x].children.add(timerIdx);
     }
+    return timerIdx;
+}
+
+//------------------------------------------------------------------------
+
+void FW::profilePush(const char* id)
+{
+    if (!s_profileStarted)
+        return;
+    if (!Thread::isMain())
+        fail("profilePush() can only be used in the main thread!");
+
+    S32 timerIdx = findProfileTimer(id);
 
     // Push timer.
 
@@ -615,6 +767,29 @@ void FW::profilePop(void)
 
 //------------------------------------------------------------------------
 
+void FW::profileAdd(const char* id, F32 seconds)
+{
+    if (!s_profileStarted)
+        return;
+    if (!Thread::isMain())
+        fail("profileAdd() can only be used in the main thread!");
+
+    s_profileTimers[findProfileTimer(id)].added += seconds;
+}
+
+//------------------------------------------------------------------------
+
+F32 FW::profileGetTotal(const char* id)
+{
+    F32 total = 0.0f;
+    for (int i = 0; i < s_profileTimers.getSize(); i++)
+        if (s_profileTimers[i].id == id)
+            total += s_profileTimers[i].getTotal();
+    return total;
+}
+
+//------------------------------------------------------------------------
+
 void FW::profileEnd(bool printResults)
 {
     if (!Thread::isMain())
@@ -643,9 +818,9 @@ void FW::profileEnd(bool printResults)
             printf("%*s%-*s%-8.3f",
                 entry.y, "",
                 32 - entry.y, timer.id.getPtr(),
-                timer.timer.getTotal());
+                timer.getTotal());
 
-            printf("%.0f%%\n", timer.timer.getTotal() / s_profileTimers[0].timer.getTotal() * 100.0f);
+            printf("%.0f%%\n", timer.getTotal() / s_profileTimers[0].getTotal() * 100.0f);
         }
         printf("\n");
     }
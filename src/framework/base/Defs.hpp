@@ -45,7 +45,7 @@ namespace FW
 #   define FW_DEBUG 0
 #endif
 
-#ifdef _M_X64
+#if defined(_M_X64) || defined(__x86_64__) || defined(__aarch64__)
 #   define FW_64    1
 #else
 #   define FW_64    0
@@ -57,6 +57,16 @@ namespace FW
 #   define FW_CUDA 0
 #endif
 
+// Headless builds (the batch renderer, see CMakeLists.txt) leave out the window, GL and CUDA parts
+// of the framework and use the C and C++ standard libraries in place of the Win32 API.
+#ifndef FW_HEADLESS
+#   define FW_HEADLESS 0
+#endif
+
+#if !defined(_MSC_VER) && !FW_CUDA && !defined(__forceinline)
+#   define __forceinline inline __attribute__((always_inline))
+#endif
+
 #if FW_CUDA && !defined(__CUDA_ARCH__)
 #   define __CUDA_ARCH__ 100 // e.g. 120 = compute capability 1.2
 #endif
@@ -90,7 +100,7 @@ typedef float               F32;
 typedef double              F64;
 typedef void                (*FuncPtr)(void);
 
-#if FW_CUDA
+#if FW_CUDA || !defined(_MSC_VER)
 typedef unsigned long long  U64;
 typedef signed long long    S64;
 #else
@@ -144,7 +154,9 @@ bool            hasError        (void);
 const String&   getError        (void);
 
 void            fail            (const char* fmt, ...);
+#if !FW_HEADLESS
 void            failWin32Error  (const char* funcName);
+#endif
 void            failIfError     (void);
 
 // Re-entrancy. Called internally by Main and Window.
@@ -162,16 +174,27 @@ bool            hasLogFile      (void);
 // Memory profiling.
 
 size_t          getMemoryUsed   (void);
+size_t          getMemoryPeak   (void);                         // highest getMemoryUsed() since the last resetMemoryPeak()
+void            resetMemoryPeak (void);                         // also of the owners
 void            pushMemOwner    (const char* id);
 void            popMemOwner     (void);
 void            printMemStats   (void);
 
+// Bytes per owner, only tracked when built with FW_MEM_DEBUG; otherwise there are no owners.
+
+S32             getNumMemOwners (void);
+const char*     getMemOwnerID   (S32 idx);
+size_t          getMemOwnerUsed (S32 idx);
+size_t          getMemOwnerPeak (S32 idx);
+
 // Performance profiling.
 
 void            profileStart    (void);
 void            profilePush     (const char* id);
 void            profilePop      (void);
 void            profileEnd      (bool printResults = true);
+void            profileAdd      (const char* id, F32 seconds);  // time measured elsewhere (e.g. summed over threads), as a child of the current timer
+F32             profileGetTotal (const char* id);               // seconds under this id so far, summed over all its parents
 
 #endif
 
@@ -31,6 +31,7 @@
 
 namespace FW
 {
+template <class T> inline U32 hash(const T& value);
 
 //------------------------------------------------------------------------
 
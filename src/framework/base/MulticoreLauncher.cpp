@@ -28,6 +28,10 @@
 #include "base/MulticoreLauncher.hpp"
 #include "base/Timer.hpp"
 
+#if FW_HEADLESS
+#include <thread>
+#endif
+
 using namespace FW;
 
 //------------------------------------------------------------------------
@@ -176,9 +180,13 @@ void MulticoreLauncher::popAll(const String& progressMessage)
 
 int MulticoreLauncher::getNumCores(void)
 {
+#if FW_HEADLESS
+    return max((int)std::thread::hardware_concurrency(), 1);
+#else
     SYSTEM_INFO si;
     GetSystemInfo(&si);
     return si.dwNumberOfProcessors;
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -33,6 +33,23 @@
 
 using namespace FW;
 
+//------------------------------------------------------------------------
+// The MSVC runtime formatting functions, in standard C for headless builds.
+// vsnprintf consumes the arguments, so the length is measured on a copy.
+
+#if FW_HEADLESS
+static int _vscprintf(const char* fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    return len;
+}
+
+#   define vsprintf_s vsnprintf
+#endif
+
 //------------------------------------------------------------------------
 
 String& String::set(char chr)
@@ -396,8 +413,13 @@ String FW::getDateString(void)
     char buffer[256];
     time_t currTime;
     time(&currTime);
+#if FW_HEADLESS
+    if (!ctime_r(&currTime, buffer))
+        fail("ctime_r() failed!");
+#else
     if (ctime_s(buffer, sizeof(buffer), &currTime) != 0)
         fail("ctime_s() failed!");
+#endif
 
     // Strip linefeed.
 
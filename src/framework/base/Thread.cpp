@@ -37,6 +37,125 @@ Thread*             Thread::s_mainThread = NULL;
 
 //------------------------------------------------------------------------
 
+#if FW_HEADLESS
+
+// The headless build has no Win32, the standard library provides the same primitives.
+
+Spinlock::Spinlock(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+Spinlock::~Spinlock(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+void Spinlock::enter(void)
+{
+    m_mutex.lock();
+}
+
+//------------------------------------------------------------------------
+
+void Spinlock::leave(void)
+{
+    m_mutex.unlock();
+}
+
+//------------------------------------------------------------------------
+
+Semaphore::Semaphore(int initCount, int maxCount)
+:   m_count     (initCount),
+    m_maxCount  (maxCount)
+{
+}
+
+//------------------------------------------------------------------------
+
+Semaphore::~Semaphore(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+bool Semaphore::acquire(int millis)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (millis < 0)
+        m_condition.wait(lock, [this] { return m_count > 0; });
+    else if (!m_condition.wait_for(lock, std::chrono::milliseconds(millis), [this] { return m_count > 0; }))
+        return false;
+    m_count--;
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+void Semaphore::release(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_count >= m_maxCount)
+            fail("Semaphore::release() exceeded the maximum count!");
+        m_count++;
+    }
+    m_condition.notify_one();
+}
+
+//------------------------------------------------------------------------
+
+Monitor::Monitor(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+Monitor::~Monitor(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+void Monitor::enter(void)
+{
+    m_mutex.lock();
+}
+
+//------------------------------------------------------------------------
+
+void Monitor::leave(void)
+{
+    m_mutex.unlock();
+}
+
+//------------------------------------------------------------------------
+
+void Monitor::wait(void)
+{
+    m_condition.wait(m_mutex);
+}
+
+//------------------------------------------------------------------------
+
+void Monitor::notify(void)
+{
+    m_condition.notify_one();
+}
+
+//------------------------------------------------------------------------
+
+void Monitor::notifyAll(void)
+{
+    m_condition.notify_all();
+}
+
+//------------------------------------------------------------------------
+
+#else
+
 Spinlock::Spinlock(void)
 {
     InitializeCriticalSection(&m_critSect);
@@ -232,6 +351,10 @@ void Monitor::notifyAll(void)
 
 //------------------------------------------------------------------------
 
+#endif
+
+//------------------------------------------------------------------------
+
 Thread::Thread(void)
 :   m_refCount  (0),
     m_id        (0),
@@ -279,8 +402,12 @@ void Thread::start(ThreadFunc func, void* param)
     params.userParam    = param;
     params.ready.acquire();
 
+#if FW_HEADLESS
+    m_handle = new std::thread(threadProc, &params);
+#else
     if (!CreateThread(NULL, 0, threadProc, &params, 0, NULL))
         failWin32Error("CreateThread");
+#endif
 
     params.ready.acquire();
     m_startLock.leave();
@@ -323,27 +450,44 @@ bool Thread::isMain(void)
 
 U32 Thread::getID(void)
 {
+#if FW_HEADLESS
+    static std::atomic<U32> s_nextID(1);
+    static thread_local U32 s_id = s_nextID++;
+    return s_id;
+#else
     return GetCurrentThreadId();
+#endif
 }
 
 //------------------------------------------------------------------------
 
 void Thread::sleep(int millis)
 {
+#if FW_HEADLESS
+    std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+#else
     Sleep(millis);
+#endif
 }
 
 //------------------------------------------------------------------------
 
 void Thread::yield(void)
 {
+#if FW_HEADLESS
+    std::this_thread::yield();
+#else
     SwitchToThread();
+#endif
 }
 
 //------------------------------------------------------------------------
 
 int Thread::getPriority(void)
 {
+#if FW_HEADLESS
+    return m_priority; // scheduling priorities are not portable
+#else
     refer();
     if (m_handle)
         m_priority = GetThreadPriority(m_handle);
@@ -352,6 +496,7 @@ int Thread::getPriority(void)
     if (m_priority == THREAD_PRIORITY_ERROR_RETURN)
         failWin32Error("GetThreadPriority");
     return m_priority;
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -360,8 +505,10 @@ void Thread::setPriority(int priority)
 {
     refer();
     m_priority = priority;
+#if !FW_HEADLESS
     if (m_handle && !SetThreadPriority(m_handle, priority))
         failWin32Error("SetThreadPriority");
+#endif
     unrefer();
 }
 
@@ -372,6 +519,9 @@ bool Thread::isAlive(void)
     bool alive = false;
     refer();
 
+#if FW_HEADLESS
+    alive = (m_handle && m_id);
+#else
     if (m_handle)
     {
         DWORD exitCode;
@@ -383,6 +533,7 @@ bool Thread::isAlive(void)
         else
             m_exited = true;
     }
+#endif
 
     unrefer();
     return alive;
@@ -396,8 +547,17 @@ void Thread::join(void)
     FW_ASSERT(this != getCurrent());
 
     refer();
+#if FW_HEADLESS
+    if (m_handle)
+    {
+        m_handle->join();
+        delete m_handle;
+        m_handle = NULL;
+    }
+#else
     if (m_handle && WaitForSingleObject(m_handle, INFINITE) == WAIT_FAILED)
         failWin32Error("WaitForSingleObject");
+#endif
     m_exited = true;
     unrefer();
 }
@@ -456,6 +616,9 @@ void Thread::setUserData(const String& id, void* data, DeinitFunc deinitFunc)
 
 void Thread::suspendAll(void)
 {
+#if FW_HEADLESS
+    // Threads cannot be suspended portably, fail() exits right after calling this.
+#else
     s_lock.enter();
     for (int i = s_threads.firstSlot(); i != -1; i = s_threads.nextSlot(i))
     {
@@ -466,6 +629,7 @@ void Thread::suspendAll(void)
         thread->unrefer();
     }
     s_lock.leave();
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -495,9 +659,11 @@ void Thread::unrefer(void)
 void Thread::started(void)
 {
     m_id = getID();
+#if !FW_HEADLESS
     HANDLE process = GetCurrentProcess();
     if (!DuplicateHandle(process, GetCurrentThread(), process, &m_handle, THREAD_ALL_ACCESS, FALSE, 0))
         failWin32Error("DuplicateHandle");
+#endif
 
     s_lock.enter();
 
@@ -514,8 +680,13 @@ void Thread::started(void)
 
 void Thread::exited(void)
 {
+#if FW_HEADLESS
+    if (!m_id)
+        return;
+#else
     if (!m_handle)
         return;
+#endif
 
     s_lock.enter();
 
@@ -530,17 +701,26 @@ void Thread::exited(void)
 
     s_lock.leave();
 
+#if FW_HEADLESS
+    m_id = 0; // join() releases the std::thread
+#else
     if (m_handle)
         CloseHandle(m_handle);
     m_id = 0;
     m_handle = NULL;
+#endif
 }
 
 //------------------------------------------------------------------------
 
+#if FW_HEADLESS
+void Thread::threadProc(StartParams* params)
+{
+#else
 DWORD WINAPI Thread::threadProc(LPVOID lpParameter)
 {
     StartParams*    params      = (StartParams*)lpParameter;
+#endif
     Thread*         thread      = params->thread;
     ThreadFunc      userFunc    = params->userFunc;
     void*           userParam   = params->userParam;
@@ -573,7 +753,9 @@ DWORD WINAPI Thread::threadProc(LPVOID lpParameter)
         thread->m_exited = true;
         thread->unrefer();
     }
+#if !FW_HEADLESS
     return 0;
+#endif
 }
 
 //------------------------------------------------------------------------
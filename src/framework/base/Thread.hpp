@@ -29,6 +29,14 @@
 #include "base/Hash.hpp"
 #include "base/DLLImports.hpp"
 
+#if FW_HEADLESS
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#endif
+
 namespace FW
 {
 //------------------------------------------------------------------------
@@ -47,7 +55,11 @@ private:
     Spinlock&           operator=       (const Spinlock&); // forbidden
 
 private:
+#if FW_HEADLESS
+    std::recursive_mutex m_mutex;
+#else
     CRITICAL_SECTION    m_critSect;
+#endif
 };
 
 //------------------------------------------------------------------------
@@ -66,7 +78,14 @@ private:
     Semaphore&          operator=       (const Semaphore&); // forbidden
 
 private:
+#if FW_HEADLESS
+    std::mutex          m_mutex;
+    std::condition_variable m_condition;
+    S32                 m_count;
+    S32                 m_maxCount;
+#else
     HANDLE              m_handle;
+#endif
 };
 
 //------------------------------------------------------------------------
@@ -88,6 +107,10 @@ private:
     Monitor&            operator=       (const Monitor&); // forbidden
 
 private:
+#if FW_HEADLESS
+    std::recursive_mutex m_mutex;
+    std::condition_variable_any m_condition;
+#else
     // Legacy implementation, works on all Windows versions.
 
     Spinlock            m_lock;
@@ -102,6 +125,7 @@ private:
 
     CRITICAL_SECTION    m_mutex;
     CONDITION_VARIABLE  m_condition;
+#endif
 };
 
 //------------------------------------------------------------------------
@@ -164,7 +188,11 @@ private:
     void                started         (void);
     void                exited          (void);
 
+#if FW_HEADLESS
+    static void         threadProc      (StartParams* params);
+#else
     static DWORD WINAPI threadProc      (LPVOID lpParameter);
+#endif
 
 private:
                         Thread          (const Thread&); // forbidden
@@ -181,7 +209,11 @@ private:
 
     Spinlock            m_startLock;
     U32                 m_id;
+#if FW_HEADLESS
+    std::thread*        m_handle;
+#else
     HANDLE              m_handle;
+#endif
     S32                 m_priority;
 
     Hash<String, UserData> m_userData;
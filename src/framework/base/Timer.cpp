@@ -38,10 +38,14 @@ S64 Timer::s_prevTicks          = 0;
 
 void Timer::staticInit(void)
 {
+#if FW_HEADLESS
+        s_ticksToSecsCoef = 1.0e-9;
+#else
         LARGE_INTEGER freq;
         if (!QueryPerformanceFrequency(&freq))
             failWin32Error("QueryPerformanceFrequency");
         s_ticksToSecsCoef = max(1.0 / (F64)freq.QuadPart, 0.0);
+#endif
     }
 
 //------------------------------------------------------------------------
@@ -28,6 +28,10 @@
 #pragma once
 #include "base/DLLImports.hpp"
 
+#if FW_HEADLESS
+#   include <chrono>
+#endif
+
 namespace FW
 {
 //------------------------------------------------------------------------
@@ -87,11 +91,16 @@ Timer& Timer::operator=(const Timer& other)
 
 S64 Timer::queryTicks(void)
 {
+#if FW_HEADLESS
+    // nanoseconds of the monotonic clock
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
     LARGE_INTEGER ticks;
     QueryPerformanceCounter(&ticks);
     ticks.QuadPart = max(s_prevTicks, ticks.QuadPart);
     s_prevTicks = ticks.QuadPart; // increasing little endian => thread-safe
     return ticks.QuadPart;
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -26,7 +26,13 @@
  */
 
 #include "gpu/Buffer.hpp"
+
+#if FW_HEADLESS
+// Headless builds have neither GL nor CUDA: buffers live on the CPU only, and
+// asking for the GL or CUDA copy of one fails.
+#else
 #include "gpu/CudaModule.hpp"
+#endif
 
 using namespace FW;
 
@@ -51,6 +57,10 @@ void Buffer::wrapGL(GLuint glBuffer)
 {
     FW_ASSERT(glBuffer != 0);
 
+#if FW_HEADLESS
+    fail("Buffer::wrapGL(): Built with FW_HEADLESS!");
+    GLint size = 0;
+#else
     GLint size;
     {
         GLint oldBuffer;
@@ -60,6 +70,7 @@ void Buffer::wrapGL(GLuint glBuffer)
         glBindBuffer(GL_ARRAY_BUFFER, oldBuffer);
         GLContext::checkErrors();
     }
+#endif
 
     m_glBuffer = glBuffer;
     wrap(GL, size);
@@ -122,6 +133,7 @@ void Buffer::getRange(void* dst, S64 srcOfs, S64 size, bool async, CUstream cuda
 
     switch (m_owner)
     {
+#if !FW_HEADLESS
     case GL:
         {
             GLint oldBuffer;
@@ -132,6 +144,7 @@ void Buffer::getRange(void* dst, S64 srcOfs, S64 size, bool async, CUstream cuda
             GLContext::checkErrors();
         }
         break;
+#endif
 
     case Cuda:
         memcpyDtoH(dst, m_cudaPtr + (U32)srcOfs, (U32)size, async, cudaStream);
@@ -157,6 +170,7 @@ void Buffer::setRange(S64 dstOfs, const void* src, S64 size, bool async, CUstrea
 
     switch (m_owner)
     {
+#if !FW_HEADLESS
     case GL:
         {
             GLint oldBuffer;
@@ -167,6 +181,7 @@ void Buffer::setRange(S64 dstOfs, const void* src, S64 size, bool async, CUstrea
             GLContext::checkErrors();
         }
         break;
+#endif
 
     case Cuda:
         memcpyHtoD(getMutableCudaPtr(dstOfs), src, (U32)size, async, cudaStream);
@@ -209,9 +224,11 @@ void Buffer::clearRange(S64 dstOfs, int value, S64 size, bool async, CUstream cu
     if (!size)
         return;
 
+#if !FW_HEADLESS
     if (m_owner == Cuda)
         CudaModule::checkError("cuMemsetD8", cuMemsetD8(getMutableCudaPtr(dstOfs), (U8)value, (U32)size));
     else
+#endif
         memset(getMutablePtr(dstOfs), value, (size_t)size);
 }
 
@@ -283,6 +300,7 @@ void Buffer::setOwner(Module module, bool modify, bool async, CUstream cudaStrea
     {
         validateCPU(false, NULL, validSize);
         FW_ASSERT((m_exists & CPU) != 0);
+#if !FW_HEADLESS
         if (validSize)
         {
             profilePush("glBufferSubData");
@@ -294,6 +312,7 @@ void Buffer::setOwner(Module module, bool modify, bool async, CUstream cudaStrea
             GLContext::checkErrors();
             profilePop();
         }
+#endif
         m_dirty &= ~GL;
     }
 
@@ -379,8 +398,8 @@ void Buffer::init(S64 size, U32 hints, int align)
     m_cpuPtr    = NULL;
     m_cpuBase   = NULL;
     m_glBuffer  = 0;
-    m_cudaPtr   = NULL;
-    m_cudaBase  = NULL;
+    m_cudaPtr   = 0;
+    m_cudaBase  = 0;
     m_cudaGLReg = false;
 }
 
@@ -392,10 +411,15 @@ U32 Buffer::validateHints(U32 hints, int align, Module original)
     FW_ASSERT(align > 0);
 
     U32 res = Hint_None;
+#if FW_HEADLESS
+    FW_UNREF(hints);
+    FW_UNREF(original); // both hints need CUDA
+#else
     if ((hints & Hint_PageLock) != 0 && original != CPU)
         res |= Hint_PageLock;
     if ((hints & Hint_CudaGL) != 0 && original != Cuda && align == 1 && isAvailable_cuGLRegisterBufferObject())
         res |= Hint_CudaGL;
+#endif
     return res;
 }
 
@@ -415,8 +439,10 @@ void Buffer::deinit(void)
 
     if (m_original != GL)
         glFree(m_glBuffer, m_cudaGLReg);
+#if !FW_HEADLESS
     else if (m_cudaGLReg)
         CudaModule::checkError("cuGLUnregisterBufferObject", cuGLUnregisterBufferObject(m_glBuffer));
+#endif
 
     if (m_original != CPU)
         cpuFree(m_cpuPtr, m_cpuBase, m_hints);
@@ -550,6 +576,7 @@ void Buffer::validateCPU(bool async, CUstream cudaStream, S64 validSize)
 
     // Copy data from the source.
 
+#if !FW_HEADLESS
     if (source == GL)
     {
         profilePush("glGetBufferSubData");
@@ -562,6 +589,7 @@ void Buffer::validateCPU(bool async, CUstream cudaStream, S64 validSize)
         profilePop();
     }
     else
+#endif
     {
         FW_ASSERT(source == Cuda);
         memcpyDtoH(m_cpuPtr, m_cudaPtr, (U32)validSize, async, cudaStream);
@@ -573,6 +601,7 @@ void Buffer::validateCPU(bool async, CUstream cudaStream, S64 validSize)
 void Buffer::cpuAlloc(U8*& cpuPtr, U8*& cpuBase, S64 size, U32 hints, int align)
 {
     FW_ASSERT(align > 0);
+#if !FW_HEADLESS
     if ((hints & Hint_PageLock) != 0)
     {
         checkSize(size, 32, "cuMemAllocHost");
@@ -580,6 +609,7 @@ void Buffer::cpuAlloc(U8*& cpuPtr, U8*& cpuBase, S64 size, U32 hints, int align)
             max(1U, (U32)(size + align - 1))));
     }
     else
+#endif
     {
         checkSize(size, sizeof(U8*) * 8 - 1, "malloc");
         cpuBase = new U8[(size_t)(size + align - 1)];
@@ -596,9 +626,11 @@ void Buffer::cpuFree(U8*& cpuPtr, U8*& cpuBase, U32 hints)
     FW_ASSERT((cpuPtr == NULL) == (cpuBase == NULL));
     if (cpuPtr)
     {
+#if !FW_HEADLESS
         if ((hints & Hint_PageLock) != 0)
             CudaModule::checkError("cuMemFreeHost", cuMemFreeHost(cpuBase));
         else
+#endif
             delete[] cpuBase;
         cpuPtr = NULL;
         cpuBase = NULL;
@@ -610,6 +642,11 @@ void Buffer::cpuFree(U8*& cpuPtr, U8*& cpuBase, U32 hints)
 void Buffer::glAlloc(GLuint& glBuffer, S64 size, const void* data)
 {
     FW_ASSERT(size >= 0);
+#if FW_HEADLESS
+    FW_UNREF(glBuffer);
+    FW_UNREF(data);
+    fail("Buffer::glAlloc(): Built with FW_HEADLESS!");
+#else
     GLContext::staticInit();
 
     GLint oldBuffer;
@@ -620,12 +657,17 @@ void Buffer::glAlloc(GLuint& glBuffer, S64 size, const void* data)
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)size, data, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, oldBuffer);
     GLContext::checkErrors();
+#endif
 }
 
 //------------------------------------------------------------------------
 
 void Buffer::glFree(GLuint& glBuffer, bool& cudaGLReg)
 {
+#if FW_HEADLESS
+    FW_UNREF(glBuffer);
+    FW_UNREF(cudaGLReg);
+#else
     if (glBuffer)
     {
         if (cudaGLReg)
@@ -637,12 +679,23 @@ void Buffer::glFree(GLuint& glBuffer, bool& cudaGLReg)
         GLContext::checkErrors();
         glBuffer = 0;
     }
+#endif
 }
 
 //------------------------------------------------------------------------
 
 void Buffer::cudaAlloc(CUdeviceptr& cudaPtr, CUdeviceptr& cudaBase, bool& cudaGLReg, S64 size, GLuint glBuffer, U32 hints, int align)
 {
+#if FW_HEADLESS
+    FW_UNREF(cudaPtr);
+    FW_UNREF(cudaBase);
+    FW_UNREF(cudaGLReg);
+    FW_UNREF(size);
+    FW_UNREF(glBuffer);
+    FW_UNREF(hints);
+    FW_UNREF(align);
+    fail("Buffer::cudaAlloc(): Built with FW_HEADLESS!");
+#else
     CudaModule::staticInit();
     if ((hints & Hint_CudaGL) == 0)
     {
@@ -665,6 +718,7 @@ void Buffer::cudaAlloc(CUdeviceptr& cudaPtr, CUdeviceptr& cudaBase, bool& cudaGL
         CudaModule::checkError("cuGLMapBufferObject", cuGLMapBufferObject(&cudaBase, &buffer_size, glBuffer));
         cudaPtr = cudaBase;
     }
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -674,12 +728,17 @@ void Buffer::cudaFree(CUdeviceptr& cudaPtr, CUdeviceptr& cudaBase, GLuint glBuff
     FW_ASSERT((cudaPtr == NULL) == (cudaBase == NULL));
     if (cudaPtr)
     {
+#if FW_HEADLESS
+        FW_UNREF(glBuffer);
+        FW_UNREF(hints);
+#else
         if ((hints & Hint_CudaGL) == 0)
             CudaModule::checkError("cuMemFree", cuMemFree(cudaBase));
         else
             CudaModule::checkError("cuGLUnmapBufferObject", cuGLUnmapBufferObject(glBuffer));
-        cudaPtr = NULL;
-        cudaBase = NULL;
+#endif
+        cudaPtr = 0;
+        cudaBase = 0;
     }
 }
 
@@ -696,10 +755,18 @@ void Buffer::checkSize(S64 size, int bits, const String& funcName)
 
 void Buffer::memcpyXtoX(void* dstHost, CUdeviceptr dstDevice, const void* srcHost, CUdeviceptr srcDevice, S64 size, bool async, CUstream cudaStream)
 {
-    CUresult res;
     if (size <= 0)
         return;
 
+#if FW_HEADLESS
+    FW_UNREF(async);
+    FW_UNREF(cudaStream);
+    if (!dstHost || !srcHost)
+        fail("Buffer::memcpyXtoX(): Built with FW_HEADLESS!");
+    memcpy(dstHost, srcHost, (size_t)size);
+#else
+    CUresult res;
+
     // Try to copy.
 
     if (dstHost && srcHost)
@@ -759,6 +826,7 @@ void Buffer::memcpyXtoX(void* dstHost, CUdeviceptr dstDevice, const void* srcHos
         (srcHost) ? (const U8*)srcHost + mid : NULL,
         (srcHost) ? NULL : (CUdeviceptr)(srcDevice + mid),
         size - mid, async, cudaStream);
+#endif
 }
 
 //------------------------------------------------------------------------
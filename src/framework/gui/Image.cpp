@@ -26,7 +26,9 @@
  */
 
 #include "gui/Image.hpp"
-#include "gpu/CudaModule.hpp"
+#if (!FW_HEADLESS)
+#   include "gpu/CudaModule.hpp"
+#endif
 #include "io/File.hpp"
 #include "io/ImageBinaryIO.hpp"
 #include "io/ImageLodePngIO.hpp"
@@ -475,6 +477,15 @@ void Image::flipY(void)
 
 GLuint Image::createGLTexture(ImageFormat::ID desiredFormat, bool generateMipmaps) const
 {
+#if (FW_HEADLESS)
+
+    FW_UNREF(desiredFormat);
+    FW_UNREF(generateMipmaps);
+    fail("Image::createGLTexture(): Built with FW_HEADLESS!");
+    return 0;
+
+#else
+
     // Select format.
 
     ImageFormat::ID formatID;
@@ -525,6 +536,8 @@ GLuint Image::createGLTexture(ImageFormat::ID desiredFormat, bool generateMipmap
 
     delete converted;
     return tex;
+
+#endif
 }
 
 //------------------------------------------------------------------------
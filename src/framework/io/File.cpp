@@ -27,6 +27,12 @@
 
 #include "io/File.hpp"
 
+#if FW_HEADLESS
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#endif
+
 using namespace FW;
 
 //------------------------------------------------------------------------
@@ -34,7 +40,9 @@ using namespace FW;
 File::AsyncOp::~AsyncOp(void)
 {
     wait();
+#if !FW_HEADLESS
     CloseHandle(m_overlapped.hEvent);
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -44,8 +52,10 @@ bool File::AsyncOp::isDone(void)
     if (m_done)
         return true;
 
+#if !FW_HEADLESS
     if (!HasOverlappedIoCompleted(&m_overlapped))
         return false;
+#endif
 
     wait();
     return true;
@@ -58,6 +68,9 @@ void File::AsyncOp::wait(void)
     if (m_done)
         return;
 
+#if FW_HEADLESS
+    done();
+#else
     DWORD numBytes = 0;
     if (!GetOverlappedResult(m_fileHandle, &m_overlapped, &numBytes, TRUE))
     {
@@ -73,11 +86,16 @@ void File::AsyncOp::wait(void)
     {
         done();
     }
+#endif
 }
 
 //------------------------------------------------------------------------
 
+#if FW_HEADLESS
+File::AsyncOp::AsyncOp(FILE* fileHandle)
+#else
 File::AsyncOp::AsyncOp(HANDLE fileHandle)
+#endif
 :   m_offset        (0),
     m_numBytes      (0),
     m_expectedBytes (0),
@@ -94,6 +112,7 @@ File::AsyncOp::AsyncOp(HANDLE fileHandle)
     m_done          (false),
     m_failed        (false)
 {
+#if !FW_HEADLESS
     memset(&m_overlapped, 0, sizeof(m_overlapped));
 
     // Create event object. Without one, GetOverlappedResult()
@@ -102,6 +121,7 @@ File::AsyncOp::AsyncOp(HANDLE fileHandle)
     m_overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     if (!m_overlapped.hEvent)
         failWin32Error("CreateEvent");
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -130,6 +150,31 @@ File::File(const String& name, Mode mode, bool disableCache)
     m_size          (0),
     m_offset        (0)
 {
+#if FW_HEADLESS
+    // Standard C streams, disableCache has no portable equivalent and is ignored.
+    // The state files and materials were written on Windows, so backslashes are folder separators.
+
+    std::string path = name.getPtr();
+    std::replace(path.begin(), path.end(), '\\', '/');
+
+    const char* modeName;
+    switch (mode)
+    {
+    case Read:      modeName = "read"; m_handle = fopen(path.c_str(), "rb"); break;
+    case Create:    modeName = "create"; m_handle = fopen(path.c_str(), "w+b"); break;
+    case Modify:    modeName = "modify"; m_handle = fopen(path.c_str(), "r+b"); if (!m_handle) m_handle = fopen(path.c_str(), "w+b"); break;
+    default:        FW_ASSERT(false); return;
+    }
+
+    if (!m_handle)
+        setError("Cannot open file '%s' for %s!", m_name.getPtr(), modeName);
+    else if (fseeko(m_handle, 0, SEEK_END) != 0 || (m_size = ftello(m_handle)) < 0)
+    {
+        setError("Cannot get the size of '%s'!", m_name.getPtr());
+        m_size = 0;
+    }
+    m_actualSize = m_size;
+#else
     static bool privilegeSet = false;
     if (!privilegeSet)
     {
@@ -200,6 +245,7 @@ File::File(const String& name, Mode mode, bool disableCache)
         m_align = bytesPerSector;
     }
     FW_ASSERT((m_align & (m_align - 1)) == 0);
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -210,8 +256,12 @@ File::~File(void)
         return;
 
     fixSize();
+#if FW_HEADLESS
+    fclose(m_handle);
+#else
     CancelIo(m_handle);
     CloseHandle(m_handle);
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -253,6 +303,11 @@ void File::allocateSpace(S64 size)
     if (m_mode == Read || !m_handle || m_actualSize >= size)
         return;
 
+#if FW_HEADLESS
+    fflush(m_handle);
+    if (ftruncate(fileno(m_handle), size) == 0)
+        m_actualSize = size;
+#else
     LARGE_INTEGER ofs;
     ofs.QuadPart = (size + m_align - 1) & -m_align;
     if (SetFilePointerEx(m_handle, ofs, NULL, FILE_BEGIN) && SetEndOfFile(m_handle))
@@ -260,6 +315,7 @@ void File::allocateSpace(S64 size)
         SetFileValidData(m_handle, ofs.QuadPart);
         m_actualSize = ofs.QuadPart;
     }
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -288,8 +344,13 @@ void File::flush(void)
         return;
 
     profilePush("Flush file");
+#if FW_HEADLESS
+    if (fflush(m_handle) != 0)
+        setError("fflush() failed on '%s'!", m_name.getPtr());
+#else
     if (!FlushFileBuffers(m_handle))
         setError("FlushFileBuffers() failed on '%s'!", m_name.getPtr());
+#endif
     profilePop();
     fixSize();
 }
@@ -427,6 +488,13 @@ void File::fixSize(void)
 
     profilePush("Resize file");
 
+#if FW_HEADLESS
+    fflush(m_handle);
+    if (ftruncate(fileno(m_handle), m_size) != 0)
+        setError("ftruncate() failed on '%s'!", m_name.getPtr());
+    else
+        m_actualSize = m_size;
+#else
     bool reopen = ((m_size & (m_align - 1)) != 0);
     if (reopen)
     {
@@ -472,6 +540,7 @@ void File::fixSize(void)
         if (!m_handle)
             setError("CreateFile() failed on '%s'!", m_name.getPtr());
     }
+#endif
 
     profilePop();
 }
@@ -497,6 +566,28 @@ void File::startOp(AsyncOp* op)
         return;
     }
 
+#if FW_HEADLESS
+    // Execute synchronously.
+
+    const char* funcName = (readPtr) ? "fread" : "fwrite";
+    size_t numDone = 0;
+    if (fseeko(m_handle, offset, SEEK_SET) == 0)
+    {
+        if (readPtr)
+            numDone = fread(readPtr, 1, numBytes, m_handle);
+        else
+            numDone = fwrite(writePtr, 1, numBytes, m_handle);
+    }
+
+    if ((S32)numDone != expectedBytes)
+    {
+        setError("%s() returned %d bytes, expected %d on '%s'!", funcName, (int)numDone, expectedBytes, m_name.getPtr());
+        op->failed();
+    }
+    else
+        op->done();
+#else
+
     // Loop over blocks corresponding to MaxBytesPerSysCall.
     // Only the last one is executed asynchronously.
 
@@ -561,6 +652,7 @@ void File::startOp(AsyncOp* op)
             break;
         }
     }
+#endif
 }
 
 //------------------------------------------------------------------------
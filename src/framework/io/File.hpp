@@ -29,6 +29,10 @@
 #include "io/Stream.hpp"
 #include "base/DLLImports.hpp"
 
+#if FW_HEADLESS
+#include <stdio.h>
+#endif
+
 namespace FW
 {
 
@@ -64,7 +68,11 @@ public:
         int                 getNumBytes             (void) const    { FW_ASSERT(m_done); return (m_failed) ? 0 : m_userBytes; }
 
     private:
+#if FW_HEADLESS
+                            AsyncOp                 (FILE* fileHandle);
+#else
                             AsyncOp                 (HANDLE fileHandle);
+#endif
 
         void                done                    (void);
         void                failed                  (void)          { m_failed = true; done(); }
@@ -86,8 +94,12 @@ public:
         void*               m_copyDst;              // Pointer to copy to.
         void*               m_freePtr;              // Pointer to free afterwards.
 
+#if FW_HEADLESS
+        FILE*               m_fileHandle;           // Ops complete as soon as they are started.
+#else
         HANDLE              m_fileHandle;
         OVERLAPPED          m_overlapped;
+#endif
         bool                m_done;
         bool                m_failed;
     };
@@ -128,7 +140,11 @@ private:
     String                  m_name;
     Mode                    m_mode;
     bool                    m_disableCache;
+#if FW_HEADLESS
+    FILE*                   m_handle;
+#else
     HANDLE                  m_handle;
+#endif
     S32                     m_align;
 
     S64                     m_size;
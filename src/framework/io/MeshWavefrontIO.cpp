@@ -184,7 +184,11 @@ bool FW::parseTexture(const char*& ptr, TextureSpec& value, const String& dirNam
         return true;
 
     // Import texture.
+    profilePush("Texture decode");
+    pushMemOwner("Textures");
     value.texture = Texture::import(dirName + '/' + name);
+    popMemOwner();
+    profilePop();
 	// change to this to enable mip map generation.
 	//value.texture = Texture::importWithMipMaps(dirName + '/' + name);
 
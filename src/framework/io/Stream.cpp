@@ -246,6 +246,39 @@ void BufferedOutputStream::writef(const char* fmt, ...)
 
 //------------------------------------------------------------------------
 
+#if FW_HEADLESS
+
+void BufferedOutputStream::writefv(const char* fmt, va_list args)
+{
+    // vsnprintf consumes the arguments, so the first attempt works on a copy
+    va_list copy;
+    va_copy(copy, args);
+    int space = m_buffer.getSize() - m_numValid;
+    int size = vsnprintf((char*)m_buffer.getPtr(m_numValid), space, fmt, copy);
+    va_end(copy);
+    if (size < 0)
+        return;
+    if (size < space)
+    {
+        addValid(size);
+        return;
+    }
+
+    flushInternal();
+    if (size < m_buffer.getSize())
+        addValid(vsnprintf((char*)m_buffer.getPtr(), m_buffer.getSize(), fmt, args));
+    else
+    {
+        char* tmp = new char[size + 1];
+        vsnprintf(tmp, size + 1, fmt, args);
+        m_stream.write(tmp, size);
+        m_numFlushed += size;
+        delete[] tmp;
+    }
+}
+
+#else
+
 void BufferedOutputStream::writefv(const char* fmt, va_list args)
 {
     int space = m_buffer.getSize() - m_numValid;
@@ -270,6 +303,8 @@ void BufferedOutputStream::writefv(const char* fmt, va_list args)
     }
 }
 
+#endif
+
 //------------------------------------------------------------------------
 
 void BufferedOutputStream::flush(void)
@@ -0,0 +1,304 @@
+#include "BatchRender.hpp"
+#include "BvhReport.hpp"
+#include "TraceEvents.hpp"
+#include "gui/Image.hpp"
+#include "io/File.hpp"
+#include "io/StateDump.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+
+namespace FW {
+
+
+//------------------------------------------------------------------------
+
+void lowercaseOptions(std::vector<std::string>& args, size_t first)
+{
+	for (size_t i = first; i < args.size(); ++i)
+		if (i == 0 || (args[i - 1] != "-hierarchy" && args[i - 1] != "-trace_events" && args[i - 1] != "-ray_dump" && args[i - 1] != "-image_diff"))
+			std::transform(args[i].begin(), args[i].end(), args[i].begin(), [](char a) { return (char)::tolower((int)a); });
+}
+
+//------------------------------------------------------------------------
+
+bool parseToolSettings(const std::vector<std::string>& args, const char* toolName, BatchSettings& settings, const ToolOption& toolOption)
+{
+	if (args.size() < 3)
+		return false;
+
+	// BatchSettings skips the state and result file like the first arguments of -bat_render
+	std::vector<std::string> batchArgs = { args[0], args[1], args[2], toolName };
+	for (size_t i = 3; i < args.size(); ++i)
+		if (!toolOption(args, i))
+			batchArgs.push_back(args[i]);
+	settings.parse(batchArgs);
+	return true;
+}
+
+//------------------------------------------------------------------------
+
+bool loadBatchState(const std::string& fileName, CameraControls& camera, BatchState& state)
+{
+	String oldError = clearError();
+	StateDump dump;
+	{
+		File file(fileName.c_str(), File::Read);
+		char tag[9] = {};
+		file.readFully(tag, 8);
+		if (!hasError() && String(tag) != "FWState ")
+			setError("Invalid state file!");
+		if (!hasError())
+			file >> dump;
+	}
+
+	if (!hasError())
+	{
+		dump.pushOwner("App");
+		dump.get(state.meshFileName, "m_meshFileName");
+		dump.get(state.pointLightPos, "m_pointLightPos");
+		dump.popOwner();
+		camera.readState(dump);
+	}
+
+	String newError = getError();
+	if (restoreError(oldError))
+	{
+		::printf("Error while loading '%s': %s\n", fileName.c_str(), newError.getPtr());
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------
+
+Mesh<VertexPNTC>* loadBatchMesh(const String& fileName)
+{
+	TraceSpan span("Mesh load", "load");
+	profilePush(batchPhaseName(BatchPhase_MeshLoad));
+	pushMemOwner("Mesh");
+	String oldError = clearError();
+	std::unique_ptr<MeshBase> mesh((MeshBase*)importMesh(fileName));
+	String newError = getError();
+	if (restoreError(oldError) || !mesh)
+	{
+		popMemOwner();
+		profilePop();
+		::printf("Error while loading '%s': %s\n", fileName.getPtr(), newError.getPtr());
+		return nullptr;
+	}
+
+	Mesh<VertexPNTC>* result = new Mesh<VertexPNTC>(*mesh);
+
+	// fix input colors to white so we see something
+	for (S32 i = 0; i < result->numVertices(); ++i)
+		result->mutableVertex(i).c = Vec3f(1, 1, 1);
+	popMemOwner();
+	profilePop();
+	return result;
+}
+
+//------------------------------------------------------------------------
+
+std::string sceneName(const String& meshFileName)
+{
+	return baseName(meshFileName.getPtr());
+}
+
+//------------------------------------------------------------------------
+
+void gatherTriangles(Mesh<VertexPNTC>& mesh, std::vector<RTTriangle>& triangles)
+{
+	TraceSpan trianglesSpan("Triangle setup", "load", "triangles", mesh.numTriangles());
+	profilePush(batchPhaseName(BatchPhase_Triangles));
+	pushMemOwner("Triangles");
+	triangles.clear();
+	triangles.reserve(mesh.numTriangles());
+	for (int i = 0; i < mesh.numSubmeshes(); ++i)
+	{
+		const Array<Vec3i>& idx = mesh.indices(i);
+		for (int j = 0; j < idx.getSize(); ++j)
+		{
+			RTTriangle t(mesh.vertex(idx[j][0]), mesh.vertex(idx[j][1]), mesh.vertex(idx[j][2]));
+			t.m_data.vertex_indices = idx[j];
+			t.m_material = &(mesh.material(i));
+			triangles.push_back(t);
+		}
+	}
+
+	popMemOwner();
+	profilePop();
+	trianglesSpan.end();
+
+	TraceSpan md5Span("MD5", "load");
+	profilePush(batchPhaseName(BatchPhase_Md5));
+	std::vector<Vec3f> positions;
+	positions.reserve(mesh.numVertices());
+	for (int i = 0; i < mesh.numVertices(); ++i)
+		positions.push_back(mesh.vertex(i).p);
+	::printf("Mesh MD5: %s\n", RayTracer::computeMD5(positions).getPtr());
+	profilePop();
+}
+
+//------------------------------------------------------------------------
+
+std::unique_ptr<RayTracer> constructBatchTracer(Mesh<VertexPNTC>& mesh, std::vector<RTTriangle>& triangles, const BatchSettings& settings, int& buildTime,
+	PerfCounters* counters)
+{
+	std::unique_ptr<RayTracer> rt(new RayTracer());
+	rt->setPresplit(settings.presplit ? settings.presplit_growth : 0.0f);
+	rt->setLayout(settings.bvh_layout);
+
+	if (!settings.hierarchy_file.empty())
+	{
+		profilePush(batchPhaseName(BatchPhase_HierarchyFile));
+		rt->loadHierarchy(settings.hierarchy_file.c_str(), triangles);
+		profilePop();
+		BvhReport report = rt->analyzeHierarchy(false);
+		if (report.valid())
+		{
+			::printf("Loaded hierarchy from %s\n", settings.hierarchy_file.c_str());
+			buildTime = 0;
+			return rt;
+		}
+		::printf("Ignoring hierarchy %s: %s\n", settings.hierarchy_file.c_str(), report.errors().c_str());
+	}
+
+	profilePush(batchPhaseName(BatchPhase_Build));
+	if (counters)
+		counters->start();
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (settings.two_level)
+	{
+		// the triangles are in submesh order, so every submesh is a contiguous range
+		std::vector<std::pair<size_t, size_t>> ranges;
+		size_t first = 0;
+		for (int i = 0; i < mesh.numSubmeshes(); ++i)
+		{
+			size_t count = mesh.indices(i).getSize();
+			ranges.emplace_back(first, first + count);
+			first += count;
+		}
+		rt->constructTwoLevelHierarchy(triangles, ranges, settings.splitMode);
+		::printf("Built %d bottom-level hierarchies\n", (int)rt->getNumBottomLevel());
+	}
+	else
+		rt->constructHierarchy(triangles, settings.splitMode);
+
+	buildTime = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	if (counters)
+		counters->stop();
+	profilePop();
+	std::cout << "Build time: " << buildTime << " ms" << std::endl;
+
+	if (rt->getNumPresplits())
+		::printf("Pre-split: %d triangles -> %d references (+%.1f%%, capped at +%.0f%%)\n",
+			(int)triangles.size(), (int)rt->getNumReferences(),
+			100.0f * rt->getNumPresplits() / triangles.size(), 100.0f * settings.presplit_growth);
+
+	if (settings.optimize_bvh)
+	{
+		pushMemOwner("BVH");
+		BvhOptimizer::Stats stats = rt->optimizeHierarchy();
+		popMemOwner();
+		::printf("Treelet optimization: SAH cost %.2f -> %.2f (%.1f%%) in %d ms\n",
+			stats.sahBefore, stats.sahAfter, 100.0f * (stats.sahAfter - stats.sahBefore) / stats.sahBefore, (int)(stats.seconds * 1000.0f));
+	}
+	return rt;
+}
+
+//------------------------------------------------------------------------
+
+void layoutBatchTracer(RayTracer& rt, Renderer& renderer, const CameraControls& camera, Renderer::ShadingMode mode)
+{
+	Timer timer(true);
+	Image sample(max(BatchImageSize / 4, Vec2i(1)), ImageFormat::RGBA_Vec4f);
+	rt.beginVisitCounting();
+	renderer.rayTracePicture(&rt, &sample, camera, mode);
+	rt.applyLayout(BvhLayout_HotTreelets);
+	::printf("Hot treelet layout from a %dx%d sample render in %d ms\n", sample.getSize().x, sample.getSize().y, (int)(timer.getElapsed() * 1000.0f));
+}
+
+//------------------------------------------------------------------------
+
+Renderer::ShadingMode configureBatchRenderer(Renderer& renderer, const BatchSettings& settings, const BatchState& state)
+{
+	Renderer::ShadingMode mode;
+	if (settings.sample_type == AO_sampling)
+	{
+		renderer.setAORayLength(settings.ao_length);
+		renderer.setAONumRays(settings.spp);
+		renderer.setAANumRays(1);
+		mode = Renderer::ShadingMode_AmbientOcclusion;
+	}
+	else
+	{
+		renderer.setAANumRays(settings.spp);
+		mode = Renderer::ShadingMode_Headlight;
+	}
+	renderer.setUseAreaLights(settings.use_arealights);
+	renderer.setUseTextures(settings.use_textures);
+	renderer.setUseReflections(settings.enable_reflections);
+	renderer.setWhittedBounces(3);
+	renderer.setPointLightPos(state.pointLightPos);
+	renderer.setNormalMapping(false);
+	renderer.setTextureFiltering(false);
+	renderer.setSpecularMapping(false);
+	renderer.setBilinearFiltering(false);
+	renderer.setFilter(settings.aa_filter, settings.aa_filter_radius);
+	renderer.setSampler(settings.sampler);
+	renderer.setAdaptiveAO(settings.adaptive_ao, settings.adaptive_threshold);
+	return mode;
+}
+
+//------------------------------------------------------------------------
+
+timingResult renderBatch(Renderer& renderer, RayTracer& rt, Image& image, const CameraControls& camera, Renderer::ShadingMode mode, const BatchSettings& settings,
+	PerfCounters* counters)
+{
+	renderer.setPhaseTiming(settings.profile);
+	profilePush("Render");
+	if (counters)
+		counters->start();
+	timingResult res;
+	if (settings.time_budget <= 0.0f)
+		res = renderer.rayTracePicture(&rt, &image, camera, mode);
+	else
+	{
+		// equal time: AO keeps adding samples until the budget is used up
+		renderer.setProgressiveUnlimited(true);
+		renderer.resetProgressive();
+		res = renderer.renderProgressive(&rt, &image, camera, mode, settings.time_budget);
+		std::cout << "Progressive render: " << renderer.getProgressiveSamples() << " samples per pixel in " << res.duration << " ms" << std::endl;
+	}
+	if (counters)
+		counters->stop();
+	profileRenderPhases(renderer);
+	profilePop();
+	return res;
+}
+
+//------------------------------------------------------------------------
+
+void writeBvhReport(RayTracer& rt, const std::string& resultFile, const std::string& setName, const std::string& sceneName, const std::string& stateName)
+{
+	BvhReport report = rt.analyzeHierarchy(true);
+	report.print();
+
+	std::string reportName = resultFile.substr(0, resultFile.find_last_of(".")) + "_bvh.txt";
+	bool reportCreated = !fileExists(reportName);
+	std::ofstream reportFile(reportName, std::ios_base::out | std::ios_base::app);
+	if (reportCreated)
+		reportFile << "set_name scene_name state_name " << BvhReport::header() << std::endl;
+	reportFile << setName << " " << sceneName << " " << stateName << " ";
+	report.writeLine(reportFile);
+	reportFile << std::endl;
+}
+
+
+}
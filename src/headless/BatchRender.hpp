@@ -0,0 +1,76 @@
+#pragma once
+
+
+#include "BatchSettings.hpp"
+#include "RayTracer.hpp"
+#include "Renderer.hpp"
+#include "3d/CameraControls.hpp"
+#include "3d/Mesh.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace FW {
+
+
+// The steps of App's batch render, shared by the headless renderer and the benchmark runner.
+
+// the size of App's window, which is the size of its batch renders
+static const Vec2i BatchImageSize(1024, 768);
+
+// what App::readState reads for the renderer
+struct BatchState {
+	String	meshFileName;
+	Vec3f	pointLightPos;
+};
+
+// The options are case insensitive as in App, which lowercases the whole command line. File names keep
+// their case here since Linux file systems are case sensitive: lowercases args[first...] except the
+// file names after -hierarchy, -trace_events and -ray_dump and the folder after -image_diff.
+void lowercaseOptions(std::vector<std::string>& args, size_t first);
+
+// one of a tool's own options at args[i]: takes it, moving i past its values, and returns true, or returns
+// false for an option of -bat_render
+typedef std::function<bool(const std::vector<std::string>& args, size_t& i)> ToolOption;
+
+// For the tools that run "tool statefile file [tool options] [-bat_render options]": parses args[3...] into
+// settings except the tool's own options, which toolOption takes. The state and the file are skipped like the
+// state and result file of -bat_render, and the tool's name is the set name. False if args has no file.
+bool parseToolSettings(const std::vector<std::string>& args, const char* toolName, BatchSettings& settings, const ToolOption& toolOption);
+
+// reads the camera and the scene of a state file saved by the app, prints the error and returns false on failure
+bool loadBatchState(const std::string& fileName, CameraControls& camera, BatchState& state);
+
+// imports the mesh with white vertex colors as App does, nullptr on failure
+Mesh<VertexPNTC>* loadBatchMesh(const String& fileName);
+
+// the name of the scene in the results, i.e. the mesh file without folders and extension
+std::string sceneName(const String& meshFileName);
+
+// the triangles of all submeshes in submesh order, and prints the MD5 of the vertices
+void gatherTriangles(Mesh<VertexPNTC>& mesh, std::vector<RTTriangle>& triangles);
+
+// builds the hierarchy the settings ask for and returns the build time in ms, or loads the hierarchy file
+// (build time 0). Optimizing the hierarchy is not part of the build time, nor of the counters if given.
+std::unique_ptr<RayTracer> constructBatchTracer(Mesh<VertexPNTC>& mesh, std::vector<RTTriangle>& triangles, const BatchSettings& settings, int& buildTime,
+	PerfCounters* counters = nullptr);
+
+// the hot treelet layout orders the nodes by the visits of a quarter resolution sample render
+void layoutBatchTracer(RayTracer& rt, Renderer& renderer, const CameraControls& camera, Renderer::ShadingMode mode);
+
+// sets up the renderer as App does in batch mode and returns the shading mode to render with
+Renderer::ShadingMode configureBatchRenderer(Renderer& renderer, const BatchSettings& settings, const BatchState& state);
+
+// one timed render, progressive if the settings have a time budget; with -profile, split into phases in the profiler,
+// and with counters, their values for the render
+timingResult renderBatch(Renderer& renderer, RayTracer& rt, Image& image, const CameraControls& camera, Renderer::ShadingMode mode, const BatchSettings& settings,
+	PerfCounters* counters = nullptr);
+
+// appends the BVH statistics to resultfile_bvh.txt
+void writeBvhReport(RayTracer& rt, const std::string& resultFile, const std::string& setName, const std::string& sceneName, const std::string& stateName);
+
+
+}
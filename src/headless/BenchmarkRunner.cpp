@@ -0,0 +1,357 @@
+// Renders every state of a benchmark plan with every option set in one process. Each mesh is loaded
+// once and each distinct hierarchy of it is built once, and all views of the mesh are rendered against
+// it, instead of one process per state and set as in timing_sets/*.bat.
+//
+//   benchmark_runner planfile resultfile
+//
+// The plan is a text file with one directive per line, # starts a comment:
+//
+//   warmup 1                       untimed renders before the measured ones
+//   repeat 5                       measured renders of every state and set
+//   build_repeat 1                 builds of every hierarchy, the last one is kept
+//   reject 3                       drop renders further than this many deviations (MAD) from the median, 0 keeps all
+//   states states/standard set     a state file, or a folder whose .dat files are all used
+//   set sah -ao -spp 16 -builder sah
+//   set object -ao -spp 16 -builder object_median
+//
+// A set is a name and the -bat_render options, see timing_sets/readme.txt. The results file has the
+// columns of the batch render results, with the means of the runs as build and trace time, followed
+// by the standard deviation and minimum of both and the number of runs kept and rejected.
+
+#include "BatchRender.hpp"
+#include "RenderPool.hpp"
+#include "gui/Image.hpp"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace FW;
+
+namespace {
+
+struct BenchmarkSet {
+	std::string					name;
+	BatchSettings				settings;
+};
+
+struct BenchmarkPlan {
+	int							warmup		= 1;
+	int							repeat		= 5;
+	int							buildRepeat	= 1;
+	float						rejectMads	= 3.0f;
+	std::vector<std::string>	states;
+	std::vector<BenchmarkSet>	sets;
+};
+
+struct BenchmarkState {
+	std::string					fileName;
+	std::string					name;
+	BatchState					state;
+	CameraControls				camera;
+};
+
+// mean, deviation and minimum of the runs that are left after rejecting the outliers
+struct SampleStats {
+	double	mean;
+	double	stddev;
+	double	min;
+	int		count;
+	int		rejected;
+};
+
+//------------------------------------------------------------------------
+
+// the .dat files of a folder in name order, or the file itself
+bool listStates(const std::string& path, std::vector<std::string>& states)
+{
+	if (path.size() > 4 && path.compare(path.size() - 4, 4, ".dat") == 0)
+	{
+		states.push_back(path);
+		return true;
+	}
+
+	DIR* dir = opendir(path.c_str());
+	if (!dir)
+		return false;
+	std::vector<std::string> files;
+	while (dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".dat") == 0)
+			files.push_back(path + "/" + name);
+	}
+	closedir(dir);
+	std::sort(files.begin(), files.end());
+	states.insert(states.end(), files.begin(), files.end());
+	return true;
+}
+
+//------------------------------------------------------------------------
+
+bool loadPlan(const std::string& fileName, BenchmarkPlan& plan)
+{
+	std::ifstream file(fileName);
+	if (!file)
+	{
+		::printf("Cannot open plan '%s'!\n", fileName.c_str());
+		return false;
+	}
+
+	std::string line;
+	for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		std::string directive;
+		if (!(words >> directive))
+			continue;
+
+		bool ok = true;
+		if (directive == "warmup")
+			ok = !!(words >> plan.warmup) && plan.warmup >= 0;
+		else if (directive == "repeat")
+			ok = !!(words >> plan.repeat) && plan.repeat > 0;
+		else if (directive == "build_repeat")
+			ok = !!(words >> plan.buildRepeat) && plan.buildRepeat > 0;
+		else if (directive == "reject")
+			ok = !!(words >> plan.rejectMads) && plan.rejectMads >= 0.0f;
+		else if (directive == "states")
+		{
+			// the rest of the line, folder names may have spaces
+			std::string path;
+			std::getline(words >> std::ws, path);
+			path = path.substr(0, path.find_last_not_of(" \t\r") + 1);
+			ok = !path.empty() && listStates(path, plan.states);
+		}
+		else if (directive == "set")
+		{
+			BenchmarkSet set;
+			std::vector<std::string> args = { "", "", "" };
+			ok = !!(words >> set.name);
+			for (std::string word; words >> word; )
+				args.push_back(word);
+			lowercaseOptions(args, 3);
+			args.push_back("-bat_render");
+			set.settings.parse(args);
+			plan.sets.push_back(set);
+		}
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			::printf("%s:%d: cannot read '%s'\n", fileName.c_str(), lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	if (plan.states.empty() || plan.sets.empty())
+	{
+		::printf("The plan '%s' needs at least one state and one set!\n", fileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------
+
+// Runs further than rejectMads scaled median absolute deviations from the median are dropped, e.g.
+// a render that another process on the machine interrupted. 1.4826 scales the MAD to the standard
+// deviation of normally distributed runs. Fewer than five runs say too little about the spread to
+// reject any of them.
+SampleStats computeStats(std::vector<double> samples, float rejectMads)
+{
+	SampleStats stats = {};
+	if (samples.empty())
+		return stats;
+
+	if (rejectMads > 0.0f && samples.size() >= 5)
+	{
+		std::vector<double> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+		double median = sorted[sorted.size() / 2];
+		std::vector<double> deviations;
+		for (double s : samples)
+			deviations.push_back(std::abs(s - median));
+		std::sort(deviations.begin(), deviations.end());
+		double limit = rejectMads * 1.4826 * deviations[deviations.size() / 2];
+
+		if (limit > 0.0)
+		{
+			size_t before = samples.size();
+			samples.erase(std::remove_if(samples.begin(), samples.end(), [&](double s) { return std::abs(s - median) > limit; }), samples.end());
+			stats.rejected = (int)(before - samples.size());
+		}
+	}
+
+	stats.count = (int)samples.size();
+	stats.min = *std::min_element(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (double s : samples)
+		sum += s;
+	stats.mean = sum / stats.count;
+	double squares = 0.0;
+	for (double s : samples)
+		squares += (s - stats.mean) * (s - stats.mean);
+	stats.stddev = stats.count > 1 ? std::sqrt(squares / (stats.count - 1)) : 0.0;
+	return stats;
+}
+
+//------------------------------------------------------------------------
+
+void appendStats(const std::string& fileName, const std::string& setName, const std::string& scene, const std::string& state,
+	const SampleStats& build, const SampleStats& trace, const SampleStats& rays)
+{
+	bool created = !fileExists(fileName);
+	std::ofstream result(fileName, std::ios_base::out | std::ios_base::app);
+	if (created)
+		result << "set_name scene_name state_name build_time(ms) trace_time(ms) ray_count build_stddev(ms) build_min(ms) trace_stddev(ms) trace_min(ms) runs rejected" << std::endl;
+
+	char stats[256];
+	::snprintf(stats, sizeof(stats), "%d %d %.0f %.2f %.0f %.2f %.0f %d %d",
+		(int)std::lround(build.mean), (int)std::lround(trace.mean), rays.mean,
+		build.stddev, build.min, trace.stddev, trace.min, trace.count, trace.rejected);
+	result << setName << " " << scene << " " << state << " " << stats << std::endl;
+}
+
+//------------------------------------------------------------------------
+
+// the settings that change the hierarchy, sets that agree on these share it
+std::string hierarchyKey(const BatchSettings& s)
+{
+	std::ostringstream key;
+	key << s.splitMode << " " << s.two_level << " " << s.optimize_bvh << " " << (s.presplit ? s.presplit_growth : 0.0f) << " "
+		<< s.bvh_layout << " " << s.hierarchy_file << " " << s.threads << " " << s.pin_threads;
+	// the hot treelet layout depends on the rays of the sample render
+	if (s.bvh_layout == BvhLayout_HotTreelets)
+		key << " " << s.sample_type << " " << s.spp << " " << s.ao_length;
+	return key.str();
+}
+
+struct ResidentHierarchy {
+	std::unique_ptr<RayTracer>	rt;
+	SampleStats					build;
+};
+
+}
+
+//------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		::printf("Usage: %s planfile resultfile\n", argc ? argv[0] : "benchmark_runner");
+		return 1;
+	}
+	std::string resultFile = argv[2];
+
+	BenchmarkPlan plan;
+	if (!loadPlan(argv[1], plan))
+		return 1;
+
+	// the states in plan order, grouped by mesh so every mesh is loaded once
+	std::vector<std::unique_ptr<BenchmarkState>> states;
+	std::vector<std::string> meshes;
+	for (const std::string& fileName : plan.states)
+	{
+		std::unique_ptr<BenchmarkState> s(new BenchmarkState);
+		s->fileName = fileName;
+		s->name = baseName(fileName);
+		if (!loadBatchState(fileName, s->camera, s->state))
+			return 1;
+		std::string mesh = s->state.meshFileName.getPtr();
+		if (std::find(meshes.begin(), meshes.end(), mesh) == meshes.end())
+			meshes.push_back(mesh);
+		states.push_back(std::move(s));
+	}
+	::printf("%d states of %d meshes, %d sets, %d warm-up and %d measured renders each\n",
+		(int)states.size(), (int)meshes.size(), (int)plan.sets.size(), plan.warmup, plan.repeat);
+
+	Timer total(true);
+	for (const std::string& meshFileName : meshes)
+	{
+		std::unique_ptr<Mesh<VertexPNTC>> mesh(loadBatchMesh(meshFileName.c_str()));
+		if (!mesh)
+			return 1;
+		std::string scene = sceneName(meshFileName.c_str());
+		std::vector<RTTriangle> triangles;
+		gatherTriangles(*mesh, triangles);
+
+		std::map<std::string, ResidentHierarchy> hierarchies;
+		for (const BenchmarkSet& set : plan.sets)
+		{
+			const BatchSettings& settings = set.settings;
+			RenderPool::get().configure(settings.threads, settings.pin_threads);
+
+			std::vector<const BenchmarkState*> views;
+			for (const auto& s : states)
+				if (s->state.meshFileName.getPtr() == meshFileName)
+					views.push_back(s.get());
+
+			Renderer renderer;
+			Renderer::ShadingMode mode = configureBatchRenderer(renderer, settings, views[0]->state);
+
+			ResidentHierarchy& hierarchy = hierarchies[hierarchyKey(settings)];
+			bool built = !hierarchy.rt;
+			if (built)
+			{
+				std::vector<double> buildTimes;
+				for (int i = 0; i < plan.buildRepeat; ++i)
+				{
+					int buildTime = 0;
+					hierarchy.rt = constructBatchTracer(*mesh, triangles, settings, buildTime);
+					buildTimes.push_back(buildTime);
+				}
+				hierarchy.build = computeStats(buildTimes, 0.0f);
+			}
+			else
+				::printf("Reusing the hierarchy of %s for set %s\n", scene.c_str(), set.name.c_str());
+			RayTracer& rt = *hierarchy.rt;
+
+			renderer.gatherLightTriangles(&rt);
+			if (built && settings.bvh_layout == BvhLayout_HotTreelets)
+				layoutBatchTracer(rt, renderer, views[0]->camera, mode);
+
+			// the hierarchy is the same for all views, so it is reported once per set and scene
+			if (settings.bvh_report)
+				writeBvhReport(rt, resultFile, set.name, scene, views[0]->name);
+
+			Image image(BatchImageSize, ImageFormat::RGBA_Vec4f);
+			for (const BenchmarkState* view : views)
+			{
+				renderer.setPointLightPos(view->state.pointLightPos);
+				for (int i = 0; i < plan.warmup; ++i)
+					renderBatch(renderer, rt, image, view->camera, mode, settings);
+
+				std::vector<double> traceTimes, rayCounts;
+				for (int i = 0; i < plan.repeat; ++i)
+				{
+					timingResult res = renderBatch(renderer, rt, image, view->camera, mode, settings);
+					traceTimes.push_back(res.duration);
+					rayCounts.push_back(res.rayCount);
+				}
+
+				SampleStats trace = computeStats(traceTimes, plan.rejectMads);
+				SampleStats rays = computeStats(rayCounts, 0.0f);
+				appendStats(resultFile, set.name, scene, view->name, hierarchy.build, trace, rays);
+				::printf("%s %s %s: trace %.1f +- %.1f ms (min %.0f, %d runs, %d rejected), build %.0f ms\n",
+					set.name.c_str(), scene.c_str(), view->name.c_str(), trace.mean, trace.stddev, trace.min, trace.count, trace.rejected, hierarchy.build.mean);
+
+				if (settings.output_images)
+					exportImage(("images/" + view->name + ".png").c_str(), &image);
+			}
+		}
+	}
+	::printf("Benchmark done in %.1f s\n", total.getElapsed());
+	return 0;
+}
@@ -0,0 +1,157 @@
+// The batch render of App (-bat_render) without a window, GL or CUDA, for machines with no display.
+// Takes the same command line and appends to the same results file, so the timing scripts and the
+// plotter work with either one:
+//
+//   headless_renderer statefile resultfile measurement_name [options]
+//
+// Built by CMakeLists.txt in the root folder with FW_HEADLESS defined.
+
+#include "BatchRender.hpp"
+#include "RenderPool.hpp"
+#include "TraceEvents.hpp"
+#include "RayDump.hpp"
+#include "Validation.hpp"
+#include "gui/Image.hpp"
+
+#include <stdio.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	// the state and result files and the set name are used as given
+	std::vector<std::string> args(argv, argv + argc);
+	lowercaseOptions(args, 4);
+
+	if (args.size() < 4)
+	{
+		::printf("Usage: %s statefile resultfile measurement_name [options]\n"
+			"The options are those of -bat_render, see timing_sets/readme.txt.\n", argc ? argv[0] : "headless_renderer");
+		return 1;
+	}
+
+	BatchSettings settings;
+	settings.parse(args);
+	BatchResults results = {};
+
+	RenderPool::get().configure(settings.threads, settings.pin_threads);
+	std::cout << "Render threads: " << RenderPool::get().getNumThreads() << (settings.pin_threads ? ", pinned" : "") << std::endl;
+
+	// the phases are timed by the framework profiler, printed at the end and added to the results
+	if (settings.profile)
+		profileStart();
+
+	// load, build and render threads on a timeline, for chrome://tracing or ui.perfetto.dev
+	if (!settings.trace_file.empty())
+		TraceEvents::enable();
+
+	CameraControls camera;
+	BatchState state;
+	std::cout << args[1] << std::endl;
+	if (!loadBatchState(args[1], camera, state))
+		return 1;
+	results.state_name = baseName(args[1]);
+	results.scene_name = sceneName(state.meshFileName);
+	std::cout << "Scene name: " << results.scene_name << std::endl;
+
+	std::unique_ptr<Mesh<VertexPNTC>> mesh(loadBatchMesh(state.meshFileName));
+	if (!mesh)
+		return 1;
+
+	std::vector<RTTriangle> triangles;
+	gatherTriangles(*mesh, triangles);
+	// hardware counters of the build and the render, normalized per triangle and per ray in the results
+	PerfCounters buildCounters, traceCounters;
+	bool counters = settings.perf_counters;
+	std::unique_ptr<RayTracer> rt = constructBatchTracer(*mesh, triangles, settings, results.build_time, counters ? &buildCounters : nullptr);
+
+	Renderer renderer;
+	Renderer::ShadingMode shadingMode = configureBatchRenderer(renderer, settings, state);
+	renderer.gatherLightTriangles(rt.get());
+
+	if (settings.bvh_layout == BvhLayout_HotTreelets)
+		layoutBatchTracer(*rt, renderer, camera, shadingMode);
+
+	// a sample of rays against brute force, on its own so that the timed render traces as without it
+	if (settings.validate_rays > 0 && !validateTraversal(*rt, triangles, camera, BatchImageSize, settings.ao_length, settings.validate_rays))
+		return 1;
+
+	// the rays of the timed render only, recording them slows it down
+	if (!settings.ray_dump_file.empty())
+		RayDump::enable();
+
+	Image image(BatchImageSize, ImageFormat::RGBA_Vec4f);
+	timingResult res = renderBatch(renderer, *rt, image, camera, shadingMode, settings, counters ? &traceCounters : nullptr);
+	results.trace_time = res.duration;
+	results.rayCount = res.rayCount;
+	results.collectThreads(renderer);
+
+	if (!settings.ray_dump_file.empty())
+	{
+		RayDump::disable();
+		if (RayDump::write(settings.ray_dump_file, (S32)triangles.size()))
+			std::cout << "Rays written to " << settings.ray_dump_file << std::endl;
+		else
+			std::cout << "Could not write the rays to " << settings.ray_dump_file << std::endl;
+	}
+
+	if (counters)
+	{
+		if (results.build_time > 0)
+			printPerfCounters("Build", buildCounters, (double)triangles.size(), "triangle");
+		printPerfCounters("Trace", traceCounters, (double)res.rayCount, "ray");
+		results.collectCounters(buildCounters, traceCounters, triangles.size());
+	}
+
+	// what stays resident for rendering, and the peak of loading and building on the way
+	if (settings.mem_report)
+		printMemoryReport("after render");
+	if (!checkMemoryBudget(settings.mem_budget))
+		return 1;
+
+	if (settings.output_images)
+	{
+		profilePush(batchPhaseName(BatchPhase_ImageExport));
+		exportImage(("images/" + results.state_name + ".png").c_str(), &image);
+
+		// where the AO rays went, white is the full AO ray count
+		if (settings.adaptive_ao && settings.time_budget <= 0.0f)
+		{
+			Image samples(image.getSize(), ImageFormat::RGBA_Vec4f);
+			renderer.getAOSamplesImage(&samples);
+			exportImage(("images/" + results.state_name + "_spp.png").c_str(), &samples);
+		}
+		profilePop();
+	}
+
+	if (!settings.image_diff_folder.empty() &&
+		!diffBatchImage(image, settings.image_diff_folder, results.state_name, settings.min_psnr, settings.output_images))
+		return 1;
+
+	if (settings.profile)
+	{
+		results.collectPhases();
+		profileEnd();
+	}
+	results.append(args[2], args[3]);
+
+	if (!settings.trace_file.empty())
+	{
+		TraceEvents::disable();
+		if (TraceEvents::write(settings.trace_file))
+			std::cout << "Trace written to " << settings.trace_file << std::endl;
+		else
+			std::cout << "Could not write the trace to " << settings.trace_file << std::endl;
+	}
+
+	if (settings.bvh_report)
+		writeBvhReport(*rt, args[2], args[3], results.scene_name, results.state_name);
+
+	return 0;
+}
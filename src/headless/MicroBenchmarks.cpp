@@ -0,0 +1,481 @@
+// Times the inner kernels of the ray tracer in isolation, so that a change to one of them can be judged
+// without full renders:
+//
+//   microbench [-state statefile] [-triangles count] [-rays count] [-samples count] [-seconds time] [-threads count] [-out resultfile]
+//
+// Without a state, the inputs are a synthetic soup of small random triangles in the unit cube and random
+// rays through it. With a state, they are the triangles of its scene and rays recorded from its view: the
+// primary rays of a quarter resolution render and one diffuse bounce from every hit. Both are generated
+// from fixed seeds, so two builds time the same work.
+//
+// Every kernel is run for about -seconds per sample and the fastest of -samples samples is reported, in ns
+// and in time stamp counter cycles (x86 only) per item, with the throughput. The instruction set is the
+// one the build was compiled for; configure build folders with -DRAYTRACER_ISA=scalar|sse4|avx2 to
+// compare the paths. -out appends the table to a results file.
+//
+// Built by CMakeLists.txt in the root folder with FW_HEADLESS defined.
+
+#include "BatchRender.hpp"
+#include "BuildKernels.hpp"
+#include "RenderPool.hpp"
+#include "base/Random.hpp"
+#include "gui/Image.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MICROBENCH_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICROBENCH_HAS_TSC 1
+#else
+#define MICROBENCH_HAS_TSC 0
+#endif
+
+using namespace FW;
+
+namespace {
+
+struct Options {
+	std::string		stateFile;
+	std::string		resultFile;
+	int				triangles	= 100000;
+	int				rays		= 100000;
+	int				samples		= 5;
+	double			seconds		= 0.2;
+	int				threads		= 1;
+};
+
+// a ray as the traversal sees it, with the reciprocal direction and octant of raycast
+struct BenchRay {
+	Vec3f					orig, dir, invDir;
+	std::array<bool, 3>		dirIsNeg;
+};
+
+struct KernelResult {
+	double	nsPerItem;
+	double	cyclesPerItem;	// 0 without a time stamp counter
+	double	hitRate;		// of the intersection kernels, -1 for the others
+};
+
+// keeps the compiler from dropping the results of the kernels
+volatile U64 g_sink;
+
+//------------------------------------------------------------------------
+
+const char* isaName()
+{
+#if defined(RAYTRACER_ISA_NAME)
+	return RAYTRACER_ISA_NAME;
+#elif defined(__AVX512F__)
+	return "avx512";
+#elif defined(__AVX2__)
+	return "avx2";
+#elif defined(__AVX__)
+	return "avx";
+#elif defined(__SSE4_2__)
+	return "sse4";
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+inline U64 readCycles()
+{
+#if MICROBENCH_HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//------------------------------------------------------------------------
+
+// Calls kernel, which processes items items and returns how many of them hit (intersection kernels) or anything
+// that depends on its work, often enough that one sample takes about the given time, and keeps the fastest sample.
+KernelResult timeKernel(const std::function<U64(void)>& kernel, size_t items, bool countsHits, const Options& options)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// warm the caches and find the calls per sample
+	Clock::time_point begin = Clock::now();
+	U64 hits = kernel();
+	double once = std::chrono::duration<double>(Clock::now() - begin).count();
+	int calls = std::max(1, (int)(options.seconds / std::max(once, 1e-9)));
+
+	KernelResult best = { 1e30, 0.0, countsHits && items ? (double)hits / items : -1.0 };
+	for (int s = 0; s < options.samples; ++s)
+	{
+		U64 sink = 0;
+		U64 cycles = readCycles();
+		begin = Clock::now();
+		for (int c = 0; c < calls; ++c)
+			sink += kernel();
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+		cycles = readCycles() - cycles;
+		g_sink = g_sink + sink;
+
+		double perItem = ns / ((double)calls * items);
+		if (perItem < best.nsPerItem)
+		{
+			best.nsPerItem = perItem;
+			best.cyclesPerItem = (double)cycles / ((double)calls * items);
+		}
+	}
+	return best;
+}
+
+//------------------------------------------------------------------------
+
+BenchRay makeRay(const Vec3f& orig, const Vec3f& dir)
+{
+	BenchRay r;
+	r.orig = orig;
+	r.dir = dir;
+	Vec3f normDir = dir.normalized();
+	r.invDir = Vec3f(1.0f / normDir.x, 1.0f / normDir.y, 1.0f / normDir.z);
+	r.dirIsNeg = std::array<bool, 3>{ normDir.x > 0, normDir.y > 0, normDir.z > 0 };
+	return r;
+}
+
+Vec3f randomDirection(Random& rnd)
+{
+	Vec3f d;
+	do
+		d = Vec3f(rnd.getF32(-1.0f, 1.0f), rnd.getF32(-1.0f, 1.0f), rnd.getF32(-1.0f, 1.0f));
+	while (d.lenSqr() > 1.0f || d.lenSqr() < 1e-4f);
+	return d.normalized();
+}
+
+// small triangles with random orientations in the unit cube, about as many per volume as in the test scenes
+void makeTriangleSoup(int count, std::vector<RTTriangle>& triangles, MeshBase::Material* material)
+{
+	Random rnd(1);
+	float size = 2.0f / std::cbrt((float)count);
+	triangles.clear();
+	triangles.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		Vec3f center(rnd.getF32(-1.0f, 1.0f), rnd.getF32(-1.0f, 1.0f), rnd.getF32(-1.0f, 1.0f));
+		VertexPNTC v[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			v[k].p = center + randomDirection(rnd) * size;
+			v[k].t = Vec2f(rnd.getF32(), rnd.getF32());
+			v[k].c = Vec3f(1.0f);
+		}
+		RTTriangle t(v[0], v[1], v[2]);
+		for (int k = 0; k < 3; ++k)
+			t.m_vertices[k].n = t.normal();
+		t.m_material = material;
+		triangles.push_back(t);
+	}
+}
+
+// segments through the cube from random points in it, as long as its diagonal
+void makeRandomRays(int count, std::vector<BenchRay>& rays)
+{
+	Random rnd(2);
+	rays.clear();
+	rays.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		Vec3f orig(rnd.getF32(-1.0f, 1.0f), rnd.getF32(-1.0f, 1.0f), rnd.getF32(-1.0f, 1.0f));
+		rays.push_back(makeRay(orig, randomDirection(rnd) * 3.5f));
+	}
+}
+
+// the primary rays of the view at a quarter of the batch resolution, and a diffuse bounce from each hit,
+// up to count rays
+void recordSceneRays(const RayTracer& rt, const CameraControls& camera, const AABB& bounds, int count, std::vector<BenchRay>& rays)
+{
+	Vec2i size = BatchImageSize / 4;
+	Mat4f projection = Mat4f::fitToView(Vec2f(-1, -1), Vec2f(2, 2), size) * camera.getCameraToClip();
+	Mat4f invP = (projection * camera.getWorldToCamera()).inverted();
+	float diagonal = (bounds.max - bounds.min).length();
+
+	Random rnd(3);
+	std::vector<BenchRay> bounces;
+	rays.clear();
+	for (int j = 0; j < size.y; ++j)
+		for (int i = 0; i < size.x; ++i)
+		{
+			float x = (i + 0.5f) / size.x * 2.0f - 1.0f;
+			float y = (j + 0.5f) / size.y * -2.0f + 1.0f;
+			Vec4f front = invP * Vec4f(x, y, 0.0f, 1.0f);
+			Vec4f back = invP * Vec4f(x, y, 1.0f, 1.0f);
+			Vec3f orig = front.getXYZ() / front.w;
+			Vec3f dir = back.getXYZ() / back.w - orig;
+			rays.push_back(makeRay(orig, dir));
+
+			RaycastResult hit = rt.raycast(orig, dir);
+			if (hit.tri)
+			{
+				Vec3f n = hit.tri->normal();
+				if (dot(n, dir) > 0.0f)
+					n = -n;
+				Vec3f d = randomDirection(rnd);
+				if (dot(d, n) < 0.0f)
+					d = -d;
+				bounces.push_back(makeRay(hit.point + n * (1e-4f * diagonal), d * diagonal));
+			}
+		}
+
+	// interleave so that any prefix has both kinds
+	std::vector<BenchRay> primary;
+	primary.swap(rays);
+	for (size_t i = 0; i < primary.size() || i < bounces.size(); ++i)
+	{
+		if (i < primary.size())
+			rays.push_back(primary[i]);
+		if (i < bounces.size())
+			rays.push_back(bounces[i]);
+	}
+	if ((int)rays.size() > count)
+		rays.resize(count);
+}
+
+//------------------------------------------------------------------------
+
+void printHeader()
+{
+	::printf("%-22s %-18s %-7s %10s %10s %12s %12s %8s\n", "kernel", "input", "isa", "items", "ns/item", "cycles/item", "Mitems/s", "hits");
+}
+
+void report(const std::string& kernel, const std::string& input, size_t items, const KernelResult& r, const Options& options)
+{
+	char hits[32] = "-";
+	if (r.hitRate >= 0.0)
+		::snprintf(hits, sizeof(hits), "%.1f%%", r.hitRate * 100.0);
+	::printf("%-22s %-18s %-7s %10zu %10.3f %12.2f %12.2f %8s\n", kernel.c_str(), input.c_str(), isaName(), items,
+		r.nsPerItem, r.cyclesPerItem, 1e3 / r.nsPerItem, hits);
+
+	if (options.resultFile.empty())
+		return;
+	bool created = !fileExists(options.resultFile);
+	std::ofstream result(options.resultFile, std::ios_base::out | std::ios_base::app);
+	if (created)
+		result << "kernel input isa items ns_per_item cycles_per_item mitems_per_s hit_rate" << std::endl;
+	result << kernel << " " << input << " " << isaName() << " " << items << " " << r.nsPerItem << " " << r.cyclesPerItem
+		<< " " << 1e3 / r.nsPerItem << " " << r.hitRate << std::endl;
+}
+
+//------------------------------------------------------------------------
+
+void runKernels(const std::string& input, std::vector<RTTriangle>& triangles, const std::vector<BenchRay>& rays,
+	const RayTracer& rt, const Image& texture, const Options& options)
+{
+	// Every ray is paired with this many primitives: the triangle it hits, so that the kernels see hits as
+	// well as misses, and others at fixed pseudo random indices.
+	const int perRay = 8;
+	size_t pairs = rays.size() * perRay;
+	size_t numTris = triangles.size();
+	std::vector<size_t> pairing(pairs);
+	for (size_t r = 0; r < rays.size(); ++r)
+	{
+		const RTTriangle* hit = rt.raycast(rays[r].orig, rays[r].dir).tri;
+		for (int k = 0; k < perRay; ++k)
+			pairing[r * perRay + k] = (r * 7919u + k * 104729u) % numTris;
+		if (hit)
+			pairing[r * perRay] = hit - triangles.data();
+	}
+	auto primitive = [&pairing](size_t ray, int k) { return pairing[ray * perRay + k]; };
+
+	std::vector<AABB> boxes;
+	boxes.reserve(numTris);
+	for (const RTTriangle& t : triangles)
+		boxes.push_back(AABB(t.min(), t.max()));
+
+	report("aabb_intersect", input, pairs, timeKernel([&] {
+		U64 hits = 0;
+		for (size_t r = 0; r < rays.size(); ++r)
+			for (int k = 0; k < perRay; ++k)
+				hits += boxes[primitive(r, k)].intersect(rays[r].orig, rays[r].invDir, rays[r].dirIsNeg);
+		return hits;
+	}, pairs, true, options), options);
+
+	report("woop_intersect", input, pairs, timeKernel([&] {
+		U64 hits = 0;
+		float t, u, v;
+		for (size_t r = 0; r < rays.size(); ++r)
+			for (int k = 0; k < perRay; ++k)
+				hits += triangles[primitive(r, k)].intersect_woop(rays[r].orig, rays[r].dir, t, u, v) && t > 0.0f && t < 1.0f;
+		return hits;
+	}, pairs, true, options), options);
+
+	// the root node of a build: sorting all references in triangle order, and the sweep over the sorted range
+	std::vector<BuildRef> refs;
+	presplitReferences(triangles, 0, numTris, 0.0f, refs);
+	std::vector<uint32_t> unsorted(refs.size()), indices;
+	std::iota(unsorted.begin(), unsorted.end(), 0);
+	for (int axis = 0; axis < 3; ++axis)
+		report(std::string("sort_centroid_") + "xyz"[axis], input, refs.size(), timeKernel([&] {
+			indices = unsorted;
+			sortByCentroid(indices, refs, 0, indices.size(), axis);
+			return (U64)indices[0];
+		}, refs.size(), false, options), options);
+
+	indices = unsorted;
+	sortByCentroid(indices, refs, 0, indices.size(), 0);
+	std::vector<float> areas;
+	report("sah_sweep", input, refs.size(), timeKernel([&] {
+		size_t mid;
+		sahSweep(indices, refs, 0, indices.size(), mid, areas);
+		return (U64)mid;
+	}, refs.size(), false, options), options);
+
+	// whole builds, for the overhead around the kernels
+	const std::pair<const char*, SplitMode> builders[] = { { "build_object_median", SplitMode_ObjectMedian }, { "build_sah", SplitMode_Sah } };
+	for (const auto& b : builders)
+	{
+		RayTracer builder;
+		report(b.first, input, numTris, timeKernel([&] {
+			builder.constructHierarchy(triangles, b.second);
+			return (U64)0;
+		}, numTris, false, options), options);
+	}
+
+	// bilinear-filter-like footprint: four neighbouring texels at random positions
+	const int fetches = 1 << 16;
+	Random rnd(4);
+	std::vector<Vec2i> texels(fetches);
+	Vec2i size = texture.getSize();
+	for (Vec2i& t : texels)
+		t = Vec2i(rnd.getS32(size.x - 1), rnd.getS32(size.y - 1));
+	report("texture_fetch", input, fetches * 4, timeKernel([&] {
+		Vec4f sum(0.0f);
+		for (const Vec2i& t : texels)
+			sum += texture.getVec4f(t) + texture.getVec4f(t + Vec2i(1, 0)) + texture.getVec4f(t + Vec2i(0, 1)) + texture.getVec4f(t + Vec2i(1, 1));
+		return (U64)sum.x;
+	}, fetches * 4, false, options), options);
+
+	report("raycast", input, rays.size(), timeKernel([&] {
+		U64 hits = 0;
+		for (const BenchRay& r : rays)
+			hits += rt.raycast(r.orig, r.dir).tri != nullptr;
+		return hits;
+	}, rays.size(), true, options), options);
+}
+
+//------------------------------------------------------------------------
+
+bool parseOptions(const std::vector<std::string>& args, Options& options)
+{
+	for (size_t i = 1; i < args.size(); ++i)
+	{
+		bool hasValue = i + 1 < args.size();
+		if (args[i] == "-state" && hasValue)
+			options.stateFile = args[++i];
+		else if (args[i] == "-out" && hasValue)
+			options.resultFile = args[++i];
+		else if (args[i] == "-triangles" && hasValue)
+			options.triangles = atoi(args[++i].c_str());
+		else if (args[i] == "-rays" && hasValue)
+			options.rays = atoi(args[++i].c_str());
+		else if (args[i] == "-samples" && hasValue)
+			options.samples = atoi(args[++i].c_str());
+		else if (args[i] == "-seconds" && hasValue)
+			options.seconds = atof(args[++i].c_str());
+		else if (args[i] == "-threads" && hasValue)
+			options.threads = atoi(args[++i].c_str());
+		else
+		{
+			::printf("Argument '%s' not recognized!\n", args[i].c_str());
+			return false;
+		}
+	}
+	return options.triangles > 0 && options.rays > 0 && options.samples > 0 && options.seconds > 0.0;
+}
+
+}
+
+//------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> args(argv, argv + argc);
+	Options options;
+	if (!parseOptions(args, options))
+	{
+		::printf("Usage: %s [-state statefile] [-triangles count] [-rays count] [-samples count] [-seconds time] [-threads count] [-out resultfile]\n",
+			argc ? argv[0] : "microbench");
+		return 1;
+	}
+
+	// the kernels run on one thread, more only speed up the builds
+	RenderPool::get().configure(options.threads, false);
+	::printf("Instruction set: %s, time stamp counter: %s, build threads: %d\n", isaName(), MICROBENCH_HAS_TSC ? "yes" : "no",
+		RenderPool::get().getNumThreads());
+
+	std::string input;
+	std::unique_ptr<Mesh<VertexPNTC>> mesh;
+	std::vector<RTTriangle> triangles;
+	std::vector<BenchRay> rays;
+	MeshBase::Material soupMaterial;
+	CameraControls camera;
+	if (options.stateFile.empty())
+	{
+		input = "soup";
+		makeTriangleSoup(options.triangles, triangles, &soupMaterial);
+		makeRandomRays(options.rays, rays);
+	}
+	else
+	{
+		BatchState state;
+		if (!loadBatchState(options.stateFile, camera, state))
+			return 1;
+		mesh.reset(loadBatchMesh(state.meshFileName));
+		if (!mesh)
+			return 1;
+		input = sceneName(state.meshFileName);
+		gatherTriangles(*mesh, triangles);
+	}
+
+	RayTracer rt;
+	rt.constructHierarchy(triangles, SplitMode_Sah);
+	if (!options.stateFile.empty())
+	{
+		AABB bounds(triangles[0].min(), triangles[0].max());
+		for (const RTTriangle& t : triangles)
+		{
+			bounds.min = FW::min(bounds.min, t.min());
+			bounds.max = FW::max(bounds.max, t.max());
+		}
+		recordSceneRays(rt, camera, bounds, options.rays, rays);
+	}
+
+	// the first diffuse texture of the scene, or random texels in the format the PNG textures are loaded in
+	const Image* texture = nullptr;
+	for (int i = 0; mesh && i < mesh->numSubmeshes() && !texture; ++i)
+		if (mesh->material(i).textures[MeshBase::TextureType_Diffuse].exists())
+			texture = mesh->material(i).textures[MeshBase::TextureType_Diffuse].getImage();
+	Image noise(Vec2i(1024, 1024), ImageFormat::ABGR_8888);
+	if (!texture)
+	{
+		Random rnd(5);
+		for (int y = 0; y < noise.getSize().y; ++y)
+			for (int x = 0; x < noise.getSize().x; ++x)
+				noise.setABGR(Vec2i(x, y), rnd.getU32());
+		texture = &noise;
+	}
+
+	::printf("Input: %s, %zu triangles, %zu rays, %dx%d texture\n\n", input.c_str(), triangles.size(), rays.size(),
+		texture->getSize().x, texture->getSize().y);
+	printHeader();
+	runKernels(input, triangles, rays, rt, *texture, options);
+	return 0;
+}
@@ -0,0 +1,211 @@
+// Traces the rays a render recorded with -ray_dump against the hierarchy that the options build, without any
+// shading, and compares the hits with those of the recording:
+//
+//   ray_replay statefile raydump [-repeat count] [-packet] [-name label] [-out resultfile] [options]
+//
+// The options are those of -bat_render (timing_sets/readme.txt), so the same dump can be traced with every
+// builder, -bvh_layout, -two_level, -optimize_bvh, -presplit or a -hierarchy file, and with -threads. The state
+// must be that of the recording; the scene's triangle count is checked. The rays of each type (primary, AO)
+// are traced by the render threads in the recorded order, -repeat times (default 3), and the fastest run
+// counts. With -packet, the primary rays go through RayTracer::raycastBatch in packets of up to 64 consecutive
+// rays, as the render traced them, instead of one at a time. The rays whose hit differs from the recording are counted as lost (the recording hit, the replay
+// missed), spurious (the other way round) and wrong (another triangle at another distance); another
+// triangle at the same distance is a tie, e.g. on a shared edge, and not an error. -out appends a row per
+// type to a results file, labeled with -name (default the dump's file name). The exit code is 2 if any ray is lost,
+// spurious or wrong.
+//
+// Built by CMakeLists.txt in the root folder with FW_HEADLESS defined.
+
+#include "BatchRender.hpp"
+#include "RayDump.hpp"
+#include "RenderPool.hpp"
+#include "Validation.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace FW;
+
+namespace {
+
+struct Options {
+	int				repeat		= 3;
+	bool			packet		= false;
+	std::string		name;
+	std::string		resultFile;
+};
+
+// the replay of the rays of one type against the recording
+struct ReplayResult : HitComparison {
+	double			ms			= 0.0;
+};
+
+// rays per parallelFor item, enough to keep the scheduling out of the time and the primary rays of a tile together
+const size_t ChunkSize = 4096;
+
+// the packets of raycastBatch, the batches of Renderer::tracePixel
+const int PacketSize = 64;
+
+//------------------------------------------------------------------------
+
+// with packet, runs of consecutive primary rays are traced as packets
+ReplayResult replay(const RayTracer& rt, const std::vector<RTTriangle>& triangles, const std::vector<RayDump::Ray>& rays, int repeat, bool packet)
+{
+	ReplayResult result;
+	std::vector<S32> hitTriangles(rays.size());
+	std::vector<F32> hitT(rays.size());
+	int chunks = (int)((rays.size() + ChunkSize - 1) / ChunkSize);
+	for (int run = 0; run < repeat; ++run)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		RenderPool::get().parallelFor(chunks, [&](int chunk, int)
+		{
+			size_t end = std::min((chunk + 1) * ChunkSize, rays.size());
+			Vec3f orig[PacketSize], dir[PacketSize];
+			RaycastResult hits[PacketSize];
+			for (size_t r = chunk * ChunkSize; r < end; )
+			{
+				int count = 0;
+				if (packet)
+					while (r + count < end && count < PacketSize && rays[r + count].type == RayDump::RayType_Primary)
+					{
+						orig[count] = rays[r + count].orig;
+						dir[count] = rays[r + count].dir;
+						++count;
+					}
+				if (count)
+					rt.raycastBatch(orig, dir, hits, count);
+				else
+					hits[count++] = rt.raycast(rays[r].orig, rays[r].dir);
+
+				for (int k = 0; k < count; ++k, ++r)
+				{
+					hitTriangles[r] = hits[k].tri ? (S32)(hits[k].tri - triangles.data()) : -1;
+					hitT[r] = hits[k].t;
+				}
+			}
+		});
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		result.ms = run ? std::min(result.ms, ms) : ms;
+	}
+
+	for (size_t r = 0; r < rays.size(); ++r)
+		result.add(rays[r].triangle, rays[r].t, hitTriangles[r], hitT[r]);
+	return result;
+}
+
+void appendResult(const Options& options, const char* type, const ReplayResult& r)
+{
+	bool created = !fileExists(options.resultFile);
+	std::ofstream result(options.resultFile, std::ios_base::out | std::ios_base::app);
+	if (created)
+		result << "name type rays ms mrays_per_s lost spurious wrong ties" << std::endl;
+	result << options.name << " " << type << " " << r.rays << " " << r.ms << " " << r.rays / r.ms / 1000.0 << " "
+		<< r.lost << " " << r.spurious << " " << r.wrong << " " << r.ties << std::endl;
+}
+
+// one of the replay's own options, see ToolOption
+bool parseOption(const std::vector<std::string>& args, size_t& i, Options& options)
+{
+	bool hasValue = i + 1 < args.size();
+	if (args[i] == "-repeat" && hasValue)
+		options.repeat = atoi(args[++i].c_str());
+	else if (args[i] == "-packet")
+		options.packet = true;
+	else if (args[i] == "-name" && hasValue)
+		options.name = args[++i];
+	else if (args[i] == "-out" && hasValue)
+		options.resultFile = args[++i];
+	else
+		return false;
+	return true;
+}
+
+}
+
+//------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> args(argv, argv + argc);
+	lowercaseOptions(args, 3);
+	Options options;
+	BatchSettings settings;
+	if (!parseToolSettings(args, "ray_replay", settings, [&](const std::vector<std::string>& a, size_t& i) { return parseOption(a, i, options); })
+		|| options.repeat <= 0)
+	{
+		::printf("Usage: %s statefile raydump [-repeat count] [-packet] [-name label] [-out resultfile] [options]\n"
+			"The options are those of -bat_render, see timing_sets/readme.txt.\n", argc ? argv[0] : "ray_replay");
+		return 1;
+	}
+	if (options.name.empty())
+		options.name = baseName(args[2]);
+
+	RenderPool::get().configure(settings.threads, settings.pin_threads);
+
+	std::vector<RayDump::Ray> rays;
+	S32 numTriangles = 0;
+	std::string error;
+	if (!RayDump::read(args[2], rays, numTriangles, error))
+	{
+		::printf("Cannot read '%s': %s\n", args[2].c_str(), error.c_str());
+		return 1;
+	}
+
+	CameraControls camera;
+	BatchState state;
+	if (!loadBatchState(args[1], camera, state))
+		return 1;
+	std::unique_ptr<Mesh<VertexPNTC>> mesh(loadBatchMesh(state.meshFileName));
+	if (!mesh)
+		return 1;
+	std::vector<RTTriangle> triangles;
+	gatherTriangles(*mesh, triangles);
+	if ((S32)triangles.size() != numTriangles)
+	{
+		::printf("The rays were recorded in a scene of %d triangles, '%s' has %d\n", numTriangles, args[1].c_str(), (int)triangles.size());
+		return 1;
+	}
+
+	int buildTime = 0;
+	std::unique_ptr<RayTracer> rt = constructBatchTracer(*mesh, triangles, settings, buildTime);
+	if (settings.bvh_layout == BvhLayout_HotTreelets)
+	{
+		Renderer renderer;
+		Renderer::ShadingMode mode = configureBatchRenderer(renderer, settings, state);
+		layoutBatchTracer(*rt, renderer, camera, mode);
+	}
+
+	// by type and then all of them in the recorded order
+	std::vector<RayDump::Ray> byType[RayDump::RayType_Max];
+	for (const RayDump::Ray& ray : rays)
+		byType[ray.type].push_back(ray);
+
+	::printf("%d threads, %s%s\n%-10s%12s%10s%12s%10s%10s%10s%10s%10s\n", RenderPool::get().getNumThreads(), options.name.c_str(),
+		options.packet ? ", primary rays in packets" : "",
+		"type", "rays", "ms", "Mrays/s", "ns/ray", "lost", "spurious", "wrong", "ties");
+	bool mismatches = false;
+	for (int type = 0; type <= RayDump::RayType_Max; ++type)
+	{
+		bool all = type == RayDump::RayType_Max;
+		const std::vector<RayDump::Ray>& typeRays = all ? rays : byType[type];
+		if (typeRays.empty())
+			continue;
+		ReplayResult r = replay(*rt, triangles, typeRays, options.repeat, options.packet);
+		const char* name = all ? "all" : RayDump::typeName((RayDump::RayType)type);
+		::printf("%-10s%12zu%10.1f%12.2f%10.1f%10zu%10zu%10zu%10zu\n", name, r.rays, r.ms, r.rays / r.ms / 1000.0,
+			r.ms * 1.0e6 / r.rays, r.lost, r.spurious, r.wrong, r.ties);
+		mismatches = mismatches || !r.agrees();
+		if (!options.resultFile.empty())
+			appendResult(options, name, r);
+	}
+	if (mismatches)
+		::printf("Some hits differ from the recording\n");
+	return mismatches ? 2 : 0;
+}
@@ -0,0 +1,459 @@
+// Grows the scene of one state to production sizes and measures where the load, the build and the render stop
+// scaling:
+//
+//   scene_scaling statefile csvfile [-triangles millions,...] [-scale instance|subdivide] [-jitter f] [-seed n]
+//                 [-save folder] [-generate_only] [options]
+//
+// The options are those of -bat_render (timing_sets/readme.txt), -hierarchy excepted. For every target triangle
+// count (default 1, 2, 5, 10, 20, 50 and 100 million) the mesh of the state is scaled up, written as a binary mesh,
+// and then loaded, built and rendered with the camera of the state as headless_renderer would. -scale instance
+// (the default) lays out the closest whole number of copies on a grid around the original, each but the original
+// turned about the vertical axis and moved within -jitter (default 0.1) of its cell; -scale subdivide splits every
+// triangle into four the closest number of times, which keeps the scene and its occlusion and only adds detail.
+//
+// The csv has one row per size with the triangle and vertex counts, the load, triangle setup, build and render
+// times, the ray throughput, and the memory in use after the render and at the peak of the run. -save keeps the
+// meshes and writes a state file for each, named after the scene and the size, for headless_renderer and the
+// timing sets; -generate_only stops there. A size the framework's Mesh cannot hold (2 GB of vertices, about 48M
+// vertices) ends the sweep, as does a peak over -mem_budget.
+//
+// Built by CMakeLists.txt in the root folder with FW_HEADLESS defined.
+
+#include "BatchRender.hpp"
+#include "RenderPool.hpp"
+#include "base/Random.hpp"
+#include "gui/Image.hpp"
+#include "io/File.hpp"
+#include "io/StateDump.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace FW;
+
+namespace {
+
+enum ScaleMode { Scale_Instance, Scale_Subdivide };
+
+struct Options {
+	std::vector<double>	triangles	= { 1, 2, 5, 10, 20, 50, 100 };	// millions
+	ScaleMode		mode		= Scale_Instance;
+	float			jitter		= 0.1f;
+	U32				seed		= 1;
+	std::string		saveFolder;
+	bool			generateOnly = false;
+	bool			valid		= true;		// false after a -scale it does not know
+};
+
+struct ScalePoint {
+	S64				triangles;
+	S64				vertices;
+	int				copies;
+	int				subdivisions;
+	double			fileMb;
+	double			loadMs;
+	double			setupMs;
+	double			buildMs;
+	double			traceMs;
+	double			rays;
+	double			memMb;
+	double			memPeakMb;
+};
+
+const double Megs = 1.0 / (1024.0 * 1024.0);
+
+//------------------------------------------------------------------------
+
+double msSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// false if the vertex array of a Mesh, whose size in bytes is an S32, cannot hold this many vertices
+bool fitsInMesh(S64 vertices)
+{
+	return vertices * (S64)sizeof(VertexPNTC) <= FW_S32_MAX;
+}
+
+// the cells of a square grid ring by ring around the origin, so that the first copy stays where the camera is
+std::vector<Vec2i> gridCells(int count)
+{
+	std::vector<Vec2i> cells;
+	for (int ring = 0; (int)cells.size() < count; ++ring)
+		for (int z = -ring; z <= ring; ++z)
+			for (int x = -ring; x <= ring; ++x)
+				if (max(std::abs(x), std::abs(z)) == ring && (int)cells.size() < count)
+					cells.push_back(Vec2i(x, z));
+	return cells;
+}
+
+// copies of the mesh on the grid; each copy but the first is turned about the vertical axis through the center
+// of the mesh and moved within jitter of its cell, which is wide enough for any turn
+Mesh<VertexPNTC>* instanceMesh(const Mesh<VertexPNTC>& mesh, int copies, float jitter, U32 seed)
+{
+	S32 numVertices = mesh.numVertices();
+	if (!fitsInMesh((S64)copies * numVertices))
+		return nullptr;
+
+	Vec3f lo, hi;
+	mesh.getBBox(lo, hi);
+	Vec3f center = (lo + hi) * 0.5f;
+	float cell = max(Vec2f(hi.x - lo.x, hi.z - lo.z).length(), 1.0e-3f);
+	std::vector<Vec2i> cells = gridCells(copies);
+
+	Mesh<VertexPNTC>* result = new Mesh<VertexPNTC>;
+	result->resizeVertices(copies * numVertices);
+	for (int s = 0; s < mesh.numSubmeshes(); ++s)
+	{
+		result->addSubmesh();
+		result->material(s) = mesh.material(s);
+		result->mutableIndices(s).reset(copies * mesh.indices(s).getSize());
+	}
+
+	Random random(seed);
+	for (int c = 0; c < copies; ++c)
+	{
+		float angle = (c && jitter > 0.0f) ? random.getF32(0.0f, 2.0f * FW_PI) : 0.0f;
+		Vec3f offset(cells[c].x * cell, 0.0f, cells[c].y * cell);
+		if (c)
+			offset += Vec3f(random.getF32(-0.5f, 0.5f), 0.0f, random.getF32(-0.5f, 0.5f)) * (jitter * cell);
+		float cs = std::cos(angle), sn = std::sin(angle);
+		auto turn = [cs, sn](const Vec3f& v) { return Vec3f(cs * v.x + sn * v.z, v.y, cs * v.z - sn * v.x); };
+
+		VertexPNTC* dst = result->getMutableVertexPtr(c * numVertices);
+		for (S32 i = 0; i < numVertices; ++i)
+		{
+			dst[i] = mesh.vertex(i);
+			dst[i].p = turn(dst[i].p - center) + center + offset;
+			dst[i].n = turn(dst[i].n);
+		}
+		for (int s = 0; s < mesh.numSubmeshes(); ++s)
+		{
+			const Array<Vec3i>& src = mesh.indices(s);
+			Vec3i* indices = result->mutableIndices(s).getPtr(c * src.getSize());
+			for (int i = 0; i < src.getSize(); ++i)
+				indices[i] = src[i] + c * numVertices;
+		}
+	}
+	return result;
+}
+
+// splits every triangle into four at its edge midpoints, which the triangles on either side of an edge share;
+// false and the mesh unchanged if the vertices would not fit
+bool subdivideMesh(Mesh<VertexPNTC>& mesh)
+{
+	// the midpoint of each edge, keyed by its vertices in either order
+	auto edgeKey = [](S32 a, S32 b) { return ((U64)(U32)min(a, b) << 32) | (U32)max(a, b); };
+	std::unordered_map<U64, S32> midpoints;
+	midpoints.reserve((size_t)mesh.numTriangles() * 3 / 2);
+	S64 numVertices = mesh.numVertices();
+	for (int s = 0; s < mesh.numSubmeshes(); ++s)
+	{
+		const Array<Vec3i>& indices = mesh.indices(s);
+		for (int i = 0; i < indices.getSize(); ++i)
+			for (int e = 0; e < 3; ++e)
+				if (midpoints.insert(std::make_pair(edgeKey(indices[i][e], indices[i][(e + 1) % 3]), (S32)numVertices)).second)
+					++numVertices;
+	}
+	if (!fitsInMesh(numVertices))
+		return false;
+
+	mesh.resizeVertices((S32)numVertices);
+	for (const auto& m : midpoints)
+	{
+		const VertexPNTC& a = mesh.vertex((S32)(m.first >> 32));
+		const VertexPNTC& b = mesh.vertex((S32)(m.first & 0xFFFFFFFFu));
+		VertexPNTC& v = mesh.mutableVertex(m.second);
+		v.p = (a.p + b.p) * 0.5f;
+		v.n = (a.n + b.n).normalized();
+		v.t = (a.t + b.t) * 0.5f;
+		v.c = (a.c + b.c) * 0.5f;
+	}
+
+	for (int s = 0; s < mesh.numSubmeshes(); ++s)
+	{
+		const Array<Vec3i>& indices = mesh.indices(s);
+		Array<Vec3i> split;
+		split.reset(indices.getSize() * 4);
+		Vec3i* out = split.getPtr();
+		for (int i = 0; i < indices.getSize(); ++i)
+		{
+			const Vec3i& t = indices[i];
+			S32 ab = midpoints[edgeKey(t.x, t.y)], bc = midpoints[edgeKey(t.y, t.z)], ca = midpoints[edgeKey(t.z, t.x)];
+			*out++ = Vec3i(t.x, ab, ca);
+			*out++ = Vec3i(ab, t.y, bc);
+			*out++ = Vec3i(ca, bc, t.z);
+			*out++ = Vec3i(ab, bc, ca);
+		}
+		mesh.setIndices(s, split);
+	}
+	return true;
+}
+
+// the closest whole number of copies or of subdivisions to the target, nullptr if the mesh cannot hold it
+Mesh<VertexPNTC>* scaleMesh(const Mesh<VertexPNTC>& mesh, double targetTriangles, const Options& options, ScalePoint& point)
+{
+	pushMemOwner("Mesh");
+	double factor = targetTriangles / max(mesh.numTriangles(), 1);
+	std::unique_ptr<Mesh<VertexPNTC>> result;
+	point.copies = 1;
+	point.subdivisions = 0;
+	if (options.mode == Scale_Instance)
+	{
+		point.copies = max((int)std::lround(factor), 1);
+		result.reset(instanceMesh(mesh, point.copies, options.jitter, options.seed));
+	}
+	else
+	{
+		point.subdivisions = max((int)std::lround(std::log(factor) / std::log(4.0)), 0);
+		result.reset(new Mesh<VertexPNTC>(static_cast<const MeshBase&>(mesh)));
+		for (int i = 0; i < point.subdivisions && result; ++i)
+			if (!subdivideMesh(*result))
+				result.reset();
+	}
+	popMemOwner();
+	return result.release();
+}
+
+// a copy of a state file that shows another mesh, with the camera and everything else unchanged
+bool writeScaledState(const std::string& sourceFile, const std::string& targetFile, const std::string& meshFileName)
+{
+	String oldError = clearError();
+	StateDump dump;
+	{
+		File file(sourceFile.c_str(), File::Read);
+		char tag[9] = {};
+		file.readFully(tag, 8);
+		if (!hasError() && String(tag) != "FWState ")
+			setError("Invalid state file!");
+		if (!hasError())
+			file >> dump;
+	}
+	if (!hasError())
+	{
+		dump.pushOwner("App");
+		dump.set(String(meshFileName.c_str()), "m_meshFileName");
+		dump.popOwner();
+		File file(targetFile.c_str(), File::Create);
+		file.write("FWState ", 8);
+		file << dump;
+	}
+
+	String newError = getError();
+	if (restoreError(oldError))
+	{
+		::printf("Cannot write '%s': %s\n", targetFile.c_str(), newError.getPtr());
+		return false;
+	}
+	return true;
+}
+
+bool writeMesh(const std::string& fileName, const Mesh<VertexPNTC>& mesh)
+{
+	String oldError = clearError();
+	exportMesh(fileName.c_str(), &mesh);
+	String newError = getError();
+	if (restoreError(oldError))
+	{
+		::printf("Cannot write '%s': %s\n", fileName.c_str(), newError.getPtr());
+		return false;
+	}
+	return true;
+}
+
+double fileMegs(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	return file ? (double)file.tellg() * Megs : 0.0;
+}
+
+bool writeCsv(const std::string& fileName, const std::vector<ScalePoint>& points)
+{
+	std::ofstream csv(fileName);
+	if (!csv)
+		return false;
+
+	csv << "triangles,vertices,copies,subdivisions,file_mb,load_ms,setup_ms,build_ms,trace_ms,mrays_per_s,"
+		"build_ns_per_triangle,mem_mb,mem_peak_mb,peak_bytes_per_triangle\n";
+	for (const ScalePoint& p : points)
+	{
+		csv << p.triangles << "," << p.vertices << "," << p.copies << "," << p.subdivisions << "," << p.fileMb << ","
+			<< p.loadMs << "," << p.setupMs << "," << p.buildMs << "," << p.traceMs << ","
+			<< (p.traceMs > 0.0 ? p.rays / p.traceMs / 1000.0 : 0.0) << "," << p.buildMs * 1.0e6 / p.triangles << ","
+			<< p.memMb << "," << p.memPeakMb << "," << p.memPeakMb / Megs / p.triangles << "\n";
+	}
+	return (bool)csv;
+}
+
+// one of the generator's own options, see ToolOption
+bool parseOption(const std::vector<std::string>& args, size_t& i, Options& options)
+{
+	bool hasValue = i + 1 < args.size();
+	if (args[i] == "-triangles" && hasValue)
+	{
+		options.triangles.clear();
+		std::stringstream list(args[++i]);
+		for (std::string item; std::getline(list, item, ',');)
+			options.triangles.push_back(atof(item.c_str()));
+	}
+	else if (args[i] == "-scale" && hasValue)
+	{
+		const std::string& mode = args[++i];
+		options.mode = mode == "subdivide" ? Scale_Subdivide : Scale_Instance;
+		options.valid = options.valid && (mode == "subdivide" || mode == "instance");
+	}
+	else if (args[i] == "-jitter" && hasValue)
+		options.jitter = (float)atof(args[++i].c_str());
+	else if (args[i] == "-seed" && hasValue)
+		options.seed = (U32)atoi(args[++i].c_str());
+	else if (args[i] == "-save" && hasValue)
+		options.saveFolder = args[++i];
+	else if (args[i] == "-generate_only")
+		options.generateOnly = true;
+	else if (args[i] == "-hierarchy" && hasValue)
+		++i;
+	else
+		return false;
+	return true;
+}
+
+bool isValid(const Options& options)
+{
+	bool valid = options.valid && !options.triangles.empty() && (!options.generateOnly || !options.saveFolder.empty());
+	for (double t : options.triangles)
+		valid = valid && t > 0.0;
+	return valid;
+}
+
+// keeps the file names after -save, which lowercaseOptions does not know
+void lowercaseArgs(std::vector<std::string>& args)
+{
+	std::string saveFolder;
+	for (size_t i = 3; i + 1 < args.size(); ++i)
+		if (args[i] == "-save")
+			saveFolder = args[i + 1];
+	lowercaseOptions(args, 3);
+	for (size_t i = 3; i + 1 < args.size(); ++i)
+		if (args[i] == "-save")
+			args[i + 1] = saveFolder;
+}
+
+}
+
+//------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> args(argv, argv + argc);
+	lowercaseArgs(args);
+	Options options;
+	BatchSettings settings;
+	if (!parseToolSettings(args, "scene_scaling", settings, [&](const std::vector<std::string>& a, size_t& i) { return parseOption(a, i, options); })
+		|| !isValid(options))
+	{
+		::printf("Usage: %s statefile csvfile [-triangles millions,...] [-scale instance|subdivide] [-jitter f] [-seed n]\n"
+			"       [-save folder] [-generate_only] [options]\n"
+			"The options are those of -bat_render, see timing_sets/readme.txt.\n", argc ? argv[0] : "scene_scaling");
+		return 1;
+	}
+
+	RenderPool::get().configure(settings.threads, settings.pin_threads);
+
+	CameraControls camera;
+	BatchState state;
+	if (!loadBatchState(args[1], camera, state))
+		return 1;
+	std::unique_ptr<Mesh<VertexPNTC>> source(loadBatchMesh(state.meshFileName));
+	if (!source)
+		return 1;
+	std::string scene = sceneName(state.meshFileName);
+	::printf("%s: %d triangles, %d vertices\n", scene.c_str(), source->numTriangles(), source->numVertices());
+
+	std::vector<ScalePoint> points;
+	for (double target : options.triangles)
+	{
+		ScalePoint point = {};
+		auto start = std::chrono::high_resolution_clock::now();
+		std::unique_ptr<Mesh<VertexPNTC>> scaled(scaleMesh(*source, target * 1.0e6, options, point));
+		if (!scaled)
+		{
+			::printf("%gM triangles: more vertices than a Mesh holds (%d MB), stopping\n", target, (int)(FW_S32_MAX * Megs));
+			break;
+		}
+		point.triangles = scaled->numTriangles();
+		point.vertices = scaled->numVertices();
+		std::cout << point.triangles << " triangles (" << point.copies << " copies, " << point.subdivisions << " subdivisions): generated in "
+			<< (int)msSince(start) << " ms" << std::endl;
+
+		// the render loads the mesh from a file like any other, so that the load time is that of a real scene
+		std::string name = scene + "_" + std::to_string((point.triangles + 500) / 1000) + "k";
+		std::string meshFile = options.saveFolder.empty() ? args[2] + ".tmp.bin" : options.saveFolder + "/" + name + ".bin";
+		if (!writeMesh(meshFile, *scaled))
+			return 1;
+		scaled.reset();
+		point.fileMb = fileMegs(meshFile);
+		if (!options.saveFolder.empty() && !writeScaledState(args[1], options.saveFolder + "/" + name + ".dat", meshFile))
+			return 1;
+		if (options.generateOnly)
+		{
+			points.push_back(point);
+			continue;
+		}
+
+		resetMemoryPeak();
+		start = std::chrono::high_resolution_clock::now();
+		std::unique_ptr<Mesh<VertexPNTC>> mesh(loadBatchMesh(meshFile.c_str()));
+		point.loadMs = msSince(start);
+		if (options.saveFolder.empty())
+			::remove(meshFile.c_str());
+		if (!mesh)
+			return 1;
+
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<RTTriangle> triangles;
+		gatherTriangles(*mesh, triangles);
+		point.setupMs = msSince(start);
+
+		int buildTime = 0;
+		std::unique_ptr<RayTracer> rt = constructBatchTracer(*mesh, triangles, settings, buildTime);
+		point.buildMs = buildTime;
+
+		Renderer renderer;
+		Renderer::ShadingMode mode = configureBatchRenderer(renderer, settings, state);
+		renderer.gatherLightTriangles(rt.get());
+		if (settings.bvh_layout == BvhLayout_HotTreelets)
+			layoutBatchTracer(*rt, renderer, camera, mode);
+
+		Image image(BatchImageSize, ImageFormat::RGBA_Vec4f);
+		timingResult res = renderBatch(renderer, *rt, image, camera, mode, settings);
+		point.traceMs = res.duration;
+		point.rays = res.rayCount;
+		point.memMb = getMemoryUsed() * Megs;
+		point.memPeakMb = getMemoryPeak() * Megs;
+		points.push_back(point);
+
+		std::cout << point.triangles << " triangles: load " << (int)point.loadMs << " ms, setup " << (int)point.setupMs << " ms, build "
+			<< point.buildMs << " ms, trace " << point.traceMs << " ms, peak " << (int)point.memPeakMb << " MB" << std::endl;
+		if (settings.mem_report)
+			printMemoryReport("after render");
+		if (!checkMemoryBudget(settings.mem_budget))
+			break;
+	}
+
+	if (!writeCsv(args[2], points))
+	{
+		::printf("Cannot write '%s'!\n", args[2].c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,253 @@
+// Measures how the BVH build and the render of one state scale with the number of threads:
+//
+//   thread_scaling statefile csvfile [-smt] [-max_threads count] [-repeat count] [options]
+//
+// The options are those of -bat_render (timing_sets/readme.txt), -threads excepted. The mesh is loaded
+// once; for every thread count the worker pool is recreated with that many threads, the hierarchy is
+// built and the view rendered, -repeat times each (default 3), and the fastest build and render count.
+// The thread counts are 1, 2, 4, ... up to the number of physical cores, which is always included; -smt
+// continues up to the number of hardware threads, so that the last step shows what the SMT siblings add.
+// With -pin_threads, worker i runs on logical CPU i, which on Linux fills the physical cores first.
+//
+// The csv has one row per thread count with the times, speedups, parallel efficiencies and the serial
+// fraction estimated from that point alone (Karp-Flatt). A least squares fit of Amdahl's law over all
+// points (the serial fraction of this fixed size problem) follows in columns of its own, with the times
+// it predicts for plotting against the measured ones, and is printed at the end. Gustafson's law would
+// need a workload that grows with the threads, which this sweep does not run.
+//
+// Built by CMakeLists.txt in the root folder with FW_HEADLESS defined.
+
+#include "BatchRender.hpp"
+#include "RenderPool.hpp"
+#include "gui/Image.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace FW;
+
+namespace {
+
+struct Options {
+	bool			smt			= false;
+	int				maxThreads	= 0;		// 0 = every hardware thread
+	int				repeat		= 3;
+};
+
+struct ScalingPoint {
+	int				threads;
+	double			buildMs;				// 0 when the hierarchy was loaded from a file
+	double			traceMs;
+	double			rays;
+};
+
+//------------------------------------------------------------------------
+
+int hardwareThreads(void)
+{
+	return std::max((int)std::thread::hardware_concurrency(), 1);
+}
+
+// distinct (package, core) pairs of the online CPUs, the hardware thread count where sysfs has no topology
+int physicalCores(void)
+{
+	std::set<std::pair<int, int>> cores;
+	for (int cpu = 0; cpu < hardwareThreads(); ++cpu)
+	{
+		std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+		std::ifstream package(topology + "physical_package_id"), core(topology + "core_id");
+		int p, c;
+		if (!(package >> p) || !(core >> c))
+			return hardwareThreads();
+		cores.insert(std::make_pair(p, c));
+	}
+	return std::max((int)cores.size(), 1);
+}
+
+// 1, 2, 4, ... and the last count, up to the physical cores and then through the SMT siblings
+std::vector<int> threadCounts(int physical, int logical, const Options& options)
+{
+	int last = options.smt ? logical : physical;
+	if (options.maxThreads > 0)
+		last = std::min(last, options.maxThreads);
+
+	std::vector<int> counts;
+	for (int n = 1; n < last; n *= 2)
+	{
+		if (n > physical && counts.back() < physical)
+			counts.push_back(physical);
+		counts.push_back(n);
+	}
+	if (last > physical && counts.back() < physical)
+		counts.push_back(physical);
+	counts.push_back(last);
+	return counts;
+}
+
+// the serial fraction s of the least squares fit of Amdahl's law T(n) = T(1) (s + (1 - s) / n), which is
+// linear in s, to the times T(n) of one phase, T(1) the first
+double fitAmdahl(const std::vector<std::pair<int, double>>& times)
+{
+	double t1 = times[0].second;
+	double num = 0.0, den = 0.0;
+	for (const auto& t : times)
+	{
+		double n = t.first;
+		double serialPart = t1 * (1.0 - 1.0 / n);
+		num += (t.second - t1 / n) * serialPart;
+		den += serialPart * serialPart;
+	}
+	return den > 0.0 ? std::min(std::max(num / den, 0.0), 1.0) : 0.0;
+}
+
+// the serial fraction that explains one measured speedup, undefined for one thread
+double karpFlatt(double speedup, int threads)
+{
+	if (threads <= 1 || speedup <= 0.0)
+		return 0.0;
+	return (1.0 / speedup - 1.0 / threads) / (1.0 - 1.0 / threads);
+}
+
+void printFit(const char* phase, double amdahl, const std::vector<std::pair<int, double>>& times)
+{
+	double speedup = times[0].second / times.back().second;
+	::printf("%s: %.2fx on %d threads (%.0f%% efficiency), Amdahl serial fraction %.3f (at most %.1fx on any number of threads)\n",
+		phase, speedup, times.back().first, 100.0 * speedup / times.back().first, amdahl, amdahl > 0.0 ? 1.0 / amdahl : 0.0);
+}
+
+bool writeCsv(const std::string& fileName, const std::vector<ScalingPoint>& points, int physical, bool hasBuild,
+	double buildAmdahl, double traceAmdahl)
+{
+	std::ofstream csv(fileName);
+	if (!csv)
+		return false;
+
+	csv << "threads,smt,build_ms,trace_ms,mrays_per_s,build_speedup,trace_speedup,build_efficiency,trace_efficiency,"
+		"build_karp_flatt,trace_karp_flatt,build_amdahl_ms,trace_amdahl_ms,build_amdahl_serial,trace_amdahl_serial\n";
+
+	const ScalingPoint& first = points[0];
+	for (const ScalingPoint& p : points)
+	{
+		int n = p.threads;
+		double buildSpeedup = hasBuild ? first.buildMs / p.buildMs : 0.0;
+		double traceSpeedup = first.traceMs / p.traceMs;
+		csv << n << "," << (n > physical ? 1 : 0) << "," << p.buildMs << "," << p.traceMs << "," << p.rays / p.traceMs / 1000.0 << ","
+			<< buildSpeedup << "," << traceSpeedup << "," << buildSpeedup / n << "," << traceSpeedup / n << ","
+			<< karpFlatt(buildSpeedup, n) << "," << karpFlatt(traceSpeedup, n) << ","
+			<< (hasBuild ? first.buildMs * (buildAmdahl + (1.0 - buildAmdahl) / n) : 0.0) << ","
+			<< first.traceMs * (traceAmdahl + (1.0 - traceAmdahl) / n) << ","
+			<< buildAmdahl << "," << traceAmdahl << "\n";
+	}
+	return (bool)csv;
+}
+
+// one of the sweep's own options, see ToolOption
+bool parseOption(const std::vector<std::string>& args, size_t& i, Options& options)
+{
+	bool hasValue = i + 1 < args.size();
+	if (args[i] == "-smt")
+		options.smt = true;
+	else if (args[i] == "-max_threads" && hasValue)
+		options.maxThreads = atoi(args[++i].c_str());
+	else if (args[i] == "-repeat" && hasValue)
+		options.repeat = atoi(args[++i].c_str());
+	else if (args[i] == "-threads" && hasValue)
+		++i;
+	else
+		return false;
+	return true;
+}
+
+}
+
+//------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> args(argv, argv + argc);
+	lowercaseOptions(args, 3);
+	Options options;
+	BatchSettings settings;
+	if (!parseToolSettings(args, "thread_scaling", settings, [&](const std::vector<std::string>& a, size_t& i) { return parseOption(a, i, options); })
+		|| options.repeat <= 0 || options.maxThreads < 0)
+	{
+		::printf("Usage: %s statefile csvfile [-smt] [-max_threads count] [-repeat count] [options]\n"
+			"The options are those of -bat_render, see timing_sets/readme.txt.\n", argc ? argv[0] : "thread_scaling");
+		return 1;
+	}
+
+	int physical = physicalCores(), logical = hardwareThreads();
+	std::vector<int> counts = threadCounts(physical, logical, options);
+	::printf("%d physical cores, %d hardware threads, %s\n", physical, logical, settings.pin_threads ? "pinned" : "not pinned");
+
+	CameraControls camera;
+	BatchState state;
+	if (!loadBatchState(args[1], camera, state))
+		return 1;
+	std::unique_ptr<Mesh<VertexPNTC>> mesh(loadBatchMesh(state.meshFileName));
+	if (!mesh)
+		return 1;
+	std::vector<RTTriangle> triangles;
+	gatherTriangles(*mesh, triangles);
+
+	std::vector<ScalingPoint> points;
+	for (int threads : counts)
+	{
+		RenderPool::get().configure(threads, settings.pin_threads);
+		ScalingPoint point = { threads, 0.0, 0.0, 0.0 };
+
+		std::unique_ptr<RayTracer> rt;
+		for (int run = 0; run < options.repeat; ++run)
+		{
+			int buildTime = 0;
+			rt = constructBatchTracer(*mesh, triangles, settings, buildTime);
+			point.buildMs = run ? std::min(point.buildMs, (double)buildTime) : buildTime;
+		}
+
+		Renderer renderer;
+		Renderer::ShadingMode mode = configureBatchRenderer(renderer, settings, state);
+		renderer.gatherLightTriangles(rt.get());
+		if (settings.bvh_layout == BvhLayout_HotTreelets)
+			layoutBatchTracer(*rt, renderer, camera, mode);
+
+		Image image(BatchImageSize, ImageFormat::RGBA_Vec4f);
+		for (int run = 0; run < options.repeat; ++run)
+		{
+			timingResult res = renderBatch(renderer, *rt, image, camera, mode, settings);
+			point.traceMs = run ? std::min(point.traceMs, (double)res.duration) : res.duration;
+			point.rays = res.rayCount;
+		}
+		std::cout << threads << " threads: build " << point.buildMs << " ms, trace " << point.traceMs << " ms" << std::endl;
+		points.push_back(point);
+	}
+
+	// a hierarchy file has no build time to fit
+	bool hasBuild = points[0].buildMs > 0.0;
+	std::vector<std::pair<int, double>> buildTimes, traceTimes;
+	for (const ScalingPoint& p : points)
+	{
+		buildTimes.push_back(std::make_pair(p.threads, std::max(p.buildMs, 1.0)));
+		traceTimes.push_back(std::make_pair(p.threads, std::max(p.traceMs, 1.0)));
+	}
+	double build = hasBuild ? fitAmdahl(buildTimes) : 0.0;
+	double trace = fitAmdahl(traceTimes);
+	if (hasBuild)
+		printFit("Build", build, buildTimes);
+	printFit("Trace", trace, traceTimes);
+
+	if (!writeCsv(args[2], points, physical, hasBuild, build, trace))
+	{
+		::printf("Cannot write '%s'!\n", args[2].c_str());
+		return 1;
+	}
+	return 0;
+}
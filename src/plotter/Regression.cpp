@@ -0,0 +1,112 @@
+#include "Regression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+const char* metricNames[Metric_Max] = { "build_time", "trace_time", "mrays_per_s" };
+
+struct Value {
+	double mean, stddev;
+	int runs;
+};
+
+Value metricValue(const Measurement& m, RegressionMetric metric) {
+	switch (metric) {
+	case Metric_BuildTime:	return { m.build_time, m.build_stddev, m.runs };
+	case Metric_TraceTime:	return { m.trace_time, m.trace_stddev, m.runs };
+	default:
+		// rays per second has the relative deviation of the trace time
+		return { m.mraysPerSecond(), m.trace_time > 0.0 ? m.mraysPerSecond() * m.trace_stddev / m.trace_time : 0.0, m.runs };
+	}
+}
+
+std::string format(const Value& v) {
+	std::ostringstream s;
+	s << std::fixed << std::setprecision(v.mean < 100.0 ? 2 : 0) << v.mean;
+	if (v.stddev > 0.0)
+		s << "+-" << std::setprecision(v.stddev < 100.0 ? 2 : 0) << v.stddev;
+	return s.str();
+}
+
+// geometric mean of other / set trace times over the states both measured, 0 if there are none
+double traceSpeedup(const ResultsFile& results, const std::string& set, const std::string& other) {
+	double logSum = 0.0;
+	int count = 0;
+	for (const Measurement& m : results.rows) {
+		if (m.set != set)
+			continue;
+		const Measurement* o = results.find(other, m.scene, m.state);
+		if (o && m.trace_time > 0.0 && o->trace_time > 0.0) {
+			logSum += std::log(o->trace_time / m.trace_time);
+			++count;
+		}
+	}
+	return count ? std::exp(logSum / count) : 0.0;
+}
+
+}
+
+int checkRegressions(const ResultsFile& baseline, const ResultsFile& current, const RegressionLimits& limits,
+	const std::vector<SpeedupRequirement>& speedups, std::ostream& out) {
+
+	int failures = 0, improvements = 0, compared = 0;
+	out << std::left << std::setw(44) << "set scene state" << std::setw(13) << "metric" << std::setw(18) << "baseline"
+		<< std::setw(18) << "current" << std::setw(10) << "change" << "verdict" << std::endl;
+
+	for (const Measurement& b : baseline.rows) {
+		std::string name = b.set + " " + b.scene + " " + b.state;
+		const Measurement* c = current.find(b.set, b.scene, b.state);
+		if (!c) {
+			out << std::setw(44) << name << "missing from the current results" << (limits.allowMissing ? "" : "  FAIL") << std::endl;
+			failures += limits.allowMissing ? 0 : 1;
+			continue;
+		}
+		++compared;
+
+		for (int metric = 0; metric < Metric_Max; ++metric) {
+			Value bv = metricValue(b, (RegressionMetric)metric);
+			Value cv = metricValue(*c, (RegressionMetric)metric);
+			if (bv.mean <= 0.0)
+				continue;
+
+			// positive = worse: times go up, rays per second go down
+			bool higherIsWorse = metric != Metric_RaysPerSecond;
+			double change = (cv.mean - bv.mean) / bv.mean * 100.0;
+			double worse = higherIsWorse ? change : -change;
+
+			// the times both files report, in ms, for the timer resolution floor
+			double msDiff = metric == Metric_BuildTime ? std::abs(c->build_time - b.build_time) : std::abs(c->trace_time - b.trace_time);
+			// the means are compared, so the noise is the standard error of their difference
+			double noise = std::sqrt(bv.stddev * bv.stddev / std::max(bv.runs, 1) + cv.stddev * cv.stddev / std::max(cv.runs, 1));
+			bool significant = msDiff >= limits.minMs && std::abs(cv.mean - bv.mean) > limits.sigmas * noise;
+			if (!significant || std::abs(worse) < limits.threshold[metric])
+				continue;
+
+			std::ostringstream changeText;
+			changeText << std::showpos << std::fixed << std::setprecision(1) << change << "%";
+			out << std::setw(44) << name << std::setw(13) << metricNames[metric] << std::setw(18) << format(bv) << std::setw(18) << format(cv)
+				<< std::setw(10) << changeText.str() << (worse > 0.0 ? "REGRESSED" : "improved") << std::endl;
+			if (worse > 0.0)
+				++failures;
+			else
+				++improvements;
+		}
+	}
+
+	for (const SpeedupRequirement& r : speedups) {
+		double speedup = traceSpeedup(current, r.set, r.other);
+		bool ok = speedup >= r.factor;
+		out << r.set << " traces " << std::fixed << std::setprecision(2) << speedup << "x as fast as " << r.other
+			<< " (required " << r.factor << "x)" << (ok ? "" : "  FAIL") << std::endl;
+		failures += ok ? 0 : 1;
+	}
+
+	out << std::defaultfloat << std::setprecision(6) << compared << " measurements compared, " << failures << " failures, " << improvements << " improvements "
+		<< "(threshold build " << limits.threshold[Metric_BuildTime] << "%, trace " << limits.threshold[Metric_TraceTime]
+		<< "%, rays/s " << limits.threshold[Metric_RaysPerSecond] << "%, " << limits.sigmas << " standard errors of the mean)" << std::endl;
+	return failures;
+}
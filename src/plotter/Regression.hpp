@@ -0,0 +1,39 @@
+#pragma once
+
+// The regression gate of bench_report: compares a fresh results file against a stored baseline.
+
+#include "Results.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum RegressionMetric { Metric_BuildTime, Metric_TraceTime, Metric_RaysPerSecond, Metric_Max };
+
+struct RegressionLimits {
+	// allowed slowdown in percent per metric, e.g. 10 fails a trace time 10% above the baseline
+	double threshold[Metric_Max] = { 10.0, 10.0, 10.0 };
+
+	// A change also has to be this many standard errors of the difference of the means, computed from
+	// the deviations and run counts of both files, so that the jitter of repeated runs does not fail
+	// the gate. Files without deviations (single runs) are judged by the threshold alone.
+	double sigmas = 3.0;
+
+	// build and trace times that change by less than this are timer resolution, not regressions
+	double minMs = 2.0;
+
+	// measurements of the baseline that the fresh results lack fail the gate unless this is set
+	bool allowMissing = false;
+};
+
+// "set is at least factor times faster than other", by the geometric mean of the trace time ratios of
+// the states both sets measured. Machine independent, unlike the baseline comparison.
+struct SpeedupRequirement {
+	std::string set, other;
+	double factor;
+};
+
+// Writes one line per compared metric that got worse or better past the limits, and a summary.
+// Returns the number of failures: regressions, missing measurements and unmet speedups.
+int checkRegressions(const ResultsFile& baseline, const ResultsFile& current, const RegressionLimits& limits,
+	const std::vector<SpeedupRequirement>& speedups, std::ostream& out);
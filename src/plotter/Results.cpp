@@ -0,0 +1,175 @@
+#include "Results.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+// "trace_time(ms)" -> "trace_time"
+std::string columnName(const std::string& header) {
+	return header.substr(0, header.find('('));
+}
+
+// the sample deviation of all the runs of the lines, from each line's mean, deviation and run count:
+// the squares within the lines plus those of the line means around the pooled mean
+double pooledStddev(const std::vector<double>& means, const std::vector<double>& stddevs, const std::vector<int>& runs, double mean) {
+	double squares = 0.0;
+	int total = 0;
+	for (size_t i = 0; i < means.size(); ++i) {
+		squares += (runs[i] - 1) * stddevs[i] * stddevs[i] + runs[i] * (means[i] - mean) * (means[i] - mean);
+		total += runs[i];
+	}
+	return total > 1 ? std::sqrt(squares / (total - 1)) : 0.0;
+}
+
+}
+
+bool ResultsFile::read(const std::string& fileName, std::string& error) {
+	std::ifstream file(fileName);
+	if (!file) {
+		error = "couldn't open '" + fileName + "'";
+		return false;
+	}
+
+	size_t begin = fileName.find_last_of("/\\") + 1, end = fileName.find_last_of('.');
+	name = fileName.substr(begin, (end == std::string::npos || end < begin ? fileName.size() : end) - begin);
+
+	std::string line;
+	std::getline(file, line);
+	std::vector<std::string> columns;
+	{
+		std::istringstream header(line);
+		for (std::string word; header >> word; )
+			columns.push_back(columnName(word));
+	}
+
+	const char* required[] = { "set_name", "scene_name", "state_name", "build_time", "trace_time", "ray_count" };
+	for (const char* r : required)
+		if (std::find(columns.begin(), columns.end(), r) == columns.end()) {
+			error = "'" + fileName + "' has no " + r + " column";
+			return false;
+		}
+
+	const char* known[] = { "set_name", "scene_name", "state_name", "build_time", "trace_time", "ray_count",
+		"build_stddev", "build_min", "trace_stddev", "trace_min", "runs", "rejected" };
+	extraColumns.clear();
+	for (const std::string& c : columns)
+		if (std::find(std::begin(known), std::end(known), c) == std::end(known))
+			extraColumns.push_back(c);
+
+	rows.clear();
+	for (int lineNumber = 2; std::getline(file, line); ++lineNumber) {
+		std::istringstream words(line);
+		std::vector<std::string> values;
+		for (std::string word; words >> word; )
+			values.push_back(word);
+		if (values.empty())
+			continue;
+		if (values.size() < columns.size()) {
+			error = fileName + ":" + std::to_string(lineNumber) + ": expected " + std::to_string(columns.size()) + " columns";
+			return false;
+		}
+
+		std::map<std::string, std::string> row;
+		for (size_t i = 0; i < columns.size(); ++i)
+			row[columns[i]] = values[i];
+		auto number = [&](const char* column, double fallback) {
+			return row.count(column) ? std::atof(row[column].c_str()) : fallback;
+		};
+
+		Measurement m;
+		m.set = row["set_name"];
+		m.scene = row["scene_name"];
+		m.state = row["state_name"];
+		m.build_time = number("build_time", 0.0);
+		m.trace_time = number("trace_time", 0.0);
+		m.ray_count = number("ray_count", 0.0);
+		m.build_stddev = number("build_stddev", 0.0);
+		m.trace_stddev = number("trace_stddev", 0.0);
+		m.build_min = number("build_min", m.build_time);
+		m.trace_min = number("trace_min", m.trace_time);
+		m.runs = (int)number("runs", 1.0);
+		for (const std::string& c : extraColumns)
+			m.extra[c] = number(c.c_str(), 0.0);
+		rows.push_back(m);
+	}
+	return true;
+}
+
+void ResultsFile::mergeRepeats() {
+	std::vector<Measurement> merged;
+	std::vector<std::vector<const Measurement*>> groups;
+	for (const Measurement& m : rows) {
+		size_t i = 0;
+		while (i < merged.size() && !(merged[i].set == m.set && merged[i].scene == m.scene && merged[i].state == m.state))
+			++i;
+		if (i == merged.size()) {
+			merged.push_back(m);
+			groups.emplace_back();
+		}
+		groups[i].push_back(&m);
+	}
+
+	for (size_t i = 0; i < merged.size(); ++i) {
+		const std::vector<const Measurement*>& group = groups[i];
+		if (group.size() < 2)
+			continue;
+
+		// the means are weighted by the runs of the lines, a line of benchmark_runner stands for all its renders
+		Measurement& m = merged[i];
+		std::vector<double> build, trace, buildStddev, traceStddev;
+		std::vector<int> runs;
+		m.build_time = m.trace_time = m.ray_count = 0.0;
+		m.runs = 0;
+		for (const Measurement* g : group) {
+			build.push_back(g->build_time);
+			trace.push_back(g->trace_time);
+			buildStddev.push_back(g->build_stddev);
+			traceStddev.push_back(g->trace_stddev);
+			runs.push_back(std::max(g->runs, 1));
+			m.build_time += g->build_time * runs.back();
+			m.trace_time += g->trace_time * runs.back();
+			m.ray_count += g->ray_count * runs.back();
+			m.build_min = std::min(m.build_min, g->build_min);
+			m.trace_min = std::min(m.trace_min, g->trace_min);
+			m.runs += runs.back();
+		}
+		m.build_time /= m.runs;
+		m.trace_time /= m.runs;
+		m.ray_count /= m.runs;
+
+		// the extra columns over the runs that measured them, nan (not measured) is left out
+		for (auto& e : m.extra) {
+			double sum = 0.0;
+			int count = 0;
+			for (size_t j = 0; j < group.size(); ++j)
+				if (!std::isnan(group[j]->extra.at(e.first))) {
+					sum += group[j]->extra.at(e.first) * runs[j];
+					count += runs[j];
+				}
+			e.second = count ? sum / count : std::numeric_limits<double>::quiet_NaN();
+		}
+		m.build_stddev = pooledStddev(build, buildStddev, runs, m.build_time);
+		m.trace_stddev = pooledStddev(trace, traceStddev, runs, m.trace_time);
+	}
+	rows = merged;
+}
+
+std::vector<std::string> ResultsFile::sets() const {
+	std::vector<std::string> names;
+	for (const Measurement& m : rows)
+		if (std::find(names.begin(), names.end(), m.set) == names.end())
+			names.push_back(m.set);
+	return names;
+}
+
+const Measurement* ResultsFile::find(const std::string& set, const std::string& scene, const std::string& state) const {
+	for (const Measurement& m : rows)
+		if (m.set == set && m.scene == scene && m.state == state)
+			return &m;
+	return nullptr;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// Reading the timing results files written by the batch render (-bat_render), the headless renderer
+// and the benchmark runner. Portable, unlike the GDI+ plotter in main.cpp.
+
+#include <map>
+#include <string>
+#include <vector>
+
+// one line of a results file, or the merge of the lines of the same measurement
+struct Measurement {
+	std::string set, scene, state;
+	double build_time, trace_time;		// ms, means if the line has several runs
+	double ray_count;
+	double build_stddev, trace_stddev;	// ms, 0 if unknown
+	double build_min, trace_min;		// ms, the mean if unknown
+	int runs;							// renders the times are over
+	std::map<std::string, double> extra;	// numeric columns this reader does not know, by header name
+
+	double mraysPerSecond() const { return trace_time > 0.0 ? ray_count / trace_time / 1000.0 : 0.0; }
+};
+
+struct ResultsFile {
+	std::string name;						// file name without folders and extension, the chart title
+	std::vector<std::string> extraColumns;	// in file order
+	std::vector<Measurement> rows;
+
+	// The first line is the header, the columns are found by name so files with more columns
+	// (e.g. benchmark_runner's deviations) read the same. Returns false and the reason on failure.
+	bool read(const std::string& fileName, std::string& error);
+
+	// Lines of the same set, scene and state (e.g. a set that was run several times, as in
+	// "identical set.bat", or benchmark_runner appending to the same file again) become one
+	// measurement over all their runs: the mean and deviation pooled from each line's mean,
+	// deviation and run count.
+	void mergeRepeats();
+
+	// set names in order of first appearance
+	std::vector<std::string> sets() const;
+
+	const Measurement* find(const std::string& set, const std::string& scene, const std::string& state) const;
+};
@@ -0,0 +1,358 @@
+/*
+
+Portable version of the plotter: reads a timing results file and writes
+
+	<results>.html		the charts and tables, open in any browser
+	<results>_*.svg		build time, trace time, rays per second and speedup charts on their own
+	<results>.json		per set and per measurement summary for dashboards
+
+bench_report results.txt [-baseline set_name] [-out prefix]
+
+The speedups are relative to the baseline set, the first set of the file by default.
+Built by CMakeLists.txt, needs nothing but the standard library.
+
+Regression gate: instead of the charts, compares the results against a stored results file of the same
+sets and states and exits with 1 if anything got slower past the limits (see Regression.hpp):
+
+bench_report results.txt -regress baseline.txt [-threshold percent] [-build_threshold percent]
+	[-trace_threshold percent] [-rays_threshold percent] [-sigmas standard_errors] [-min_ms ms] [-allow_missing]
+	[-min_speedup set other_set factor]...
+
+-min_speedup checks the results alone, e.g. "-min_speedup SAH object 1.3" for SAH tracing at least 30%
+faster than the object median split, and can be given without -regress.
+
+*/
+
+#include "Regression.hpp"
+#include "Results.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// the colors of the GDI+ plotter
+const char* colors[] = { "#FAA43A", "#60BD68", "#F17CB0", "#B2912F", "#B276B2", "#DECF3F", "#F15854", "#5DA5DA" };
+const size_t numColors = sizeof(colors) / sizeof(colors[0]);
+
+struct Series {
+	string name;
+	vector<double> values;	// per group, NaN if the set has no such measurement
+	vector<double> errors;	// standard deviations, 0 if unknown
+};
+
+struct SetSummary {
+	string name;
+	double build_time, trace_time, ray_count;	// sums over the set's measurements
+	double trace_speedup;						// geometric mean over the states measured by both sets, 0 if none
+	double total_speedup;						// of build + trace summed over the common states
+	int states;
+};
+
+string escapeXml(const string& s) {
+	string out;
+	for (char c : s)
+		switch (c) {
+		case '<': out += "&lt;"; break;
+		case '>': out += "&gt;"; break;
+		case '&': out += "&amp;"; break;
+		case '"': out += "&quot;"; break;
+		default: out += c;
+		}
+	return out;
+}
+
+string escapeJson(const string& s) {
+	string out;
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+string number(double v, int decimals) {
+	if (!std::isfinite(v))
+		return "null";
+	ostringstream s;
+	s << fixed << setprecision(decimals) << v;
+	return s.str();
+}
+
+// 1, 2 or 5 times a power of ten, so that about five ticks cover maxValue
+double tickStep(double maxValue) {
+	double rough = max(maxValue, 1e-9) / 5.0;
+	double power = pow(10.0, floor(log10(rough)));
+	for (double m : { 1.0, 2.0, 5.0 })
+		if (m * power >= rough)
+			return m * power;
+	return 10.0 * power;
+}
+
+// Grouped bar chart: one group per (scene, state), one bar per set, with error bars of one standard
+// deviation. A positive reference draws a dashed line at that value, e.g. 1 for speedups.
+string barChart(const string& title, const string& unit, const vector<string>& groups, const vector<Series>& series, double reference = 0.0) {
+	const int barWidth = 14, groupGap = 18, left = 70, right = 20, top = 60, plotHeight = 300, bottom = 140;
+	int groupWidth = barWidth * (int)series.size() + groupGap;
+	int width = max(640, left + right + groupWidth * (int)groups.size());
+	int height = top + plotHeight + bottom;
+
+	double maxValue = reference;
+	for (const Series& s : series)
+		for (size_t i = 0; i < s.values.size(); ++i)
+			if (std::isfinite(s.values[i]))
+				maxValue = max(maxValue, s.values[i] + s.errors[i]);
+	double step = tickStep(maxValue);
+	double scale = maxValue > 0.0 ? plotHeight / (ceil(maxValue / step) * step) : 0.0;
+	auto y = [&](double v) { return top + plotHeight - v * scale; };
+
+	ostringstream svg;
+	svg << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width << "\" height=\"" << height << "\" font-family=\"sans-serif\" font-size=\"12\">\n";
+	svg << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+	svg << "<text x=\"" << width / 2 << "\" y=\"24\" text-anchor=\"middle\" font-size=\"18\" font-weight=\"bold\">" << escapeXml(title) << "</text>\n";
+
+	// axes and ticks
+	for (double v = 0.0; scale > 0.0 && y(v) >= top - 0.5; v += step) {
+		svg << "<line x1=\"" << left << "\" x2=\"" << width - right << "\" y1=\"" << number(y(v), 1) << "\" y2=\"" << number(y(v), 1) << "\" stroke=\"#e0e0e0\"/>\n";
+		svg << "<text x=\"" << left - 6 << "\" y=\"" << number(y(v) + 4, 1) << "\" text-anchor=\"end\">" << number(v, step < 1.0 ? 2 : 0) << "</text>\n";
+	}
+	svg << "<text transform=\"translate(16," << top + plotHeight / 2 << ") rotate(-90)\" text-anchor=\"middle\">" << escapeXml(unit) << "</text>\n";
+	svg << "<line x1=\"" << left << "\" x2=\"" << left << "\" y1=\"" << top << "\" y2=\"" << top + plotHeight << "\" stroke=\"black\"/>\n";
+	svg << "<line x1=\"" << left << "\" x2=\"" << width - right << "\" y1=\"" << top + plotHeight << "\" y2=\"" << top + plotHeight << "\" stroke=\"black\"/>\n";
+
+	// bars
+	for (size_t g = 0; g < groups.size(); ++g) {
+		int x0 = left + groupGap / 2 + (int)g * groupWidth;
+		for (size_t s = 0; s < series.size(); ++s) {
+			double v = series[s].values[g];
+			if (!std::isfinite(v))
+				continue;
+			int x = x0 + (int)s * barWidth;
+			svg << "<rect x=\"" << x << "\" y=\"" << number(y(v), 1) << "\" width=\"" << barWidth << "\" height=\"" << number(v * scale, 1)
+				<< "\" fill=\"" << colors[s % numColors] << "\" stroke=\"black\" stroke-width=\"0.5\"><title>" << escapeXml(series[s].name) << ": " << number(v, 2) << " " << escapeXml(unit) << "</title></rect>\n";
+			double e = series[s].errors[g];
+			if (e > 0.0) {
+				double cx = x + barWidth / 2.0;
+				svg << "<path d=\"M" << number(cx, 1) << " " << number(y(v + e), 1) << "V" << number(y(max(v - e, 0.0)), 1)
+					<< "M" << number(cx - 3, 1) << " " << number(y(v + e), 1) << "h6M" << number(cx - 3, 1) << " " << number(y(max(v - e, 0.0)), 1) << "h6\" stroke=\"black\"/>\n";
+			}
+		}
+		double lx = x0 + barWidth * series.size() / 2.0;
+		svg << "<text transform=\"translate(" << number(lx, 1) << "," << top + plotHeight + 12 << ") rotate(45)\">" << escapeXml(groups[g]) << "</text>\n";
+	}
+
+	if (reference > 0.0)
+		svg << "<line x1=\"" << left << "\" x2=\"" << width - right << "\" y1=\"" << number(y(reference), 1) << "\" y2=\"" << number(y(reference), 1) << "\" stroke=\"black\" stroke-dasharray=\"4 3\"/>\n";
+
+	// legend
+	for (size_t s = 0; s < series.size(); ++s) {
+		int x = left + 10 + (int)s * 140;
+		svg << "<rect x=\"" << x << "\" y=\"36\" width=\"12\" height=\"12\" fill=\"" << colors[s % numColors] << "\" stroke=\"black\" stroke-width=\"0.5\"/>";
+		svg << "<text x=\"" << x + 16 << "\" y=\"46\">" << escapeXml(series[s].name) << "</text>\n";
+	}
+	svg << "</svg>\n";
+	return svg.str();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	vector<string> args(argv, argv + argc);
+	if (args.size() < 2) {
+		cout << "Usage: " << args[0] << " results.txt [-baseline set_name] [-out prefix]" << endl;
+		return 1;
+	}
+
+	ResultsFile results;
+	string error;
+	if (!results.read(args[1], error)) {
+		cout << "Couldn't read the results: " << error << endl;
+		return 1;
+	}
+	results.mergeRepeats();
+
+	vector<string> sets = results.sets();
+	if (sets.empty()) {
+		cout << "'" << args[1] << "' has no measurements!" << endl;
+		return 1;
+	}
+
+	string baseline = sets[0];
+	size_t dot = args[1].find_last_of('.');
+	string prefix = dot != string::npos && dot > args[1].find_last_of("/\\") + 1 ? args[1].substr(0, dot) : args[1];
+	string regressionBaseline;
+	RegressionLimits limits;
+	vector<SpeedupRequirement> speedups;
+	for (size_t i = 2; i < args.size(); ++i) {
+		bool hasValue = i + 1 < args.size();
+		if (args[i] == "-baseline" && hasValue)
+			baseline = args[++i];
+		else if (args[i] == "-out" && hasValue)
+			prefix = args[++i];
+		else if (args[i] == "-regress" && hasValue)
+			regressionBaseline = args[++i];
+		else if (args[i] == "-threshold" && hasValue)
+			limits.threshold[Metric_BuildTime] = limits.threshold[Metric_TraceTime] = limits.threshold[Metric_RaysPerSecond] = atof(args[++i].c_str());
+		else if (args[i] == "-build_threshold" && hasValue)
+			limits.threshold[Metric_BuildTime] = atof(args[++i].c_str());
+		else if (args[i] == "-trace_threshold" && hasValue)
+			limits.threshold[Metric_TraceTime] = atof(args[++i].c_str());
+		else if (args[i] == "-rays_threshold" && hasValue)
+			limits.threshold[Metric_RaysPerSecond] = atof(args[++i].c_str());
+		else if (args[i] == "-sigmas" && hasValue)
+			limits.sigmas = atof(args[++i].c_str());
+		else if (args[i] == "-min_ms" && hasValue)
+			limits.minMs = atof(args[++i].c_str());
+		else if (args[i] == "-allow_missing")
+			limits.allowMissing = true;
+		else if (args[i] == "-min_speedup" && i + 3 < args.size()) {
+			speedups.push_back({ args[i + 1], args[i + 2], atof(args[i + 3].c_str()) });
+			i += 3;
+		}
+		else {
+			cout << "Argument '" << args[i] << "' not recognized!" << endl;
+			return 1;
+		}
+	}
+
+	if (!regressionBaseline.empty() || !speedups.empty()) {
+		ResultsFile stored;
+		if (!regressionBaseline.empty()) {
+			if (!stored.read(regressionBaseline, error)) {
+				cout << "Couldn't read the baseline: " << error << endl;
+				return 1;
+			}
+			stored.mergeRepeats();
+		}
+		return checkRegressions(stored, results, limits, speedups, cout) ? 1 : 0;
+	}
+	if (find(sets.begin(), sets.end(), baseline) == sets.end()) {
+		cout << "There is no set '" << baseline << "' to compare against!" << endl;
+		return 1;
+	}
+
+	// the groups of the charts, scene by scene in order of appearance
+	vector<string> scenes;
+	for (const Measurement& m : results.rows)
+		if (find(scenes.begin(), scenes.end(), m.scene) == scenes.end())
+			scenes.push_back(m.scene);
+	vector<pair<string, string>> views;
+	for (const string& scene : scenes)
+		for (const Measurement& m : results.rows)
+			if (m.scene == scene && find(views.begin(), views.end(), make_pair(m.scene, m.state)) == views.end())
+				views.emplace_back(m.scene, m.state);
+	vector<string> groups;
+	for (auto& v : views)
+		groups.push_back(v.first + ": " + v.second);
+
+	vector<Series> build(sets.size()), trace(sets.size()), mrays(sets.size()), speedup(sets.size());
+	vector<SetSummary> summaries(sets.size());
+	for (size_t s = 0; s < sets.size(); ++s) {
+		build[s].name = trace[s].name = mrays[s].name = speedup[s].name = sets[s];
+		SetSummary& sum = summaries[s];
+		sum = SetSummary{ sets[s], 0.0, 0.0, 0.0, 0.0, 0.0, 0 };
+		double logSpeedup = 0.0, baseTotal = 0.0, setTotal = 0.0;
+		int common = 0;
+		for (auto& v : views) {
+			const Measurement* m = results.find(sets[s], v.first, v.second);
+			const Measurement* b = results.find(baseline, v.first, v.second);
+			double nan = numeric_limits<double>::quiet_NaN();
+			build[s].values.push_back(m ? m->build_time : nan);
+			build[s].errors.push_back(m ? m->build_stddev : 0.0);
+			trace[s].values.push_back(m ? m->trace_time : nan);
+			trace[s].errors.push_back(m ? m->trace_stddev : 0.0);
+			mrays[s].values.push_back(m ? m->mraysPerSecond() : nan);
+			mrays[s].errors.push_back(m && m->trace_time > 0.0 ? m->mraysPerSecond() * m->trace_stddev / m->trace_time : 0.0);
+			bool comparable = m && b && m->trace_time > 0.0 && b->trace_time > 0.0;
+			speedup[s].values.push_back(comparable ? b->trace_time / m->trace_time : nan);
+			speedup[s].errors.push_back(0.0);
+			if (m) {
+				sum.build_time += m->build_time;
+				sum.trace_time += m->trace_time;
+				sum.ray_count += m->ray_count;
+				++sum.states;
+			}
+			if (comparable) {
+				logSpeedup += log(b->trace_time / m->trace_time);
+				baseTotal += b->build_time + b->trace_time;
+				setTotal += m->build_time + m->trace_time;
+				++common;
+			}
+		}
+		sum.trace_speedup = common ? exp(logSpeedup / common) : 0.0;
+		sum.total_speedup = setTotal > 0.0 ? baseTotal / setTotal : 0.0;
+	}
+
+	struct Chart { string file, svg; };
+	vector<Chart> charts = {
+		{ "build", barChart("Build time", "ms", groups, build) },
+		{ "trace", barChart("Trace time", "ms", groups, trace) },
+		{ "mrays", barChart("Rays per second", "MRays/s", groups, mrays) },
+		{ "speedup", barChart("Trace speedup over " + baseline, "x", groups, speedup, 1.0) },
+	};
+	for (const Chart& c : charts)
+		ofstream(prefix + "_" + c.file + ".svg") << c.svg;
+
+	ofstream html(prefix + ".html");
+	html << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>" << escapeXml(results.name) << "</title>\n"
+		<< "<style>body{font-family:sans-serif} table{border-collapse:collapse} td,th{border:1px solid #ccc;padding:2px 8px;text-align:right} td:first-child,th:first-child{text-align:left}</style>\n"
+		<< "</head><body>\n<h1>" << escapeXml(results.name) << "</h1>\n";
+	html << "<table><tr><th>set</th><th>build (ms)</th><th>trace (ms)</th><th>MRays/s</th><th>MRays/s incl. build</th><th>trace speedup</th><th>total speedup</th><th>states</th></tr>\n";
+	for (const SetSummary& s : summaries)
+		html << "<tr><td>" << escapeXml(s.name) << "</td><td>" << number(s.build_time, 0) << "</td><td>" << number(s.trace_time, 0)
+			<< "</td><td>" << number(s.trace_time > 0.0 ? s.ray_count / s.trace_time / 1000.0 : 0.0, 2)
+			<< "</td><td>" << number(s.build_time + s.trace_time > 0.0 ? s.ray_count / (s.build_time + s.trace_time) / 1000.0 : 0.0, 2)
+			<< "</td><td>" << number(s.trace_speedup, 3) << "</td><td>" << number(s.total_speedup, 3) << "</td><td>" << s.states << "</td></tr>\n";
+	html << "</table>\n<p>Speedups are over " << escapeXml(baseline) << "; the trace speedup is the geometric mean over the states, error bars are one standard deviation.</p>\n";
+	for (const Chart& c : charts)
+		html << "<div>\n" << c.svg << "</div>\n";
+	html << "<table><tr><th>set</th><th>scene</th><th>state</th><th>build (ms)</th><th>trace (ms)</th><th>rays</th><th>MRays/s</th><th>build sd</th><th>trace sd</th><th>trace min</th><th>runs</th>";
+	for (const string& c : results.extraColumns)
+		html << "<th>" << escapeXml(c) << "</th>";
+	html << "</tr>\n";
+	for (const Measurement& m : results.rows) {
+		html << "<tr><td>" << escapeXml(m.set) << "</td><td>" << escapeXml(m.scene) << "</td><td>" << escapeXml(m.state) << "</td><td>" << number(m.build_time, 1)
+			<< "</td><td>" << number(m.trace_time, 1) << "</td><td>" << number(m.ray_count, 0) << "</td><td>" << number(m.mraysPerSecond(), 2)
+			<< "</td><td>" << number(m.build_stddev, 2) << "</td><td>" << number(m.trace_stddev, 2) << "</td><td>" << number(m.trace_min, 0) << "</td><td>" << m.runs << "</td>";
+		for (const string& c : results.extraColumns)
+			html << "<td>" << number(m.extra.at(c), 2) << "</td>";
+		html << "</tr>\n";
+	}
+	html << "</table>\n</body></html>\n";
+
+	ofstream json(prefix + ".json");
+	json << "{\n  \"name\": \"" << escapeJson(results.name) << "\",\n  \"baseline\": \"" << escapeJson(baseline) << "\",\n  \"sets\": [\n";
+	for (size_t i = 0; i < summaries.size(); ++i) {
+		const SetSummary& s = summaries[i];
+		json << "    {\"name\": \"" << escapeJson(s.name) << "\", \"build_ms\": " << number(s.build_time, 2) << ", \"trace_ms\": " << number(s.trace_time, 2)
+			<< ", \"ray_count\": " << number(s.ray_count, 0) << ", \"mrays_per_s\": " << number(s.trace_time > 0.0 ? s.ray_count / s.trace_time / 1000.0 : 0.0, 3)
+			<< ", \"trace_speedup\": " << number(s.trace_speedup, 4) << ", \"total_speedup\": " << number(s.total_speedup, 4) << ", \"states\": " << s.states << "}"
+			<< (i + 1 < summaries.size() ? "," : "") << "\n";
+	}
+	json << "  ],\n  \"measurements\": [\n";
+	for (size_t i = 0; i < results.rows.size(); ++i) {
+		const Measurement& m = results.rows[i];
+		json << "    {\"set\": \"" << escapeJson(m.set) << "\", \"scene\": \"" << escapeJson(m.scene) << "\", \"state\": \"" << escapeJson(m.state)
+			<< "\", \"build_ms\": " << number(m.build_time, 2) << ", \"trace_ms\": " << number(m.trace_time, 2) << ", \"ray_count\": " << number(m.ray_count, 0)
+			<< ", \"mrays_per_s\": " << number(m.mraysPerSecond(), 3) << ", \"build_stddev_ms\": " << number(m.build_stddev, 2) << ", \"trace_stddev_ms\": " << number(m.trace_stddev, 2)
+			<< ", \"build_min_ms\": " << number(m.build_min, 2) << ", \"trace_min_ms\": " << number(m.trace_min, 2) << ", \"runs\": " << m.runs;
+		for (const string& c : results.extraColumns)
+			json << ", \"" << escapeJson(c) << "\": " << number(m.extra.at(c), 4);
+		json << "}" << (i + 1 < results.rows.size() ? "," : "") << "\n";
+	}
+	json << "  ]\n}\n";
+
+	cout << "Wrote " << prefix << ".html, " << prefix << ".json and " << charts.size() << " charts" << endl;
+	return 0;
+}